@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// HDR style latency histogram: every power of two range is split into sub_buckets_count linear buckets, so
+// a recorded value is kept with a relative error below 1 / sub_buckets_count over the whole uint64_t range.
+class Histogram {
+public:
+    static constexpr unsigned int sub_buckets_bits {7};
+    static constexpr uint64_t sub_buckets_count {1ull << sub_buckets_bits};
+
+    Histogram() : m_counts(BucketIndex(UINT64_MAX) + 1, 0) {}
+
+    void Record(uint64_t value)
+    {
+        ++m_counts[BucketIndex(value)];
+        ++m_total;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    void Merge(const Histogram& other)
+    {
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    // Highest value that is equivalent to the one at quantile (0..1), 0 if nothing was recorded.
+    uint64_t Percentile(double quantile) const
+    {
+        if (m_total == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * m_total + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= rank)
+            {
+                return std::min(HighestEquivalent(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    uint64_t Count() const
+    {
+        return m_total;
+    }
+
+    uint64_t Min() const
+    {
+        return m_total == 0 ? 0 : m_min;
+    }
+
+    uint64_t Max() const
+    {
+        return m_max;
+    }
+
+    double Mean() const
+    {
+        return m_total == 0 ? 0.0 : static_cast<double>(m_sum) / m_total;
+    }
+private:
+    // Values below sub_buckets_count have a bucket each, above that a power of two range [2^k, 2^(k+1)) maps
+    // onto sub_buckets_count buckets of width 2^(k - sub_buckets_bits).
+    static size_t BucketIndex(uint64_t value)
+    {
+        if (value < sub_buckets_count)
+        {
+            return value;
+        }
+        unsigned int shift = std::bit_width(value) - 1 - sub_buckets_bits;
+        return (shift + 1) * sub_buckets_count + ((value >> shift) - sub_buckets_count);
+    }
+
+    static uint64_t HighestEquivalent(size_t index)
+    {
+        size_t block = index / sub_buckets_count;
+        uint64_t offset = index % sub_buckets_count;
+        if (block == 0)
+        {
+            return offset;
+        }
+        unsigned int shift = block - 1;
+        return ((sub_buckets_count + offset + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total {0};
+    uint64_t m_sum {0};
+    uint64_t m_min {UINT64_MAX};
+    uint64_t m_max {0};
+};
@@ -0,0 +1,821 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Histogram.h"
+#include "../udptcp_server/server/Framing.h"
+
+// Load generator for a local Server: TCP connections and UDP flows spread over worker threads send /time,
+// /stats and echo requests either as fast as replies come back (closed loop) or on a fixed schedule (open
+// loop). Latency of an open loop request is measured from the time it was due, not from when it was sent,
+// so a stalled server is not hidden by the generator waiting for it.
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+enum class Protocol
+{
+    Tcp,
+    Udp,
+    Count
+};
+
+enum class Command
+{
+    Time,
+    Stats,
+    Echo,
+    Count
+};
+
+constexpr size_t protocols_count {static_cast<size_t>(Protocol::Count)};
+constexpr size_t commands_count {static_cast<size_t>(Command::Count)};
+
+const char* Name(Protocol protocol)
+{
+    return protocol == Protocol::Tcp ? "tcp" : "udp";
+}
+
+const char* Name(Command command)
+{
+    switch (command)
+    {
+    case Command::Time:
+        return "/time";
+    case Command::Stats:
+        return "/stats";
+    default:
+        return "echo";
+    }
+}
+
+struct BenchConfig
+{
+    std::string host {"127.0.0.1"};
+    int port {8087};
+    unsigned int threads {4};
+    unsigned int tcp_connections {64};
+    unsigned int udp_flows {0};
+    // requests per second over all connections and flows, 0 runs closed loop
+    double rate {0};
+    // closed loop requests in flight per connection
+    unsigned int depth {1};
+    double warmup {1};
+    double duration {10};
+    unsigned int timeout_ms {1000};
+    std::array<unsigned int, commands_count> weights {0, 0, 1};
+    size_t payload_size {32};
+    FramingMode framing {FramingMode::Raw};
+    bool is_json {true};
+};
+
+struct Series
+{
+    Histogram latency;
+};
+
+struct WorkerStats
+{
+    std::array<std::array<Series, commands_count>, protocols_count> series;
+    uint64_t requests {0};
+    uint64_t errors {0};
+    uint64_t timeouts {0};
+};
+
+struct Pending
+{
+    Clock::time_point start;
+    Command command;
+};
+
+struct Flow
+{
+    int socket {-1};
+    Protocol protocol {Protocol::Tcp};
+    bool is_dead {false};
+    bool is_write_armed {false};
+    std::deque<Pending> pending;
+    std::string input;
+    std::string output;
+    size_t output_offset {0};
+    Clock::time_point next_send;
+};
+
+void Usage()
+{
+    std::cerr << "Usage: bench [options]\n"
+        "  --host ADDRESS        server IPv4 address (127.0.0.1)\n"
+        "  --port PORT           server port (8087)\n"
+        "  --threads N           worker threads (4)\n"
+        "  --tcp N               TCP connections (64)\n"
+        "  --udp N               UDP flows (0)\n"
+        "  --rate R              open loop: requests per second over all connections; 0 is closed loop (0)\n"
+        "  --depth N             closed loop: requests in flight per connection (1)\n"
+        "  --warmup S            seconds before recording starts (1)\n"
+        "  --duration S          seconds of recording (10)\n"
+        "  --timeout-ms MS       a request without a reply for this long counts as timed out (1000)\n"
+        "  --mix SPEC            request weights, e.g. time=8,stats=1,echo=1 (echo=1)\n"
+        "  --payload N           echo payload size in bytes (32)\n"
+        "  --framing MODE        raw, newline or length; must match SERVER_FRAMING (raw)\n"
+        "  --format FORMAT       json or text (json)\n";
+}
+
+void ParseMix(std::string_view spec, std::array<unsigned int, commands_count>& weights)
+{
+    weights.fill(0);
+    while (!spec.empty())
+    {
+        size_t comma = spec.find(',');
+        std::string_view part = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        size_t equal = part.find('=');
+        std::string_view name = part.substr(0, equal);
+        unsigned int weight = equal == std::string_view::npos ? 1 : std::stoul(std::string(part.substr(equal + 1)));
+        if (name == "time")
+        {
+            weights[static_cast<size_t>(Command::Time)] = weight;
+        }
+        else if (name == "stats")
+        {
+            weights[static_cast<size_t>(Command::Stats)] = weight;
+        }
+        else if (name == "echo")
+        {
+            weights[static_cast<size_t>(Command::Echo)] = weight;
+        }
+        else
+        {
+            throw std::runtime_error("unknown command in --mix: " + std::string(name));
+        }
+    }
+}
+
+BenchConfig ParseArgs(int argc, char** argv)
+{
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view option = argv[i];
+        if (option == "--help" || option == "-h")
+        {
+            Usage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc)
+        {
+            throw std::runtime_error("missing value of " + std::string(option));
+        }
+        std::string value = argv[++i];
+        if (option == "--host")
+        {
+            config.host = value;
+        }
+        else if (option == "--port")
+        {
+            config.port = std::stoi(value);
+        }
+        else if (option == "--threads")
+        {
+            config.threads = std::max(1ul, std::stoul(value));
+        }
+        else if (option == "--tcp")
+        {
+            config.tcp_connections = std::stoul(value);
+        }
+        else if (option == "--udp")
+        {
+            config.udp_flows = std::stoul(value);
+        }
+        else if (option == "--rate")
+        {
+            config.rate = std::stod(value);
+        }
+        else if (option == "--depth")
+        {
+            config.depth = std::max(1ul, std::stoul(value));
+        }
+        else if (option == "--warmup")
+        {
+            config.warmup = std::stod(value);
+        }
+        else if (option == "--duration")
+        {
+            config.duration = std::stod(value);
+        }
+        else if (option == "--timeout-ms")
+        {
+            config.timeout_ms = std::stoul(value);
+        }
+        else if (option == "--mix")
+        {
+            ParseMix(value, config.weights);
+        }
+        else if (option == "--payload")
+        {
+            config.payload_size = std::max(1ul, std::stoul(value));
+        }
+        else if (option == "--framing")
+        {
+            if (!Framing::Parse(value, config.framing))
+            {
+                throw std::runtime_error("invalid value of --framing: " + value);
+            }
+        }
+        else if (option == "--format")
+        {
+            if (value != "json" && value != "text")
+            {
+                throw std::runtime_error("invalid value of --format: " + value);
+            }
+            config.is_json = value == "json";
+        }
+        else
+        {
+            throw std::runtime_error("unknown option " + std::string(option));
+        }
+    }
+    if (config.tcp_connections + config.udp_flows == 0)
+    {
+        throw std::runtime_error("nothing to run: --tcp and --udp are both 0");
+    }
+    if (config.weights[0] + config.weights[1] + config.weights[2] == 0)
+    {
+        throw std::runtime_error("--mix has no command with a weight");
+    }
+    // a raw stream has no message boundaries, one reply per read only holds with one request in flight
+    if (config.framing == FramingMode::Raw && config.tcp_connections > 0 && (config.rate > 0 || config.depth > 1))
+    {
+        throw std::runtime_error("raw framing only supports closed loop with --depth 1, use --framing newline or length");
+    }
+    return config;
+}
+
+int Connect(const BenchConfig& config, Protocol protocol)
+{
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) != 1)
+    {
+        throw std::runtime_error("invalid --host " + config.host);
+    }
+    int fd = socket(AF_INET, protocol == Protocol::Tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error(std::string("socket failed: ") + strerror(errno));
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error(std::string("connect failed: ") + strerror(error));
+    }
+    if (protocol == Protocol::Tcp)
+    {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+class Worker {
+public:
+    Worker(const BenchConfig& config, unsigned int id) : m_config(config), m_epoll(epoll_create1(0)),
+        m_random(0x9e3779b97f4a7c15ull * (id + 1)), m_echo(config.payload_size, 'x')
+    {
+        if (m_epoll < 0)
+        {
+            throw std::runtime_error(std::string("epoll_create1 failed: ") + strerror(errno));
+        }
+        m_weights_total = m_config.weights[0] + m_config.weights[1] + m_config.weights[2];
+    }
+
+    ~Worker()
+    {
+        for (auto& flow : m_flows)
+        {
+            if (flow->socket >= 0)
+            {
+                close(flow->socket);
+            }
+        }
+        close(m_epoll);
+    }
+
+    void AddFlow(Protocol protocol)
+    {
+        auto flow = std::make_unique<Flow>();
+        flow->protocol = protocol;
+        flow->socket = Connect(m_config, protocol);
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.ptr = flow.get();
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, flow->socket, &event);
+        m_flows.push_back(std::move(flow));
+    }
+
+    // Sends during [start, end), records requests due after measure_start and drains replies after end.
+    void Run(Clock::time_point start, Clock::time_point measure_start, Clock::time_point end, size_t flows_total)
+    {
+        m_measure_start = measure_start;
+        m_end = end;
+        bool is_open_loop = m_config.rate > 0;
+        Clock::duration interval {};
+        if (is_open_loop)
+        {
+            interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(flows_total / m_config.rate));
+        }
+        for (size_t i = 0; i < m_flows.size(); ++i)
+        {
+            Flow& flow = *m_flows[i];
+            if (is_open_loop)
+            {
+                // spread the first requests over one interval so the flows do not fire in bursts
+                flow.next_send = start + interval * i / m_flows.size();
+            }
+            else
+            {
+                for (unsigned int j = 0; j < m_config.depth; ++j)
+                {
+                    Send(flow, Clock::now());
+                }
+            }
+        }
+
+        std::array<epoll_event, 64> events;
+        auto drain_end = end + std::chrono::milliseconds(m_config.timeout_ms);
+        for (auto now = Clock::now(); now < drain_end; now = Clock::now())
+        {
+            bool is_sending = now < end;
+            int timeout = 10;
+            if (is_open_loop && is_sending)
+            {
+                auto next = SendDue(interval, now);
+                // rounded up, spinning on a zero timeout would take the CPU from the server under test
+                timeout = std::clamp<long>(std::chrono::ceil<std::chrono::milliseconds>(next - now).count(), 0, 10);
+            }
+            else if (!is_sending && IsDrained())
+            {
+                break;
+            }
+            int count = epoll_wait(m_epoll, events.data(), events.size(), timeout);
+            for (int i = 0; i < count; ++i)
+            {
+                Flow& flow = *static_cast<Flow*>(events[i].data.ptr);
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                {
+                    Receive(flow, !is_open_loop && is_sending);
+                }
+                if ((events[i].events & EPOLLOUT) && !flow.is_dead)
+                {
+                    Flush(flow);
+                }
+            }
+            ExpireTimeouts(Clock::now(), !is_open_loop && is_sending);
+        }
+        for (auto& flow : m_flows)
+        {
+            for (const Pending& pending : flow->pending)
+            {
+                m_stats.timeouts += IsMeasured(pending) ? 1 : 0;
+            }
+            flow->pending.clear();
+        }
+    }
+
+    const WorkerStats& Stats() const
+    {
+        return m_stats;
+    }
+private:
+    bool IsMeasured(const Pending& pending) const
+    {
+        return pending.start >= m_measure_start && pending.start < m_end;
+    }
+
+    bool IsDrained() const
+    {
+        for (const auto& flow : m_flows)
+        {
+            if (!flow->is_dead && !flow->pending.empty())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Sends every request that is due and returns when the next one is.
+    Clock::time_point SendDue(Clock::duration interval, Clock::time_point now)
+    {
+        Clock::time_point next = now + std::chrono::milliseconds(10);
+        for (auto& flow : m_flows)
+        {
+            while (!flow->is_dead && flow->next_send <= now)
+            {
+                Send(*flow, flow->next_send);
+                flow->next_send += interval;
+            }
+            next = std::min(next, flow->next_send);
+        }
+        return next;
+    }
+
+    Command NextCommand()
+    {
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 7;
+        m_random ^= m_random << 17;
+        uint64_t point = m_random % m_weights_total;
+        for (size_t i = 0; i < commands_count; ++i)
+        {
+            if (point < m_config.weights[i])
+            {
+                return static_cast<Command>(i);
+            }
+            point -= m_config.weights[i];
+        }
+        return Command::Echo;
+    }
+
+    std::string_view Payload(Command command) const
+    {
+        switch (command)
+        {
+        case Command::Time:
+            return "/time";
+        case Command::Stats:
+            return "/stats";
+        default:
+            return m_echo;
+        }
+    }
+
+    void Send(Flow& flow, Clock::time_point start)
+    {
+        if (flow.is_dead)
+        {
+            return;
+        }
+        Command command = NextCommand();
+        std::string_view payload = Payload(command);
+        Pending pending {start, command};
+        m_stats.requests += IsMeasured(pending) ? 1 : 0;
+        if (flow.protocol == Protocol::Udp)
+        {
+            if (send(flow.socket, payload.data(), payload.size(), 0) < 0)
+            {
+                m_stats.errors += IsMeasured(pending) ? 1 : 0;
+                return;
+            }
+            flow.pending.push_back(pending);
+            return;
+        }
+        size_t frame_start = Framing::BeginFrame(m_config.framing, flow.output);
+        flow.output.append(payload);
+        Framing::EndFrame(m_config.framing, flow.output, frame_start);
+        flow.pending.push_back(pending);
+        Flush(flow);
+    }
+
+    void Flush(Flow& flow)
+    {
+        while (flow.output_offset < flow.output.size())
+        {
+            ssize_t written = send(flow.socket, flow.output.data() + flow.output_offset, flow.output.size() - flow.output_offset, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    ArmWrite(flow, true);
+                    return;
+                }
+                Kill(flow);
+                return;
+            }
+            flow.output_offset += written;
+        }
+        flow.output.clear();
+        flow.output_offset = 0;
+        ArmWrite(flow, false);
+    }
+
+    void ArmWrite(Flow& flow, bool is_armed)
+    {
+        if (flow.is_write_armed == is_armed)
+        {
+            return;
+        }
+        flow.is_write_armed = is_armed;
+        epoll_event event {};
+        event.events = EPOLLIN | (is_armed ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.ptr = &flow;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, flow.socket, &event);
+    }
+
+    void Receive(Flow& flow, bool is_closed_loop)
+    {
+        char buffer[64 * 1024];
+        bool has_data = false;
+        while (!flow.is_dead)
+        {
+            ssize_t size = recv(flow.socket, buffer, sizeof(buffer), 0);
+            if (size < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    // a refused UDP datagram only fails the request it answered
+                    if (flow.protocol == Protocol::Udp)
+                    {
+                        Complete(flow, is_closed_loop, false);
+                        continue;
+                    }
+                    Kill(flow);
+                }
+                break;
+            }
+            if (size == 0 && flow.protocol == Protocol::Tcp)
+            {
+                Kill(flow);
+                break;
+            }
+            if (flow.protocol == Protocol::Udp)
+            {
+                Complete(flow, is_closed_loop, true);
+                continue;
+            }
+            flow.input.append(buffer, size);
+            has_data = true;
+        }
+        if (!has_data)
+        {
+            return;
+        }
+        if (m_config.framing == FramingMode::Raw)
+        {
+            flow.input.clear();
+            Complete(flow, is_closed_loop, true);
+            return;
+        }
+        size_t offset = 0;
+        while (offset < flow.input.size())
+        {
+            std::string_view frame;
+            size_t consumed = 0;
+            FrameStatus status = Framing::Next(m_config.framing, std::string_view(flow.input).substr(offset), SIZE_MAX, frame, consumed);
+            if (status != FrameStatus::Complete)
+            {
+                break;
+            }
+            offset += consumed;
+            Complete(flow, is_closed_loop, true);
+        }
+        flow.input.erase(0, offset);
+    }
+
+    void Complete(Flow& flow, bool is_closed_loop, bool is_success)
+    {
+        if (flow.pending.empty())
+        {
+            return;
+        }
+        Pending pending = flow.pending.front();
+        flow.pending.pop_front();
+        if (IsMeasured(pending))
+        {
+            if (is_success)
+            {
+                auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - pending.start).count();
+                m_stats.series[static_cast<size_t>(flow.protocol)][static_cast<size_t>(pending.command)].latency.Record(latency);
+            }
+            else
+            {
+                ++m_stats.errors;
+            }
+        }
+        if (is_closed_loop)
+        {
+            Send(flow, Clock::now());
+        }
+    }
+
+    // The oldest request of a flow that is not answered in time is given up. Late replies of TCP would then be
+    // matched to the wrong request, but a TCP timeout means the server is stuck anyway.
+    void ExpireTimeouts(Clock::time_point now, bool is_closed_loop)
+    {
+        auto timeout = std::chrono::milliseconds(m_config.timeout_ms);
+        for (auto& flow : m_flows)
+        {
+            while (!flow->pending.empty() && now - flow->pending.front().start > timeout)
+            {
+                m_stats.timeouts += IsMeasured(flow->pending.front()) ? 1 : 0;
+                flow->pending.pop_front();
+                if (is_closed_loop)
+                {
+                    Send(*flow, now);
+                }
+            }
+        }
+    }
+
+    void Kill(Flow& flow)
+    {
+        if (flow.is_dead)
+        {
+            return;
+        }
+        flow.is_dead = true;
+        for (const Pending& pending : flow.pending)
+        {
+            m_stats.errors += IsMeasured(pending) ? 1 : 0;
+        }
+        flow.pending.clear();
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, flow.socket, nullptr);
+    }
+
+    const BenchConfig& m_config;
+    int m_epoll;
+    uint64_t m_random;
+    uint64_t m_weights_total;
+    std::string m_echo;
+    std::vector<std::unique_ptr<Flow>> m_flows;
+    Clock::time_point m_measure_start;
+    Clock::time_point m_end;
+    WorkerStats m_stats;
+};
+
+struct LatencySummary
+{
+    double p50;
+    double p99;
+    double p999;
+    double max;
+    double mean;
+};
+
+LatencySummary Summarize(const Histogram& histogram)
+{
+    auto us = [](uint64_t ns) { return ns / 1000.0; };
+    return {us(histogram.Percentile(0.5)), us(histogram.Percentile(0.99)), us(histogram.Percentile(0.999)), us(histogram.Max()),
+        histogram.Mean() / 1000.0};
+}
+
+void PrintJsonLatency(const Histogram& histogram)
+{
+    LatencySummary summary = Summarize(histogram);
+    std::printf("{\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f, \"mean\": %.1f}", summary.p50, summary.p99, summary.p999,
+        summary.max, summary.mean);
+}
+
+void PrintText(const char* name, const Histogram& histogram, double duration)
+{
+    LatencySummary summary = Summarize(histogram);
+    std::printf("%-12s %10llu %12.0f %10.1f %10.1f %10.1f %10.1f\n", name, static_cast<unsigned long long>(histogram.Count()),
+        histogram.Count() / duration, summary.p50, summary.p99, summary.p999, summary.max);
+}
+
+void Report(const BenchConfig& config, const WorkerStats& total)
+{
+    Histogram all;
+    for (const auto& protocol : total.series)
+    {
+        for (const auto& series : protocol)
+        {
+            all.Merge(series.latency);
+        }
+    }
+    const char* mode = config.rate > 0 ? "open" : "closed";
+    if (!config.is_json)
+    {
+        std::printf("%s loop, %u tcp connections, %u udp flows, %.1f s\n", mode, config.tcp_connections, config.udp_flows, config.duration);
+        std::printf("requests %llu, errors %llu, timeouts %llu\n", static_cast<unsigned long long>(total.requests),
+            static_cast<unsigned long long>(total.errors), static_cast<unsigned long long>(total.timeouts));
+        std::printf("%-12s %10s %12s %10s %10s %10s %10s\n", "series", "replies", "replies/s", "p50 us", "p99 us", "p999 us", "max us");
+        for (size_t p = 0; p < protocols_count; ++p)
+        {
+            for (size_t c = 0; c < commands_count; ++c)
+            {
+                const Histogram& histogram = total.series[p][c].latency;
+                if (histogram.Count() > 0)
+                {
+                    std::string name = std::string(Name(static_cast<Protocol>(p))) + " " + Name(static_cast<Command>(c));
+                    PrintText(name.c_str(), histogram, config.duration);
+                }
+            }
+        }
+        PrintText("total", all, config.duration);
+        return;
+    }
+    std::printf("{\"mode\": \"%s\", \"tcp_connections\": %u, \"udp_flows\": %u, \"threads\": %u, \"rate\": %.1f, \"depth\": %u, "
+        "\"duration_s\": %.3f, \"requests\": %llu, \"replies\": %llu, \"errors\": %llu, \"timeouts\": %llu, \"throughput_rps\": %.1f, "
+        "\"latency_us\": ", mode, config.tcp_connections, config.udp_flows, config.threads, config.rate, config.depth, config.duration,
+        static_cast<unsigned long long>(total.requests), static_cast<unsigned long long>(all.Count()),
+        static_cast<unsigned long long>(total.errors), static_cast<unsigned long long>(total.timeouts), all.Count() / config.duration);
+    PrintJsonLatency(all);
+    std::printf(", \"series\": [");
+    bool is_first = true;
+    for (size_t p = 0; p < protocols_count; ++p)
+    {
+        for (size_t c = 0; c < commands_count; ++c)
+        {
+            const Histogram& histogram = total.series[p][c].latency;
+            if (histogram.Count() == 0)
+            {
+                continue;
+            }
+            std::printf("%s{\"protocol\": \"%s\", \"command\": \"%s\", \"replies\": %llu, \"throughput_rps\": %.1f, \"latency_us\": ",
+                is_first ? "" : ", ", Name(static_cast<Protocol>(p)), Name(static_cast<Command>(c)),
+                static_cast<unsigned long long>(histogram.Count()), histogram.Count() / config.duration);
+            PrintJsonLatency(histogram);
+            std::printf("}");
+            is_first = false;
+        }
+    }
+    std::printf("]}\n");
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        BenchConfig config = ParseArgs(argc, argv);
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (unsigned int i = 0; i < config.threads; ++i)
+        {
+            workers.push_back(std::make_unique<Worker>(config, i));
+        }
+        size_t flows_total = config.tcp_connections + config.udp_flows;
+        for (size_t i = 0; i < flows_total; ++i)
+        {
+            workers[i % workers.size()]->AddFlow(i < config.tcp_connections ? Protocol::Tcp : Protocol::Udp);
+        }
+
+        auto start = Clock::now() + std::chrono::milliseconds(10);
+        auto measure_start = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.warmup));
+        auto end = measure_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.duration));
+        std::vector<std::thread> threads;
+        for (auto& worker : workers)
+        {
+            threads.emplace_back([&, worker = worker.get()] {
+                std::this_thread::sleep_until(start);
+                worker->Run(start, measure_start, end, flows_total);
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        WorkerStats total;
+        for (auto& worker : workers)
+        {
+            const WorkerStats& stats = worker->Stats();
+            for (size_t p = 0; p < protocols_count; ++p)
+            {
+                for (size_t c = 0; c < commands_count; ++c)
+                {
+                    total.series[p][c].latency.Merge(stats.series[p][c].latency);
+                }
+            }
+            total.requests += stats.requests;
+            total.errors += stats.errors;
+            total.timeouts += stats.timeouts;
+        }
+        Report(config, total);
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "bench: " << err.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../../udptcp_server/server/SlabAllocator.h"
+
+namespace
+{
+// Allocate and free on one thread: the free list hit path.
+void BM_SlabAllocateFree(benchmark::State& state)
+{
+    size_t size = state.range(0);
+    for (auto _ : state)
+    {
+        void* block = SlabAllocator::Allocate(size);
+        benchmark::DoNotOptimize(block);
+        SlabAllocator::Free(block);
+    }
+}
+BENCHMARK(BM_SlabAllocateFree)->Arg(64)->Arg(4096)->Arg(256 * 1024);
+
+// Blocks allocated on one thread and freed on another, as responses built by a pool worker and sent by the
+// reactor; the owner takes them back from its remote list.
+void BM_SlabRemoteFree(benchmark::State& state)
+{
+    constexpr size_t batch {256};
+    std::vector<void*> blocks(batch);
+    // even: the benchmark thread allocates a batch, odd: the other thread frees it
+    std::atomic<uint32_t> turn {0};
+    std::atomic<bool> is_done {false};
+    std::thread releaser([&] {
+        while (true)
+        {
+            uint32_t current = turn.load(std::memory_order_acquire);
+            if (current % 2 == 0)
+            {
+                if (is_done.load(std::memory_order_acquire))
+                {
+                    return;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            for (void* block : blocks)
+            {
+                SlabAllocator::Free(block);
+            }
+            turn.store(current + 1, std::memory_order_release);
+        }
+    });
+    for (auto _ : state)
+    {
+        for (void*& block : blocks)
+        {
+            block = SlabAllocator::Allocate(512);
+        }
+        uint32_t current = turn.fetch_add(1, std::memory_order_acq_rel) + 1;
+        while (turn.load(std::memory_order_acquire) == current)
+        {
+            std::this_thread::yield();
+        }
+    }
+    is_done.store(true, std::memory_order_release);
+    releaser.join();
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_SlabRemoteFree)->UseRealTime();
+} // namespace
@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "../../udptcp_server/server/ClockService.h"
+#include "../../udptcp_server/server/CommandContext.h"
+#include "../../udptcp_server/server/CommandRegistry.h"
+
+// PrepareAnswer is a registry lookup followed by the handler, both are measured here on their own.
+namespace
+{
+CommandRegistry MakeRegistry(size_t count)
+{
+    CommandRegistry registry;
+    registry.Register("/time", [](std::string_view, std::string& output) { output.append("2025-11-28 15:04:05"); });
+    registry.RegisterAsync("/watch", [](std::string_view, CommandContext& context) -> AsyncTask<> {
+        context.Output().append("2025-11-28 15:04:05");
+        co_return;
+    });
+    registry.Register("/shutdown", [](std::string_view, std::string&) {});
+    for (size_t i = 3; i < count; ++i)
+    {
+        registry.Register("/command_" + std::to_string(i), [](std::string_view, std::string&) {});
+    }
+    registry.Build();
+    return registry;
+}
+
+// Arguments: registered commands, 1 to look up a known name or 0 for an unknown one.
+void BM_CommandFind(benchmark::State& state)
+{
+    CommandRegistry registry = MakeRegistry(state.range(0));
+    std::string_view name = state.range(1) != 0 ? "/time" : "/unknown";
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(registry.Find(name));
+    }
+}
+BENCHMARK(BM_CommandFind)->Args({3, 1})->Args({3, 0})->Args({64, 1})->Args({64, 0});
+
+void BM_CommandDispatch(benchmark::State& state)
+{
+    CommandRegistry registry = MakeRegistry(3);
+    std::string output;
+    for (auto _ : state)
+    {
+        output.clear();
+        (*registry.Find("/time"))({}, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+BENCHMARK(BM_CommandDispatch);
+
+// The same reply from a coroutine command that does not suspend; its frame comes from the SlabAllocator.
+void BM_AsyncCommandDispatch(benchmark::State& state)
+{
+    CommandRegistry registry = MakeRegistry(3);
+    size_t index = registry.FindIndex("/watch");
+    std::string output;
+    for (auto _ : state)
+    {
+        output.clear();
+        CommandContext context(output);
+        AsyncTask<> task = registry.AsyncHandlerAt(index)({}, context);
+        task.Start();
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+BENCHMARK(BM_AsyncCommandDispatch);
+
+// Argument: ClockService::Format of the /time, /time_ms, /time_utc and /time_utc_ms commands.
+void BM_ClockAppend(benchmark::State& state)
+{
+    static ClockService clock;
+    clock.Start();
+    auto format = static_cast<ClockService::Format>(state.range(0));
+    std::string output;
+    for (auto _ : state)
+    {
+        output.clear();
+        clock.Append(format, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+BENCHMARK(BM_ClockAppend)->DenseRange(0, 3);
+} // namespace
@@ -0,0 +1,40 @@
+#include <benchmark/benchmark.h>
+
+#include "../../udptcp_server/server/ConnectionTable.h"
+
+namespace
+{
+constexpr int open_count {1024};
+
+// The per-event lookup of the reactors, descriptor and generation come from the epoll data.
+void BM_ConnectionTableFind(benchmark::State& state)
+{
+    BufferPool pool;
+    ConnectionTable table(pool, open_count * 4);
+    for (int fd = 0; fd < open_count; ++fd)
+    {
+        table.Open(fd);
+    }
+    int fd = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(table.Find(fd, 1));
+        fd = (fd + 1) % open_count;
+    }
+}
+BENCHMARK(BM_ConnectionTableFind);
+
+void BM_ConnectionTableOpenClose(benchmark::State& state)
+{
+    BufferPool pool;
+    ConnectionTable table(pool, open_count);
+    int fd = 0;
+    for (auto _ : state)
+    {
+        Connection* connection = table.Open(fd);
+        table.Close(*connection, connection->generation.load(std::memory_order_relaxed));
+        fd = (fd + 1) % open_count;
+    }
+}
+BENCHMARK(BM_ConnectionTableOpenClose);
+} // namespace
@@ -0,0 +1,34 @@
+#include <benchmark/benchmark.h>
+
+#include <string_view>
+
+#include "../../udptcp_server/logging/Logging.h"
+
+// MicroBench.cpp starts the writer with the block policy and /dev/null as output, so an emitted record
+// includes its share of the writer keeping up.
+namespace
+{
+void BM_LogFiltered(benchmark::State& state)
+{
+    LogHelper::Logger logger("BenchFiltered");
+    LogHelper::SetLevel("BenchFiltered", LogHelper::info);
+    std::string_view message = "/time";
+    for (auto _ : state)
+    {
+        LOG(logger, LogHelper::debug, "New message from client " << 7 << " : " << message);
+    }
+}
+BENCHMARK(BM_LogFiltered);
+
+void BM_LogEmitted(benchmark::State& state)
+{
+    LogHelper::Logger logger("BenchEmitted");
+    LogHelper::SetLevel("BenchEmitted", LogHelper::info);
+    std::string_view message = "/time";
+    for (auto _ : state)
+    {
+        LOG(logger, LogHelper::info, "New message from client " << 7 << " : " << message);
+    }
+}
+BENCHMARK(BM_LogEmitted);
+} // namespace
@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include "../../udptcp_server/server/Metrics.h"
+
+namespace
+{
+Metrics& SharedMetrics()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+void BM_MetricsAdd(benchmark::State& state)
+{
+    Metrics& metrics = SharedMetrics();
+    for (auto _ : state)
+    {
+        metrics.Add(Counter::TcpMessages);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetricsAdd)->Threads(1)->Threads(4)->UseRealTime();
+
+void BM_MetricsSnapshot(benchmark::State& state)
+{
+    Metrics& metrics = SharedMetrics();
+    for (auto _ : state)
+    {
+        MetricsSnapshot snapshot = metrics.Snapshot();
+        benchmark::DoNotOptimize(snapshot);
+    }
+}
+BENCHMARK(BM_MetricsSnapshot);
+
+// One latency sample, spread over the buckets of 1us..1ms.
+void BM_HistogramRecord(benchmark::State& state)
+{
+    Histogram& histogram = SharedMetrics().Get(Distribution::QueueWait);
+    uint64_t value = 1000;
+    for (auto _ : state)
+    {
+        histogram.Record(value);
+        value = value * 7 % 1000000 + 1000;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HistogramRecord)->Threads(1)->Threads(4)->UseRealTime();
+} // namespace
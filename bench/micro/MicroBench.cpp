@@ -0,0 +1,198 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "../../udptcp_server/logging/Logging.h"
+
+// Runs the suites of this directory and compares them with a baseline file that holds nanoseconds per
+// iteration of every benchmark:
+//   microbench --baseline=bench/baseline.json [--tolerance=0.25]   exit code 1 if any benchmark got slower
+//   microbench --update-baseline=bench/baseline.json                 record the numbers of the benchmarks that ran
+// A benchmark that reports an error also makes the exit code 1.
+// All other arguments go to Google Benchmark, e.g. --benchmark_filter=Command.
+namespace
+{
+using Results = std::map<std::string, double>;
+
+class BaselineReporter : public benchmark::ConsoleReporter {
+public:
+    void ReportRuns(const std::vector<Run>& runs) override
+    {
+        benchmark::ConsoleReporter::ReportRuns(runs);
+        for (const Run& run : runs)
+        {
+            if (run.run_type != Run::RT_Iteration)
+            {
+                continue;
+            }
+            if (run.error_occurred)
+            {
+                m_has_errors = true;
+                continue;
+            }
+            double ns = run.GetAdjustedRealTime() / benchmark::GetTimeUnitMultiplier(run.time_unit) * 1e9;
+            m_results[run.benchmark_name()] = ns;
+        }
+    }
+
+    const Results& GetResults() const
+    {
+        return m_results;
+    }
+
+    // a benchmark that skips with an error is a failed check
+    bool HasErrors() const
+    {
+        return m_has_errors;
+    }
+private:
+    Results m_results;
+    bool m_has_errors {false};
+};
+
+// Reads the "benchmarks" object written by WriteBaseline, it is not a general JSON parser.
+bool ReadBaseline(const std::string& path, Results& baseline)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string text = stream.str();
+    size_t pos = text.find("\"benchmarks\"");
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    pos = text.find('{', pos);
+    size_t end = text.find('}', pos);
+    while (pos != std::string::npos && pos < end)
+    {
+        size_t name_begin = text.find('"', pos);
+        if (name_begin == std::string::npos || name_begin > end)
+        {
+            break;
+        }
+        size_t name_end = text.find('"', name_begin + 1);
+        size_t colon = text.find(':', name_end);
+        baseline[text.substr(name_begin + 1, name_end - name_begin - 1)] = std::strtod(text.c_str() + colon + 1, nullptr);
+        pos = text.find_first_of(",}", colon);
+        pos = pos == std::string::npos ? pos : pos + 1;
+    }
+    return true;
+}
+
+bool WriteBaseline(const std::string& path, const Results& results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    file << "{\n  \"unit\": \"ns\",\n  \"cpus\": " << std::thread::hardware_concurrency() << ",\n  \"benchmarks\": {\n";
+    size_t i = 0;
+    for (const auto& [name, ns] : results)
+    {
+        char value[32];
+        std::snprintf(value, sizeof(value), "%.2f", ns);
+        file << "    \"" << name << "\": " << value << (++i < results.size() ? ",\n" : "\n");
+    }
+    file << "  }\n}\n";
+    return static_cast<bool>(file);
+}
+
+// Prints one line per benchmark that is in both sets, false if any is slower than the baseline by more than tolerance.
+bool Compare(const Results& baseline, const Results& results, double tolerance)
+{
+    bool is_ok = true;
+    std::printf("\n%-48s %12s %12s %8s\n", "benchmark", "baseline ns", "current ns", "change");
+    for (const auto& [name, ns] : results)
+    {
+        auto it = baseline.find(name);
+        if (it == baseline.end() || it->second <= 0)
+        {
+            std::printf("%-48s %12s %12.2f %8s\n", name.c_str(), "-", ns, "new");
+            continue;
+        }
+        double change = ns / it->second - 1;
+        bool is_regression = change > tolerance;
+        is_ok = is_ok && !is_regression;
+        std::printf("%-48s %12.2f %12.2f %+7.1f%%%s\n", name.c_str(), it->second, ns, change * 100, is_regression ? "  REGRESSION" : "");
+    }
+    return is_ok;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    std::string baseline_path;
+    std::string update_path;
+    double tolerance = 0.25;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--baseline="))
+        {
+            baseline_path = arg.substr(std::strlen("--baseline="));
+        }
+        else if (arg.starts_with("--update-baseline="))
+        {
+            update_path = arg.substr(std::strlen("--update-baseline="));
+        }
+        else if (arg.starts_with("--tolerance="))
+        {
+            tolerance = std::stod(std::string(arg.substr(std::strlen("--tolerance="))));
+        }
+        else
+        {
+            std::cerr << "microbench: unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    FILE* null_output = std::fopen("/dev/null", "w");
+    LogHelper::InitLogging(LogHelper::OverflowPolicy::Block, 256 * 1024, null_output != nullptr ? null_output : stdout);
+    BaselineReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    LogHelper::StopLogging();
+
+    int result = reporter.HasErrors() ? 1 : 0;
+    if (!baseline_path.empty())
+    {
+        Results baseline;
+        if (!ReadBaseline(baseline_path, baseline))
+        {
+            std::cerr << "microbench: cannot read baseline " << baseline_path << std::endl;
+            return 2;
+        }
+        result = Compare(baseline, reporter.GetResults(), tolerance) ? result : 1;
+    }
+    if (!update_path.empty())
+    {
+        // a filtered run only replaces the benchmarks it ran
+        Results updated;
+        ReadBaseline(update_path, updated);
+        for (const auto& [name, ns] : reporter.GetResults())
+        {
+            updated[name] = ns;
+        }
+        if (!WriteBaseline(update_path, updated))
+        {
+            std::cerr << "microbench: cannot write baseline " << update_path << std::endl;
+            return 2;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,22 @@
+#include <benchmark/benchmark.h>
+
+#include "../../udptcp_server/server/RateLimiter.h"
+
+namespace
+{
+// One admission check over N distinct sources; the rate is high enough that every check succeeds.
+void BM_RateLimiterAllow(benchmark::State& state)
+{
+    static RateLimiter limiter(65536);
+    limiter.Configure(1000000000, 0);
+    auto sources = static_cast<uint64_t>(state.range(0));
+    uint64_t source = state.thread_index();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(limiter.Allow(source % sources + 1));
+        source += 7919;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RateLimiterAllow)->Arg(1)->Arg(16384)->Threads(1)->Threads(4)->UseRealTime();
+} // namespace
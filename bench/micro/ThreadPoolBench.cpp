@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "../../udptcp_server/server/ThreadPoolQueue.h"
+
+namespace
+{
+ThreadPoolQueue& Pool()
+{
+    static ThreadPoolQueue pool;
+    static std::once_flag flag;
+    std::call_once(flag, [] { pool.startAsync(4); });
+    return pool;
+}
+
+// Producers pushing empty tasks from outside the pool, as the epoll reactor does.
+void BM_ThreadPoolPush(benchmark::State& state)
+{
+    ThreadPoolQueue& pool = Pool();
+    for (auto _ : state)
+    {
+        pool.Push([] {});
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ThreadPoolPush)->Threads(1)->Threads(4)->UseRealTime();
+
+// Push until the task has run on a worker: the dispatch latency a reactor event sees.
+void BM_ThreadPoolRoundTrip(benchmark::State& state)
+{
+    ThreadPoolQueue& pool = Pool();
+    std::atomic<bool> is_done {false};
+    for (auto _ : state)
+    {
+        is_done.store(false, std::memory_order_relaxed);
+        pool.Push([&is_done] { is_done.store(true, std::memory_order_release); });
+        while (!is_done.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+BENCHMARK(BM_ThreadPoolRoundTrip)->UseRealTime();
+} // namespace
@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+#include "../../udptcp_server/server/TimerWheel.h"
+
+namespace
+{
+// Moves one of N scheduled timers to a later deadline, what a check does for a busy connection.
+void BM_TimerWheelReschedule(benchmark::State& state)
+{
+    auto count = static_cast<size_t>(state.range(0));
+    TimerWheel wheel(100, 0);
+    std::vector<std::unique_ptr<TimerNode>> nodes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        nodes.push_back(std::make_unique<TimerNode>());
+        wheel.Schedule(*nodes.back(), 1000 + i * 37 % 600000, [] {});
+    }
+    size_t index = 0;
+    uint64_t expiry = 1000;
+    for (auto _ : state)
+    {
+        wheel.Schedule(*nodes[index], expiry, [] {});
+        index = (index + 1) % count;
+        expiry = expiry % 600000 + 997;
+    }
+    for (auto& node : nodes)
+    {
+        wheel.Cancel(*node);
+    }
+}
+BENCHMARK(BM_TimerWheelReschedule)->Arg(1024)->Arg(128 * 1024);
+
+// One tick with N timers waiting further out, the cost must not grow with N.
+void BM_TimerWheelTick(benchmark::State& state)
+{
+    auto count = static_cast<size_t>(state.range(0));
+    TimerWheel wheel(1, 0);
+    std::vector<std::unique_ptr<TimerNode>> nodes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        nodes.push_back(std::make_unique<TimerNode>());
+        wheel.Schedule(*nodes.back(), 1000000000 + i, [] {});
+    }
+    uint64_t now = 0;
+    for (auto _ : state)
+    {
+        wheel.Advance(++now);
+    }
+    for (auto& node : nodes)
+    {
+        wheel.Cancel(*node);
+    }
+}
+BENCHMARK(BM_TimerWheelTick)->Arg(1024)->Arg(128 * 1024);
+} // namespace
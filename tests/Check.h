@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+
+// Assertions of the test executables: a failed CHECK is reported and counted, the run goes on so one pass
+// shows every failure. main returns Check::Result().
+namespace Check
+{
+inline int failures {0};
+
+inline int Result()
+{
+    if (failures > 0)
+    {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
+} // namespace Check
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++Check::failures; \
+        } \
+    } while (false)
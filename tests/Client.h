@@ -0,0 +1,47 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Loopback clients of the tests that run an in-process server.
+namespace Client
+{
+// A port nothing listens on right now.
+inline int FreePort()
+{
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bind(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    getsockname(probe, reinterpret_cast<sockaddr*>(&address), &length);
+    close(probe);
+    return ntohs(address.sin_port);
+}
+
+// A connected TCP or UDP socket whose receives give up after two seconds, -1 on failure.
+inline int Connect(int port, bool is_tcp)
+{
+    int client = socket(AF_INET, is_tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        close(client);
+        return -1;
+    }
+    timeval timeout {2, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int enable = 1;
+    if (is_tcp)
+    {
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    return client;
+}
+} // namespace Client
@@ -0,0 +1,296 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "Client.h"
+#include "../udptcp_server/server/Server.h"
+
+namespace
+{
+// Sends request and returns the next lines_count newline framed replies, fewer if the server stops answering.
+std::vector<std::string> Exchange(int client, std::string_view request, size_t lines_count)
+{
+    std::vector<std::string> lines;
+    if (send(client, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+    {
+        return lines;
+    }
+    std::string data;
+    char buffer[4096];
+    while (lines.size() < lines_count)
+    {
+        size_t end = data.find('\n');
+        if (end != std::string::npos)
+        {
+            lines.push_back(data.substr(0, end));
+            data.erase(0, end + 1);
+            continue;
+        }
+        ssize_t bytes = recv(client, buffer, sizeof(buffer), 0);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            break;
+        }
+        data.append(buffer, bytes);
+    }
+    return lines;
+}
+
+struct Mode
+{
+    const char* name;
+    IoBackendType backend;
+    unsigned int shards_count;
+};
+
+constexpr Mode modes[] {{"epoll", IoBackendType::Epoll, 0}, {"epoll shards", IoBackendType::Epoll, 1}, {"io_uring", IoBackendType::IoUring, 0}};
+
+ServerConfig MakeConfig(const Mode& mode)
+{
+    ServerConfig config;
+    config.port = Client::FreePort();
+    config.io_backend = mode.backend;
+    config.shards_count = mode.shards_count;
+    config.max_threads = 2;
+    config.framing = FramingMode::Newline;
+    config.timer_tick_ms = 10;
+    return config;
+}
+
+// Counts the command frames that ended.
+struct FrameCounter
+{
+    explicit FrameCounter(std::atomic<int>& ended) : ended(ended) {}
+
+    ~FrameCounter()
+    {
+        ++ended;
+    }
+
+    std::atomic<int>& ended;
+};
+
+// Connects, sends request and returns the client, -1 on failure.
+int Start(int port, std::string_view request)
+{
+    int client = Client::Connect(port, true);
+    if (client >= 0 && send(client, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+    {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+// A command reads its arguments after it suspended, while the requests behind it fill the read buffer they
+// pointed into.
+void TestArgumentsOutliveRead(const Mode& mode)
+{
+    ServerConfig config = MakeConfig(mode);
+    TCPUPDServer server;
+    server.RegisterAsyncCommand("/later", [](std::string_view args, CommandContext& context) -> AsyncTask<> {
+        co_await context.SleepFor(50);
+        context.Output().append(args);
+    });
+    server.Init(config);
+    server.ListenAsync();
+    int client = Client::Connect(config.port, true);
+    CHECK(client >= 0);
+    if (client >= 0)
+    {
+        std::string_view request = "/later first argument\n";
+        send(client, request.data(), request.size(), MSG_NOSIGNAL);
+        usleep(10000);
+        std::string filler(200, 'z');
+        std::vector<std::string> lines = Exchange(client, filler + "\n", 2);
+        CHECK(lines.size() == 2);
+        CHECK(lines.size() > 0 && lines[0] == "first argument");
+        CHECK(lines.size() > 1 && lines[1] == filler);
+        close(client);
+    }
+    server.Stop();
+}
+
+// A command that replies faster than the client reads resumes from its Flush once the client drained the
+// output, long before the next timer tick. The client starts reading once the socket buffers are full.
+void TestFlushResumesOnDrain(const Mode& mode)
+{
+    ServerConfig config = MakeConfig(mode);
+    config.timer_tick_ms = 1000;
+    config.write_high_watermark = 16 * 1024;
+    config.write_low_watermark = 4 * 1024;
+    constexpr int parts_count {40};
+    const std::string part(256 * 1024, 'p');
+    TCPUPDServer server;
+    server.RegisterAsyncCommand("/flood", [&part](std::string_view, CommandContext& context) -> AsyncTask<> {
+        for (int i = 0; i < parts_count; ++i)
+        {
+            context.Output().append(part);
+            if (!co_await context.Flush())
+            {
+                break;
+            }
+        }
+        context.Output().append("end");
+    });
+    server.Init(config);
+    server.ListenAsync();
+    int client = Client::Connect(config.port, true);
+    CHECK(client >= 0);
+    if (client >= 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string_view request = "/flood\n";
+        send(client, request.data(), request.size(), MSG_NOSIGNAL);
+        usleep(100000);
+        std::vector<std::string> lines = Exchange(client, "", parts_count + 1);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        CHECK(lines.size() == parts_count + 1);
+        CHECK(lines.size() > 0 && lines[0] == part);
+        CHECK(!lines.empty() && lines.back() == "end");
+        CHECK(elapsed < std::chrono::milliseconds(900));
+        close(client);
+    }
+    server.Stop();
+}
+
+// A command reads what the client sends while it runs: first the requests that followed it, then new ones;
+// the connection answers requests again once it returns.
+void TestReadInput(const Mode& mode)
+{
+    ServerConfig config = MakeConfig(mode);
+    TCPUPDServer server;
+    server.RegisterAsyncCommand("/ask", [](std::string_view, CommandContext& context) -> AsyncTask<> {
+        std::string answer;
+        for (int i = 0; i < 2; ++i)
+        {
+            context.Output().append("name?");
+            if (!co_await context.Read(answer))
+            {
+                co_return;
+            }
+            context.Output().append("hello ").append(answer);
+            co_await context.Flush();
+        }
+    });
+    server.Init(config);
+    server.ListenAsync();
+    int client = Client::Connect(config.port, true);
+    CHECK(client >= 0);
+    if (client >= 0)
+    {
+        std::vector<std::string> lines = Exchange(client, "/ask\nalice\n", 3);
+        CHECK(lines == std::vector<std::string>({"name?", "hello alice", "name?"}));
+        usleep(10000);
+        lines = Exchange(client, "bob\nafter\n", 2);
+        CHECK(lines == std::vector<std::string>({"hello bob", "after"}));
+        close(client);
+    }
+    server.Stop();
+}
+
+// Stop ends the commands suspended in every kind of wait: their frames do not outlive the server.
+void TestStopEndsSuspendedCommands(const Mode& mode)
+{
+    ServerConfig config = MakeConfig(mode);
+    config.write_high_watermark = 16 * 1024;
+    config.write_low_watermark = 4 * 1024;
+    std::atomic<int> ended {0};
+    TCPUPDServer server;
+    server.RegisterAsyncCommand("/nap", [&ended](std::string_view, CommandContext& context) -> AsyncTask<> {
+        FrameCounter counter(ended);
+        co_await context.SleepFor(60000);
+    });
+    server.RegisterAsyncCommand("/listen", [&ended](std::string_view, CommandContext& context) -> AsyncTask<> {
+        FrameCounter counter(ended);
+        std::string message;
+        co_await context.Read(message);
+    });
+    server.RegisterAsyncCommand("/flood", [&ended](std::string_view, CommandContext& context) -> AsyncTask<> {
+        FrameCounter counter(ended);
+        do
+        {
+            context.Output().append(256 * 1024, 'p');
+        } while (co_await context.Flush());
+    });
+    server.Init(config);
+    server.ListenAsync();
+    std::vector<int> clients;
+    for (std::string_view request : {"/nap\n", "/listen\n", "/flood\n"})
+    {
+        clients.push_back(Start(config.port, request));
+        CHECK(clients.back() >= 0);
+    }
+    usleep(200000);
+    CHECK(ended.load() == 0);
+    server.Stop();
+    CHECK(ended.load() == 3);
+    for (int client : clients)
+    {
+        close(client);
+    }
+}
+
+// A drain ends the commands that wait for the clock or the client, so their connections close long before the
+// drain timeout. What they reply after that still arrives.
+void TestDrainCancelsCommands(const Mode& mode)
+{
+    ServerConfig config = MakeConfig(mode);
+    config.drain_timeout_ms = 5000;
+    std::atomic<int> ended {0};
+    TCPUPDServer server;
+    server.RegisterAsyncCommand("/nap", [&ended](std::string_view, CommandContext& context) -> AsyncTask<> {
+        FrameCounter counter(ended);
+        if (!co_await context.SleepFor(60000))
+        {
+            context.Output().append("woken");
+        }
+    });
+    server.RegisterAsyncCommand("/listen", [&ended](std::string_view, CommandContext& context) -> AsyncTask<> {
+        FrameCounter counter(ended);
+        std::string message;
+        if (!co_await context.Read(message))
+        {
+            context.Output().append("no input");
+        }
+    });
+    server.Init(config);
+    server.ListenAsync();
+    int napping = Start(config.port, "/nap\n");
+    int listening = Start(config.port, "/listen\n");
+    CHECK(napping >= 0 && listening >= 0);
+    usleep(100000);
+    auto start = std::chrono::steady_clock::now();
+    server.Drain();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000));
+    CHECK(ended.load() == 2);
+    CHECK(Exchange(napping, "", 2) == std::vector<std::string>({"woken"}));
+    CHECK(Exchange(listening, "", 2) == std::vector<std::string>({"no input"}));
+    server.Stop();
+    close(napping);
+    close(listening);
+}
+} // namespace
+
+int main()
+{
+    for (const Mode& mode : modes)
+    {
+        TestArgumentsOutliveRead(mode);
+        TestFlushResumesOnDrain(mode);
+        TestReadInput(mode);
+        TestStopEndsSuspendedCommands(mode);
+        TestDrainCancelsCommands(mode);
+    }
+    return Check::Result();
+}
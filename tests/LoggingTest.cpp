@@ -0,0 +1,121 @@
+#include <atomic>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "../udptcp_server/logging/Logging.h"
+
+namespace
+{
+// The messages of every record written to output, without the prefix.
+std::vector<std::string> ReadMessages(FILE* output)
+{
+    std::vector<std::string> messages;
+    std::rewind(output);
+    char line[8192];
+    while (std::fgets(line, sizeof(line), output) != nullptr)
+    {
+        std::string text(line);
+        size_t begin = text.find("> ");
+        if (begin != std::string::npos && !text.empty() && text.back() == '\n')
+        {
+            messages.push_back(text.substr(begin + 2, text.size() - begin - 3));
+        }
+    }
+    return messages;
+}
+
+struct Point
+{
+    int x;
+    int y;
+};
+
+std::ostream& operator<<(std::ostream& stream, const Point& point)
+{
+    return stream << '(' << point.x << ", " << point.y << ')';
+}
+
+struct Wide
+{
+};
+
+std::ostream& operator<<(std::ostream& stream, const Wide&)
+{
+    for (int i = 0; i < 10000; ++i)
+    {
+        stream << 'w';
+    }
+    return stream;
+}
+
+// Types without a raw encoding go through their stream operator, cut to the space left in the record.
+void TestStreamedTypes()
+{
+    FILE* output = std::tmpfile();
+    LogHelper::InitLogging(LogHelper::OverflowPolicy::Block, 64 * 1024, output);
+    LogHelper::Logger logger("Test");
+    Point point {1, -2};
+    LOG(logger, LogHelper::info, "point " << point << " done");
+    LOG(logger, LogHelper::info, "wide " << Wide {} << " lost");
+    LogHelper::StopLogging();
+
+    std::vector<std::string> messages = ReadMessages(output);
+    CHECK(messages.size() == 2);
+    CHECK(messages.size() > 0 && messages[0] == "point (1, -2) done");
+    CHECK(messages.size() > 1 && messages[1].starts_with("wide www") && messages[1].size() < 4096 &&
+        messages[1].find_first_not_of('w', 5) == std::string::npos);
+    std::fclose(output);
+}
+
+// Two threads log in turns, each record is published before the other thread logs its own, so the output must
+// alternate even when the writer drains one ring while the other thread is adding to it.
+void TestOrderAcrossThreads()
+{
+    FILE* output = std::tmpfile();
+    LogHelper::InitLogging(LogHelper::OverflowPolicy::Block, 64 * 1024, output);
+    LogHelper::Logger logger("Test");
+    constexpr int turns_count {2000};
+    std::atomic<int> turn {0};
+    auto player = [&](int parity) {
+        for (int i = parity; i < 2 * turns_count; i += 2)
+        {
+            while (turn.load(std::memory_order_acquire) != i)
+            {
+                std::this_thread::yield();
+            }
+            LOG(logger, LogHelper::info, i);
+            turn.store(i + 1, std::memory_order_release);
+        }
+    };
+    std::thread first(player, 0);
+    std::thread second(player, 1);
+    first.join();
+    second.join();
+    LogHelper::StopLogging();
+
+    std::vector<std::string> messages = ReadMessages(output);
+    CHECK(messages.size() == 2 * turns_count);
+    bool is_ordered = true;
+    for (size_t i = 0; is_ordered && i < messages.size(); ++i)
+    {
+        is_ordered = messages[i] == std::to_string(i);
+        if (!is_ordered)
+        {
+            std::fprintf(stderr, "record %zu is %s\n", i, messages[i].c_str());
+        }
+    }
+    CHECK(is_ordered);
+    std::fclose(output);
+}
+} // namespace
+
+int main()
+{
+    TestStreamedTypes();
+    TestOrderAcrossThreads();
+    return Check::Result();
+}
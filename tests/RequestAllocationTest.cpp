@@ -0,0 +1,181 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "Client.h"
+#include "../udptcp_server/server/Server.h"
+
+// Every operator new of the process is counted, so a request that allocates anywhere on the server threads
+// shows up. Direct malloc calls of the C library are not seen.
+namespace
+{
+std::atomic<uint64_t> g_allocations {0};
+
+void* CountedAllocate(size_t size, size_t alignment)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    size = size == 0 ? 1 : size;
+    void* pointer = alignment <= alignof(std::max_align_t) ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+} // namespace
+
+void* operator new(size_t size)
+{
+    return CountedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace
+{
+constexpr int warmup_requests {2000};
+constexpr int measured_requests {2000};
+
+bool RoundTrip(int client, const std::string& request, size_t response_size, std::vector<char>& buffer)
+{
+    if (send(client, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+    {
+        return false;
+    }
+    size_t received = 0;
+    while (received < response_size)
+    {
+        ssize_t bytes = recv(client, buffer.data() + received, buffer.size() - received, 0);
+        // io_uring task work for the requests Init submitted from this thread may interrupt it
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            return false;
+        }
+        received += bytes;
+    }
+    return true;
+}
+
+// Steady state request/response against an in-process server: once a connection is warm, serving a request
+// must not call operator new on any thread.
+void TestRequestAllocations(IoBackendType backend, bool is_tcp)
+{
+    ServerConfig config;
+    config.port = Client::FreePort();
+    config.io_backend = backend;
+    config.max_threads = 2;
+    TCPUPDServer server;
+    server.Init(config);
+    server.ListenAsync();
+    int client = Client::Connect(config.port, is_tcp);
+    CHECK(client >= 0);
+    std::vector<char> buffer(4096);
+    for (bool is_time : {false, true})
+    {
+        std::string request = is_time ? "/time" : std::string(200, 'x');
+        // "YYYY-MM-DD HH:MM:SS"
+        size_t response_size = is_time ? 19 : request.size();
+        bool is_ok = client >= 0;
+        for (int i = 0; i < warmup_requests && is_ok; ++i)
+        {
+            is_ok = RoundTrip(client, request, response_size, buffer);
+        }
+        uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+        for (int i = 0; i < measured_requests && is_ok; ++i)
+        {
+            is_ok = RoundTrip(client, request, response_size, buffer);
+        }
+        allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+        if (!is_ok || allocations > 0)
+        {
+            std::fprintf(stderr, "%s %s %s: %s, operator new called %llu times in %d requests\n",
+                backend == IoBackendType::IoUring ? "io_uring" : "epoll", is_tcp ? "TCP" : "UDP", is_time ? "/time" : "echo",
+                is_ok ? "served" : "failed", static_cast<unsigned long long>(allocations), measured_requests);
+        }
+        CHECK(is_ok);
+        CHECK(allocations == 0);
+    }
+    if (client >= 0)
+    {
+        close(client);
+    }
+    server.Stop();
+}
+} // namespace
+
+int main()
+{
+    for (IoBackendType backend : {IoBackendType::Epoll, IoBackendType::IoUring})
+    {
+        for (bool is_tcp : {true, false})
+        {
+            TestRequestAllocations(backend, is_tcp);
+        }
+    }
+    return Check::Result();
+}
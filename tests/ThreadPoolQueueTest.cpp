@@ -0,0 +1,190 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "../udptcp_server/server/ThreadPoolQueue.h"
+
+namespace
+{
+using namespace std::chrono_literals;
+
+// Waits up to a few seconds for condition, a stuck pool fails the check instead of hanging the test.
+template<class F>
+bool WaitFor(F&& condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+// Tasks pushed before startAsync wait for the workers instead of running on the pushing thread.
+void TestQueuedUntilStart()
+{
+    ThreadPoolQueue pool;
+    std::atomic<int> ran {0};
+    std::atomic<bool> is_on_caller {false};
+    std::thread::id caller = std::this_thread::get_id();
+    for (int i = 0; i < 10; ++i)
+    {
+        pool.Push([&] {
+            is_on_caller.store(is_on_caller.load() || std::this_thread::get_id() == caller);
+            ran.fetch_add(1);
+        });
+    }
+    CHECK(ran.load() == 0);
+    pool.startAsync(2);
+    CHECK(WaitFor([&] { return ran.load() == 10; }));
+    CHECK(!is_on_caller.load());
+}
+
+// One worker serves the tasks of one producer in push order.
+void TestFifoOnOneWorker()
+{
+    ThreadPoolQueue pool;
+    pool.startAsync(1);
+    std::vector<int> order;
+    std::atomic<int> ran {0};
+    for (int i = 0; i < 500; ++i)
+    {
+        pool.Push([&order, &ran, i] {
+            order.push_back(i);
+            ran.fetch_add(1, std::memory_order_release);
+        });
+    }
+    CHECK(WaitFor([&] { return ran.load(std::memory_order_acquire) == 500; }));
+    bool is_ordered = order.size() == 500;
+    for (size_t i = 0; is_ordered && i < order.size(); ++i)
+    {
+        is_ordered = order[i] == static_cast<int>(i);
+    }
+    CHECK(is_ordered);
+}
+
+// A worker pushes to its own queue and then stays busy until everything ran, so the tasks can only finish if
+// the other workers steal them.
+void TestStealing()
+{
+    ThreadPoolQueue pool(4096);
+    pool.startAsync(4);
+    constexpr int tasks_count {1000};
+    std::atomic<int> ran {0};
+    std::mutex threads_mutex;
+    std::set<std::thread::id> threads;
+    std::atomic<bool> is_done {false};
+    std::thread::id busy;
+    pool.Push([&] {
+        busy = std::this_thread::get_id();
+        for (int i = 0; i < tasks_count; ++i)
+        {
+            pool.Push([&] {
+                {
+                    std::unique_lock lock(threads_mutex);
+                    threads.insert(std::this_thread::get_id());
+                }
+                ran.fetch_add(1);
+            });
+        }
+        WaitFor([&] { return ran.load() == tasks_count; });
+        is_done.store(true);
+    });
+    CHECK(WaitFor([&] { return is_done.load(); }));
+    CHECK(ran.load() == tasks_count);
+    std::unique_lock lock(threads_mutex);
+    CHECK(!threads.empty() && !threads.contains(busy));
+}
+
+// Many producers, every task runs exactly once, also across a shrink that parks workers with queued tasks.
+void TestEveryTaskRunsOnce()
+{
+    ThreadPoolQueue pool(64 * 1024);
+    pool.startAsync(8);
+    constexpr int producers_count {4};
+    constexpr int tasks_per_producer {20000};
+    std::vector<std::atomic<int>> runs(producers_count * tasks_per_producer);
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < producers_count; ++producer)
+    {
+        producers.emplace_back([&, producer] {
+            for (int i = 0; i < tasks_per_producer; ++i)
+            {
+                pool.Push([&runs, index = producer * tasks_per_producer + i] { runs[index].fetch_add(1); });
+            }
+        });
+    }
+    pool.Resize(2);
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    CHECK(WaitFor([&] {
+        for (const std::atomic<int>& count : runs)
+        {
+            if (count.load() == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }));
+    bool is_once = true;
+    for (const std::atomic<int>& count : runs)
+    {
+        is_once = is_once && count.load() == 1;
+    }
+    CHECK(is_once);
+}
+
+// With every queue full the pushing thread runs the task marked with the overload policy.
+void TestOverloadPolicy()
+{
+    ThreadPoolQueue pool(2);
+    pool.SetOverloadPolicy(OverloadPolicy::DropNewest);
+    pool.startAsync(1);
+    std::atomic<bool> is_blocked {false};
+    std::atomic<bool> is_released {false};
+    pool.Push([&] {
+        is_blocked.store(true);
+        WaitFor([&] { return is_released.load(); });
+    });
+    CHECK(WaitFor([&] { return is_blocked.load(); }));
+    std::atomic<int> queued {0};
+    int shed = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        pool.Push([&] {
+            if (ThreadPoolQueue::ShedPolicy() == OverloadPolicy::DropNewest)
+            {
+                ++shed;
+            }
+            else
+            {
+                queued.fetch_add(1);
+            }
+        });
+    }
+    CHECK(shed == 2);
+    is_released.store(true);
+    CHECK(WaitFor([&] { return queued.load() == 2; }));
+}
+} // namespace
+
+int main()
+{
+    TestQueuedUntilStart();
+    TestFifoOnOneWorker();
+    TestStealing();
+    TestEveryTaskRunsOnce();
+    TestOverloadPolicy();
+    return Check::Result();
+}
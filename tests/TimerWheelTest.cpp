@@ -0,0 +1,121 @@
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include "Check.h"
+#include "../udptcp_server/server/TimerWheel.h"
+
+namespace
+{
+constexpr uint64_t level_span {TimerWheel::slots_count};
+
+// Every timer fires at the tick it is due, whichever level it waited in. The delays straddle the span of
+// every level, where a timer is cascaded down in the same tick it is due.
+void TestFiresOnTime()
+{
+    std::vector<uint64_t> delays;
+    for (uint64_t span = level_span; span <= level_span * level_span * level_span; span *= level_span)
+    {
+        for (uint64_t delay : {span - 1, span, span + 1, 2 * span, 3 * span - 1})
+        {
+            delays.push_back(delay);
+        }
+    }
+    delays.push_back(1);
+    for (uint64_t start : std::initializer_list<uint64_t> {0, 1, level_span - 1, level_span, level_span + 1, level_span * level_span - 1})
+    {
+        TimerWheel wheel(1, start);
+        std::vector<std::unique_ptr<TimerNode>> nodes;
+        std::vector<uint64_t> fired(delays.size(), 0);
+        uint64_t now = start;
+        for (size_t i = 0; i < delays.size(); ++i)
+        {
+            nodes.push_back(std::make_unique<TimerNode>());
+            wheel.Schedule(*nodes.back(), start + delays[i], [&fired, &now, i] { fired[i] = now; });
+        }
+        uint64_t last = start + 3 * level_span * level_span * level_span;
+        while (now < last)
+        {
+            wheel.Advance(++now);
+        }
+        for (size_t i = 0; i < delays.size(); ++i)
+        {
+            CHECK(fired[i] == start + delays[i]);
+        }
+    }
+}
+
+// Milliseconds round up to whole ticks, a timer never fires early.
+void TestRoundsUpToTicks()
+{
+    TimerWheel wheel(100, 1000);
+    TimerNode node;
+    uint64_t fired = 0;
+    uint64_t now = 1000;
+    wheel.Schedule(node, 1250, [&fired, &now] { fired = now; });
+    for (; now <= 1500; now += 50)
+    {
+        wheel.Advance(now);
+    }
+    CHECK(fired == 1300);
+}
+
+void TestCancelAndReschedule()
+{
+    TimerWheel wheel(1, 0);
+    TimerNode cancelled;
+    TimerNode moved;
+    TimerNode kept;
+    int cancelled_count = 0;
+    uint64_t moved_at = 0;
+    uint64_t kept_at = 0;
+    uint64_t now = 0;
+    wheel.Schedule(cancelled, 10, [&cancelled_count] { ++cancelled_count; });
+    wheel.Cancel(cancelled);
+    wheel.Schedule(moved, 10, [&moved_at, &now] { moved_at = now; });
+    wheel.Schedule(moved, 200, [&moved_at, &now] { moved_at = now; });
+    wheel.Schedule(kept, 50, [&kept_at, &now] { kept_at = now; });
+    // an earlier schedule is kept, a later one is ignored
+    wheel.ScheduleBefore(kept, 300, [&kept_at, &now] { kept_at = now + 1000; });
+    while (now < 400)
+    {
+        wheel.Advance(++now);
+    }
+    CHECK(cancelled_count == 0);
+    CHECK(moved_at == 200);
+    CHECK(kept_at == 50);
+}
+
+// Callbacks run outside the wheel lock and may schedule again.
+void TestScheduleFromCallback()
+{
+    TimerWheel wheel(1, 0);
+    TimerNode node;
+    std::vector<uint64_t> fired;
+    uint64_t now = 0;
+    std::function<void()> repeat = [&] {
+        fired.push_back(now);
+        if (fired.size() < 3)
+        {
+            wheel.Schedule(node, now + level_span, [&repeat] { repeat(); });
+        }
+    };
+    wheel.Schedule(node, level_span, [&repeat] { repeat(); });
+    while (now < 4 * level_span)
+    {
+        wheel.Advance(++now);
+    }
+    CHECK((fired == std::vector<uint64_t> {level_span, 2 * level_span, 3 * level_span}));
+}
+} // namespace
+
+int main()
+{
+    TestFiresOnTime();
+    TestRoundsUpToTicks();
+    TestCancelAndReschedule();
+    TestScheduleFromCallback();
+    return Check::Result();
+}
@@ -1,11 +1,35 @@
 #include "Application.h"
+#include "SystemdNotify.h"
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+extern char** environ;
 
 volatile std::atomic<bool> Application::g_terminated = false;
+volatile std::atomic<bool> Application::g_reload = false;
+volatile std::atomic<bool> Application::g_upgrade = false;
 
-Application::Application() : m_logger(boost::log::keywords::channel = "Application") {}
+Application::Application() : m_port(0), m_upgrade_pid(0),
+    m_config_loader(std::getenv("SERVER_CONFIG") != nullptr ? std::getenv("SERVER_CONFIG") : ""), m_logger("Application") {}
 
 void Application::SignalHandler(int s) 
 {
+    if (s == SIGHUP)
+    {
+        g_reload.store(true);
+        return;
+    }
+    if (s == SIGUSR2)
+    {
+        g_upgrade.store(true);
+        return;
+    }
     g_terminated.store(true);
 }
 
@@ -14,36 +38,140 @@ int Application::Run(std::string_view port)
 {
     try
     {
-        LogHelper::InitLogging();
-        LogHelper::SetLevel(boost::log::trivial::trace);
+        InitLogging();
         SetupSignalHandlers();
         int new_port = GetIntPort(port);
         SetupSignalHandlers();
         InitServer(new_port);
         LOG(m_logger, LogHelper::info, "Server started");
+        // a process started by Upgrade becomes the main process of the service
+        SystemdNotify("READY=1\nMAINPID=" + std::to_string(getpid()));
     }
     catch (const std::exception& err)
     {
         LOG(m_logger, LogHelper::error, "Error while init TCP/UDP server: " << err.what());
         LOG(m_logger, LogHelper::info, "Server stopped");
+        LogHelper::StopLogging();
         return EXIT_FAILURE;
     }
     MainLoop();
+    // after a handover the service lives on in the new process
+    if (!m_server->IsHandedOver())
+    {
+        SystemdNotify("STOPPING=1");
+    }
+    m_server->Drain();
+    m_server->Stop();
     LOG(m_logger, LogHelper::info, "Server stopped");
+    LogHelper::StopLogging();
     return EXIT_SUCCESS;
 }
 
+void Application::InitLogging()
+{
+    LogHelper::OverflowPolicy policy = LogHelper::OverflowPolicy::Drop;
+    const char* overflow = std::getenv("SERVER_LOG_OVERFLOW");
+    bool is_valid_policy = overflow == nullptr || LogHelper::ParsePolicy(overflow, policy);
+    LogHelper::InitLogging(policy);
+    if (!is_valid_policy)
+    {
+        throw std::runtime_error(std::string("invalid value of SERVER_LOG_OVERFLOW: ") + overflow);
+    }
+}
+
+// Starts from "info" so channel overrides dropped from the configuration do not linger after a reload.
+void Application::ApplyLogLevel(const std::string& log_level)
+{
+    LogHelper::ParseLevels(log_level.empty() ? "info" : "info," + log_level);
+}
+
 void Application::InitServer(int port)
 {
+    ConfigLoader::Settings settings = m_config_loader.Load();
+    ApplyLogLevel(settings.log_level);
+    ServerConfig& config = settings.server;
+    config.port = port;
+    m_port = port;
+    m_handover_path = config.handover_path;
+    if (!m_config_loader.Path().empty())
+    {
+        LOG(m_logger, LogHelper::info, "Configuration loaded from " << m_config_loader.Path());
+    }
+
     m_server = std::make_unique<TCPUPDServer>();
     m_server->SetShutdownCallback([]
     {
         g_terminated.store(true);
     }
     );
-    m_server->Init(port);
-    unsigned int max_threads = 8;
-    m_server->ListenAsync(max_threads);
+    m_server->Init(config);
+    m_server->ListenAsync();
+}
+
+void Application::Reload()
+{
+    ConfigLoader::Settings settings;
+    try
+    {
+        settings = m_config_loader.Load();
+    }
+    catch (const std::exception& err)
+    {
+        LOG(m_logger, LogHelper::error, "Configuration not reloaded: " << err.what());
+        return;
+    }
+    for (const std::string& key : m_config_loader.RestartRequired())
+    {
+        LOG(m_logger, LogHelper::warning, "Setting " << key << " changed, it takes effect on restart");
+    }
+    ApplyLogLevel(settings.log_level);
+    m_server->Reload(settings.server);
+    LOG(m_logger, LogHelper::info, "Configuration reloaded");
+}
+
+void Application::Upgrade()
+{
+    if (m_handover_path.empty())
+    {
+        LOG(m_logger, LogHelper::warning, "SIGUSR2 ignored, an upgrade needs SERVER_HANDOVER_PATH");
+        return;
+    }
+    if (m_upgrade_pid > 0)
+    {
+        LOG(m_logger, LogHelper::warning, "SIGUSR2 ignored, process " << m_upgrade_pid << " is taking over already");
+        return;
+    }
+    // the binary may have been replaced on disk, the link then ends in " (deleted)"
+    std::error_code error;
+    std::string path = std::filesystem::read_symlink("/proc/self/exe", error).string();
+    constexpr std::string_view deleted {" (deleted)"};
+    if (path.ends_with(deleted))
+    {
+        path.resize(path.size() - deleted.size());
+    }
+    std::string port = std::to_string(m_port);
+    char* argv[] {path.data(), port.data(), nullptr};
+    pid_t pid = 0;
+    int result = error ? error.value() : posix_spawn(&pid, path.c_str(), nullptr, nullptr, argv, environ);
+    if (result != 0)
+    {
+        LOG(m_logger, LogHelper::error, "Upgrade failed, cannot start " << path << ": " << strerror(result));
+        return;
+    }
+    m_upgrade_pid = pid;
+    LOG(m_logger, LogHelper::info, "Upgrade started, process " << pid << " of " << path << " takes the listeners over");
+}
+
+void Application::ReapUpgrade()
+{
+    int status = 0;
+    if (m_upgrade_pid <= 0 || waitpid(m_upgrade_pid, &status, WNOHANG) != m_upgrade_pid)
+    {
+        return;
+    }
+    LOG(m_logger, LogHelper::error, "Upgrade failed, process " << m_upgrade_pid << " exited with status "
+        << (WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status)) << ", serving on");
+    m_upgrade_pid = 0;
 }
 
 int Application::GetIntPort(std::string_view port)
@@ -65,7 +193,8 @@ void Application::SetupSignalHandlers()
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = SA_RESTART;
 
-    if (sigaction(SIGINT, &sa, nullptr) == -1 || sigaction(SIGTERM, &sa, nullptr) == -1)
+    if (sigaction(SIGINT, &sa, nullptr) == -1 || sigaction(SIGTERM, &sa, nullptr) == -1 || sigaction(SIGHUP, &sa, nullptr) == -1 ||
+        sigaction(SIGUSR2, &sa, nullptr) == -1)
     {
         throw std::runtime_error("failed to set signal handlers");
     }
@@ -75,6 +204,15 @@ void Application::MainLoop()
 {
     while (!g_terminated.load())
     {
+        if (g_reload.exchange(false))
+        {
+            Reload();
+        }
+        if (g_upgrade.exchange(false))
+        {
+            Upgrade();
+        }
+        ReapUpgrade();
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 }
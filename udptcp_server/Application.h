@@ -2,7 +2,10 @@
 #include <stdexcept>
 #include <string_view>
 #include <memory>
+#include <string>
+#include <sys/types.h>
 
+#include "ConfigLoader.h"
 #include "./server/Server.h"
 #include "./logging/Logging.h"
 
@@ -12,13 +15,27 @@ public:
     Application();
     int Run(std::string_view port);
 private:
+    void InitLogging();
     void SetupSignalHandlers();
     static void SignalHandler(int s);
     int GetIntPort(std::string_view port);
+    void ApplyLogLevel(const std::string& log_level);
     void InitServer(int port);
+    // Re-reads the configuration on SIGHUP and applies what can change without a restart.
+    void Reload();
+    // Starts the current binary on SIGUSR2; it takes the listening sockets over and this process drains.
+    void Upgrade();
+    // Logs the replacement process if it exited without taking over.
+    void ReapUpgrade();
     void MainLoop();
 
     static volatile std::atomic<bool> g_terminated;
+    static volatile std::atomic<bool> g_reload;
+    static volatile std::atomic<bool> g_upgrade;
+    int m_port;
+    std::string m_handover_path;
+    pid_t m_upgrade_pid;
+    ConfigLoader m_config_loader;
     std::unique_ptr<TCPUPDServer> m_server;
-    mutable boost::log::sources::severity_channel_logger_mt<boost::log::trivial::severity_level> m_logger;
+    mutable LogHelper::Logger m_logger;
 };
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "ConfigLoader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "./logging/Logging.h"
+
+namespace
+{
+using Settings = ConfigLoader::Settings;
+
+struct Option
+{
+    std::string_view key;
+    // applied by a reload, the others need a restart
+    bool is_reloadable;
+    bool (*apply)(std::string_view value, Settings& settings);
+};
+
+template<auto member, unsigned long long min_value = 0>
+bool SetNumber(std::string_view value, Settings& settings)
+{
+    using Number = std::remove_reference_t<decltype(settings.server.*member)>;
+    unsigned long long result = 0;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc() || end != value.data() + value.size() || result > std::numeric_limits<Number>::max())
+    {
+        return false;
+    }
+    settings.server.*member = static_cast<Number>(std::max(result, min_value));
+    return true;
+}
+
+template<auto member>
+bool SetFlag(std::string_view value, Settings& settings)
+{
+    bool is_on = value == "1" || value == "true" || value == "on";
+    if (!is_on && value != "0" && value != "false" && value != "off")
+    {
+        return false;
+    }
+    settings.server.*member = is_on;
+    return true;
+}
+
+bool SetEndpoints(std::string_view value, Settings& settings)
+{
+    return Endpoint::ParseList(value, settings.server.endpoints);
+}
+
+bool SetHandoverPath(std::string_view value, Settings& settings)
+{
+    settings.server.handover_path = value;
+    return true;
+}
+
+bool SetIoBackend(std::string_view value, Settings& settings)
+{
+    if (value == "epoll")
+    {
+        settings.server.io_backend = IoBackendType::Epoll;
+        return true;
+    }
+    if (value == "io_uring")
+    {
+        settings.server.io_backend = IoBackendType::IoUring;
+        return true;
+    }
+    return false;
+}
+
+bool SetFraming(std::string_view value, Settings& settings)
+{
+    return Framing::Parse(value, settings.server.framing);
+}
+
+bool SetOverloadPolicy(std::string_view value, Settings& settings)
+{
+    static constexpr std::pair<std::string_view, OverloadPolicy> policies[] {
+        {"run", OverloadPolicy::Run}, {"drop_newest", OverloadPolicy::DropNewest},
+        {"drop_oldest", OverloadPolicy::DropOldest}, {"reject", OverloadPolicy::Reject}};
+    for (const auto& [name, policy] : policies)
+    {
+        if (value == name)
+        {
+            settings.server.overload_policy = policy;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SetLogLevel(std::string_view value, Settings& settings)
+{
+    if (!LogHelper::IsValidLevels(value))
+    {
+        return false;
+    }
+    settings.log_level = value;
+    return true;
+}
+
+constexpr Option options[] {
+    {"listen", false, &SetEndpoints},
+    {"threads", true, &SetNumber<&ServerConfig::max_threads, 1>},
+    {"max_events", false, &SetNumber<&ServerConfig::max_events, 1>},
+    {"shards", false, &SetNumber<&ServerConfig::shards_count>},
+    {"pin_shards", false, &SetFlag<&ServerConfig::pin_shards>},
+    {"listen_backlog", false, &SetNumber<&ServerConfig::listen_backlog, 1>},
+    {"accept_listeners", false, &SetNumber<&ServerConfig::accept_listeners, 1>},
+    {"io_backend", false, &SetIoBackend},
+    {"uring_entries", false, &SetNumber<&ServerConfig::uring_entries, 1>},
+    {"uring_buffers", false, &SetNumber<&ServerConfig::uring_buffers_count, 1>},
+    {"framing", false, &SetFraming},
+    {"read_buffer_size", false, &SetNumber<&ServerConfig::read_buffer_size, 1>},
+    {"max_message_size", false, &SetNumber<&ServerConfig::max_message_size>},
+    {"write_high_watermark", false, &SetNumber<&ServerConfig::write_high_watermark, 1>},
+    {"write_low_watermark", false, &SetNumber<&ServerConfig::write_low_watermark>},
+    {"zerocopy_threshold", false, &SetNumber<&ServerConfig::zerocopy_threshold>},
+    {"idle_timeout_ms", true, &SetNumber<&ServerConfig::idle_timeout_ms>},
+    {"read_timeout_ms", true, &SetNumber<&ServerConfig::read_timeout_ms>},
+    {"write_timeout_ms", true, &SetNumber<&ServerConfig::write_timeout_ms>},
+    {"timer_tick_ms", false, &SetNumber<&ServerConfig::timer_tick_ms, 1>},
+    {"keepalive_idle", false, &SetNumber<&ServerConfig::keepalive_idle_s, 1>},
+    {"keepalive_interval", false, &SetNumber<&ServerConfig::keepalive_interval_s, 1>},
+    {"keepalive_count", false, &SetNumber<&ServerConfig::keepalive_count, 1>},
+    {"udp_batch", false, &SetNumber<&ServerConfig::udp_batch_size, 1>},
+    {"udp_datagram_size", false, &SetNumber<&ServerConfig::udp_datagram_size, 1>},
+    {"metrics_port", false, &SetNumber<&ServerConfig::metrics_port>},
+    {"rate_limit", true, &SetNumber<&ServerConfig::rate_limit>},
+    {"rate_burst", true, &SetNumber<&ServerConfig::rate_burst>},
+    {"rate_limit_sources", false, &SetNumber<&ServerConfig::rate_limit_sources, 1>},
+    {"queue_capacity", false, &SetNumber<&ServerConfig::queue_capacity, 2>},
+    {"overload_policy", true, &SetOverloadPolicy},
+    {"drain_timeout_ms", false, &SetNumber<&ServerConfig::drain_timeout_ms>},
+    {"handover_path", false, &SetHandoverPath},
+    {"log_level", true, &SetLogLevel},
+};
+
+const Option* FindOption(std::string_view key)
+{
+    for (const Option& option : options)
+    {
+        if (option.key == key)
+        {
+            return &option;
+        }
+    }
+    return nullptr;
+}
+
+std::string_view Trim(std::string_view text)
+{
+    size_t begin = 0;
+    while (begin < text.size() && std::isspace(static_cast<unsigned char>(text[begin])))
+    {
+        ++begin;
+    }
+    size_t end = text.size();
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1])))
+    {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+std::string EnvironmentName(std::string_view key)
+{
+    std::string name("SERVER_");
+    for (char c : key)
+    {
+        name.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+    }
+    return name;
+}
+} // namespace
+
+ConfigLoader::ConfigLoader(std::string path) : m_path(std::move(path)) {}
+
+ConfigLoader::Settings ConfigLoader::Load()
+{
+    std::map<std::string, std::string, std::less<>> values;
+    if (!m_path.empty())
+    {
+        std::ifstream file(m_path);
+        if (!file)
+        {
+            throw std::runtime_error("cannot open configuration file " + m_path);
+        }
+        std::string line;
+        for (unsigned int number = 1; std::getline(file, line); ++number)
+        {
+            std::string_view text = Trim(std::string_view(line).substr(0, line.find('#')));
+            if (text.empty())
+            {
+                continue;
+            }
+            size_t equals = text.find('=');
+            std::string_view key = Trim(text.substr(0, equals));
+            if (equals == std::string_view::npos || FindOption(key) == nullptr)
+            {
+                throw std::runtime_error(m_path + ":" + std::to_string(number) + ": unknown setting \"" + std::string(text) + "\"");
+            }
+            values[std::string(key)] = Trim(text.substr(equals + 1));
+        }
+    }
+    // the environment wins over the file
+    for (const Option& option : options)
+    {
+        const char* value = std::getenv(EnvironmentName(option.key).c_str());
+        if (value != nullptr && *value != '\0')
+        {
+            values[std::string(option.key)] = value;
+        }
+    }
+
+    Settings settings;
+    for (const auto& [key, value] : values)
+    {
+        if (!FindOption(key)->apply(value, settings))
+        {
+            const char* source = std::getenv(EnvironmentName(key).c_str());
+            std::string name = source != nullptr && *source != '\0' ? EnvironmentName(key) : m_path + ": " + key;
+            throw std::runtime_error("invalid value of " + name + ": " + value);
+        }
+    }
+    settings.server.write_low_watermark = std::min(settings.server.write_low_watermark, settings.server.write_high_watermark);
+
+    m_restart_required.clear();
+    if (m_is_loaded)
+    {
+        for (const Option& option : options)
+        {
+            auto before = m_initial_values.find(option.key);
+            auto after = values.find(option.key);
+            bool is_changed = (before == m_initial_values.end()) != (after == values.end()) ||
+                (before != m_initial_values.end() && before->second != after->second);
+            if (is_changed && !option.is_reloadable)
+            {
+                m_restart_required.emplace_back(option.key);
+            }
+        }
+    }
+    else
+    {
+        m_initial_values = std::move(values);
+        m_is_loaded = true;
+    }
+    return settings;
+}
+
+const std::vector<std::string>& ConfigLoader::RestartRequired() const
+{
+    return m_restart_required;
+}
+
+const std::string& ConfigLoader::Path() const
+{
+    return m_path;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./server/ServerConfig.h"
+
+// Server settings from a file of "key = value" lines with the SERVER_* environment variables on top. A key is
+// the name of its variable without the prefix in lower case: idle_timeout_ms for SERVER_IDLE_TIMEOUT_MS.
+// # starts a comment, blank lines are skipped.
+class ConfigLoader {
+public:
+    struct Settings
+    {
+        ServerConfig server;
+        // SERVER_LOG_LEVEL syntax, empty for the default
+        std::string log_level;
+    };
+
+    // An empty path reads the environment only.
+    explicit ConfigLoader(std::string path);
+
+    // Reads the file and the environment again. Throws std::runtime_error naming the line or variable of
+    // the first invalid value.
+    Settings Load();
+
+    // Keys whose value in the last Load differs from the first one although it takes effect on restart only.
+    const std::vector<std::string>& RestartRequired() const;
+
+    const std::string& Path() const;
+private:
+    std::string m_path;
+    // values of the first Load as written, the ones the server started with
+    std::map<std::string, std::string, std::less<>> m_initial_values;
+    std::vector<std::string> m_restart_required;
+    bool m_is_loaded {false};
+};
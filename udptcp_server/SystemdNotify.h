@@ -0,0 +1,41 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+// Sends state lines such as "READY=1" to systemd when it started the process as a Type=notify service,
+// does nothing otherwise.
+inline void SystemdNotify(std::string_view state)
+{
+    const char* path = std::getenv("NOTIFY_SOCKET");
+    if (path == nullptr || (path[0] != '/' && path[0] != '@'))
+    {
+        return;
+    }
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    size_t length = strlen(path);
+    if (length >= sizeof(address.sun_path))
+    {
+        return;
+    }
+    memcpy(address.sun_path, path, length);
+    if (path[0] == '@')
+    {
+        address.sun_path[0] = '\0';
+    }
+    int notify = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (notify < 0)
+    {
+        return;
+    }
+    sendto(notify, state.data(), state.size(), MSG_NOSIGNAL, reinterpret_cast<const sockaddr*>(&address),
+        static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length));
+    close(notify);
+}
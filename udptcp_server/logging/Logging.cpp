@@ -1,63 +1,576 @@
-#include <boost/log/core.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/log/sources/severity_logger.hpp>
-#include <boost/log/support/date_time.hpp>
-#include <boost/log/utility/setup/formatter_parser.hpp>
-#include <boost/core/null_deleter.hpp>
-#include <boost/log/sinks/text_ostream_backend.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/expressions.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
-
-#include "Logging.h"
-
-namespace logging = boost::log;
-namespace keywords = boost::log::keywords;
-namespace sinks = boost::log::sinks;
-namespace expr = boost::log::expressions;
-
-static boost::shared_ptr<sinks::synchronous_sink<sinks::text_ostream_backend>> g_console_sink;
-
-void InitConsoleLogging(boost::log::formatter& log_format)
-{
-    g_console_sink = boost::make_shared<sinks::synchronous_sink<sinks::text_ostream_backend>>();
-    
-    auto backend = g_console_sink->locked_backend();
-    backend->add_stream(boost::shared_ptr<std::ostream>(&std::cout, boost::null_deleter()));
-    backend->auto_flush(true);
-    
-    g_console_sink->set_formatter(log_format);
-    
-    g_console_sink->set_filter(
-        logging::trivial::severity >= logging::trivial::info
-    );
-    
-    logging::core::get()->add_sink(g_console_sink);
-}
-
-void LogHelper::InitLogging(const int rotation_size, const int max_files, const int max_size)
-{
-    boost::log::formatter log_format = (
-        expr::stream 
-        << "[" << expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S")
-        << "] [" << logging::trivial::severity 
-        << "] [" << expr::attr<std::string>("Channel") 
-        << "] " << expr::smessage
-    );
-    
-    InitConsoleLogging(log_format);
-    logging::add_common_attributes();
-    
-    logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::info);
-}
-
-void LogHelper::SetLevel(logging::trivial::severity_level level)
-{
-    auto filter_expr = logging::trivial::severity >= level;
-    logging::core::get()->set_filter(filter_expr);
-    
-    if (g_console_sink)
-    {
-        g_console_sink->set_filter(filter_expr);
-    }
-}
\ No newline at end of file
+#include "Logging.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LogHelper
+{
+namespace detail
+{
+static constexpr size_t staging_size {4096};
+static constexpr uint32_t padding_entry {UINT32_MAX};
+
+// Single producer (the owning thread), single consumer (the writer) ring of variable sized entries.
+struct ThreadRing
+{
+    explicit ThreadRing(size_t capacity) : buffer(std::make_unique<char[]>(capacity)), capacity(capacity) {}
+
+    std::unique_ptr<char[]> buffer;
+    const size_t capacity;
+    alignas(64) std::atomic<uint64_t> head {0};
+    alignas(64) std::atomic<uint64_t> tail {0};
+    std::atomic<uint64_t> dropped {0};
+    std::atomic<bool> is_abandoned {false};
+    bool is_recording {false};
+    std::array<char, staging_size> staging;
+};
+
+struct alignas(8) EntryHeader
+{
+    uint32_t size;
+    uint32_t payload_size;
+    int64_t timestamp;
+    const Channel* channel;
+    const char* function;
+    Level level;
+};
+
+struct RingHolder
+{
+    ~RingHolder()
+    {
+        if (ring)
+        {
+            // the writer frees the ring once it is drained
+            ring->is_abandoned.store(true, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<ThreadRing> ring;
+};
+} // namespace detail
+
+namespace
+{
+struct LogState
+{
+    ~LogState()
+    {
+        if (is_running.exchange(false))
+        {
+            wake_epoch.fetch_add(1, std::memory_order_release);
+            wake_epoch.notify_one();
+            writer.join();
+        }
+    }
+
+    std::mutex channels_mutex;
+    std::vector<std::unique_ptr<Channel>> channels;
+    Level default_level {Level::info};
+
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<detail::ThreadRing>> rings;
+    size_t ring_size {0};
+    OverflowPolicy policy {OverflowPolicy::Drop};
+    FILE* output {stdout};
+
+    // the writer sleeps on wake_epoch (a futex) while every ring is empty
+    std::atomic<uint32_t> wake_epoch {0};
+    std::atomic<bool> is_writer_sleeping {false};
+    std::atomic<bool> is_running {false};
+    std::thread writer;
+};
+
+LogState& State()
+{
+    static LogState state;
+    return state;
+}
+
+thread_local detail::RingHolder t_ring;
+
+void WakeWriter()
+{
+    LogState& state = State();
+    state.wake_epoch.fetch_add(1, std::memory_order_release);
+    state.wake_epoch.notify_one();
+}
+
+constexpr std::array<std::string_view, 6> level_names {"trace", "debug", "info", "warning", "error", "fatal"};
+
+int64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+size_t Align(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+// Drains every ring once, formats the entries and appends them to output in timestamp order across threads.
+// Records stamped after the drain started are held back for the next one, which sorts them with what the other
+// threads logged meanwhile. A producer preempted between stamping and publishing a record can still land it after
+// newer records of other threads.
+class Formatter {
+public:
+    bool Drain(std::string& output, bool is_final)
+    {
+        int64_t cutoff = Now();
+        {
+            // the copy keeps its capacity, an idle writer does not allocate
+            std::unique_lock lock(State().rings_mutex);
+            m_rings = State().rings;
+        }
+        size_t held = m_lines.size();
+        for (auto& ring : m_rings)
+        {
+            DrainRing(*ring);
+        }
+        m_rings.clear();
+        bool has_records = m_lines.size() > held;
+        std::stable_sort(m_lines.begin(), m_lines.end(), [](const Line& left, const Line& right) {
+            return left.timestamp < right.timestamp;
+        });
+        auto ready = is_final ? m_lines.end() : std::partition_point(m_lines.begin(), m_lines.end(), [cutoff](const Line& line) {
+            return line.timestamp < cutoff;
+        });
+        for (auto line = m_lines.begin(); line != ready; ++line)
+        {
+            output.append(m_text, line->begin, line->end - line->begin);
+        }
+        m_held_text.clear();
+        for (auto line = ready; line != m_lines.end(); ++line)
+        {
+            size_t begin = m_held_text.size();
+            m_held_text.append(m_text, line->begin, line->end - line->begin);
+            *line = Line {line->timestamp, begin, m_held_text.size()};
+        }
+        m_lines.erase(m_lines.begin(), ready);
+        m_text.swap(m_held_text);
+
+        std::unique_lock lock(State().rings_mutex);
+        std::erase_if(State().rings, [](const std::shared_ptr<detail::ThreadRing>& ring) {
+            return ring->is_abandoned.load(std::memory_order_acquire) &&
+                ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire);
+        });
+        return has_records;
+    }
+
+    bool HasHeld() const
+    {
+        return !m_lines.empty();
+    }
+
+    // Whether a ring holds records the last drain did not take.
+    bool HasPending()
+    {
+        std::unique_lock lock(State().rings_mutex);
+        for (auto& ring : State().rings)
+        {
+            if (ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    struct Line
+    {
+        int64_t timestamp;
+        size_t begin;
+        size_t end;
+    };
+
+    void DrainRing(detail::ThreadRing& ring)
+    {
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        uint64_t tail = ring.tail.load(std::memory_order_acquire);
+        while (head != tail)
+        {
+            const char* entry = ring.buffer.get() + (head & (ring.capacity - 1));
+            detail::EntryHeader header;
+            std::memcpy(&header, entry, sizeof(uint32_t) * 2);
+            if (header.payload_size != detail::padding_entry)
+            {
+                std::memcpy(&header, entry, sizeof(header));
+                Format(header, entry + sizeof(header));
+            }
+            head += header.size;
+        }
+        ring.head.store(head, std::memory_order_release);
+
+        uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0)
+        {
+            static Channel channel("Logging", Level::warning);
+            int64_t now = Now();
+            size_t begin = m_text.size();
+            AppendPrefix(now, Level::warning, channel, "Drain");
+            m_text += "Dropped ";
+            m_text += std::to_string(dropped);
+            m_text += " records of a thread with a full ring\n";
+            m_lines.push_back(Line {now, begin, m_text.size()});
+        }
+    }
+
+    void Format(const detail::EntryHeader& header, const char* payload)
+    {
+        size_t begin = m_text.size();
+        AppendPrefix(header.timestamp, header.level, *header.channel, header.function);
+        const char* end = payload + header.payload_size;
+        while (payload < end)
+        {
+            auto tag = static_cast<detail::Tag>(*payload++);
+            switch (tag)
+            {
+            case detail::Tag::String:
+            {
+                uint32_t size;
+                std::memcpy(&size, payload, sizeof(size));
+                m_text.append(payload + sizeof(size), size);
+                payload += sizeof(size) + size;
+                break;
+            }
+            case detail::Tag::Int:
+                payload = AppendNumber<int64_t>(payload);
+                break;
+            case detail::Tag::UInt:
+                payload = AppendNumber<uint64_t>(payload);
+                break;
+            case detail::Tag::Double:
+                payload = AppendNumber<double>(payload);
+                break;
+            case detail::Tag::Char:
+                m_text += *payload++;
+                break;
+            case detail::Tag::Bool:
+                m_text += *payload++ ? "1" : "0";
+                break;
+            }
+        }
+        m_text += '\n';
+        m_lines.push_back(Line {header.timestamp, begin, m_text.size()});
+    }
+
+    template<class T>
+    const char* AppendNumber(const char* payload)
+    {
+        T value;
+        std::memcpy(&value, payload, sizeof(value));
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        m_text.append(buffer, result.ptr);
+        return payload + sizeof(value);
+    }
+
+    void AppendPrefix(int64_t timestamp, Level level, const Channel& channel, const char* function)
+    {
+        time_t seconds = timestamp / 1000000000;
+        if (seconds != m_cached_second)
+        {
+            std::tm tm;
+            localtime_r(&seconds, &tm);
+            char buffer[32];
+            m_cached_time.assign(buffer, std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm));
+            m_cached_second = seconds;
+        }
+        m_text += '[';
+        m_text += m_cached_time;
+        m_text += "] [";
+        m_text += level_names[static_cast<size_t>(level)];
+        m_text += "] [";
+        m_text += channel.name;
+        m_text += "] <";
+        m_text += function;
+        m_text += "> ";
+    }
+
+    std::vector<std::shared_ptr<detail::ThreadRing>> m_rings;
+    std::vector<Line> m_lines;
+    std::string m_text;
+    std::string m_held_text;
+    time_t m_cached_second {-1};
+    std::string m_cached_time;
+};
+
+void WriterLoop()
+{
+    Formatter formatter;
+    std::string output;
+    while (true)
+    {
+        bool is_running = State().is_running.load(std::memory_order_acquire);
+        bool has_records = formatter.Drain(output, !is_running);
+        if (!output.empty())
+        {
+            std::fwrite(output.data(), 1, output.size(), State().output);
+            std::fflush(State().output);
+            output.clear();
+        }
+        if (!is_running && !has_records)
+        {
+            break;
+        }
+        // held records go out with the next drain
+        if (!has_records && !formatter.HasHeld())
+        {
+            // pairs with the fence in CommitRecord: either the producer sees the writer asleep and wakes it, or the
+            // writer sees its record and drains again
+            LogState& state = State();
+            uint32_t epoch = state.wake_epoch.load(std::memory_order_acquire);
+            state.is_writer_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (state.is_running.load(std::memory_order_acquire) && !formatter.HasPending())
+            {
+                state.wake_epoch.wait(epoch, std::memory_order_acquire);
+            }
+            state.is_writer_sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Caller holds channels_mutex.
+Channel* FindOrAddChannel(std::string_view name)
+{
+    LogState& state = State();
+    for (auto& channel : state.channels)
+    {
+        if (channel->name == name)
+        {
+            return channel.get();
+        }
+    }
+    return state.channels.emplace_back(std::make_unique<Channel>(name, state.default_level)).get();
+}
+} // namespace
+
+namespace detail
+{
+ThreadRing* LocalRing()
+{
+    if (!t_ring.ring)
+    {
+        LogState& state = State();
+        if (!state.is_running.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        std::unique_lock lock(state.rings_mutex);
+        t_ring.ring = std::make_shared<ThreadRing>(state.ring_size);
+        state.rings.push_back(t_ring.ring);
+    }
+    return t_ring.ring.get();
+}
+
+char* BeginRecord(ThreadRing* ring, size_t& capacity)
+{
+    if (ring->is_recording)
+    {
+        // a record built while evaluating the message of another one is lost
+        return nullptr;
+    }
+    ring->is_recording = true;
+    capacity = ring->staging.size();
+    return ring->staging.data();
+}
+
+void CommitRecord(ThreadRing* ring, Level level, const Channel& channel, const char* function, size_t size)
+{
+    ring->is_recording = false;
+    LogState& state = State();
+    size_t total = Align(sizeof(EntryHeader) + size);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t previous_tail = tail;
+    size_t offset = tail & (ring->capacity - 1);
+    size_t contiguous = ring->capacity - offset;
+    // an entry never wraps, the rest of the buffer is skipped with a padding entry
+    size_t needed = contiguous < total ? contiguous + total : total;
+    while (ring->capacity - (tail - ring->head.load(std::memory_order_acquire)) < needed)
+    {
+        if (state.policy == OverflowPolicy::Drop || !state.is_running.load(std::memory_order_relaxed))
+        {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        WakeWriter();
+        std::this_thread::yield();
+    }
+
+    if (contiguous < total)
+    {
+        uint32_t padding[2] {static_cast<uint32_t>(contiguous), padding_entry};
+        std::memcpy(ring->buffer.get() + offset, padding, sizeof(padding));
+        offset = 0;
+        tail += contiguous;
+    }
+    EntryHeader header;
+    header.size = static_cast<uint32_t>(total);
+    header.payload_size = static_cast<uint32_t>(size);
+    header.timestamp = Now();
+    header.channel = &channel;
+    header.function = function;
+    header.level = level;
+    std::memcpy(ring->buffer.get() + offset, &header, sizeof(header));
+    std::memcpy(ring->buffer.get() + offset + sizeof(header), ring->staging.data(), size);
+    ring->tail.store(tail + total, std::memory_order_release);
+    // only the record that makes a ring non-empty can find the writer asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->head.load(std::memory_order_relaxed) == previous_tail && state.is_writer_sleeping.load(std::memory_order_relaxed))
+    {
+        WakeWriter();
+    }
+}
+} // namespace detail
+
+void InitLogging(OverflowPolicy policy, size_t ring_size, FILE* output)
+{
+    LogState& state = State();
+    if (state.is_running.load())
+    {
+        return;
+    }
+    state.policy = policy;
+    state.output = output;
+    // the largest entry must fit twice so a padding entry never blocks it
+    state.ring_size = std::bit_ceil(std::max(ring_size, 4 * detail::staging_size));
+    state.is_running.store(true, std::memory_order_release);
+    state.writer = std::thread(WriterLoop);
+}
+
+void StopLogging()
+{
+    LogState& state = State();
+    if (!state.is_running.exchange(false))
+    {
+        return;
+    }
+    WakeWriter();
+    if (state.writer.joinable())
+    {
+        state.writer.join();
+    }
+}
+
+void SetLevel(Level level)
+{
+    LogState& state = State();
+    std::unique_lock lock(state.channels_mutex);
+    state.default_level = level;
+    for (auto& channel : state.channels)
+    {
+        channel->level.store(level, std::memory_order_relaxed);
+    }
+}
+
+void SetLevel(std::string_view channel, Level level)
+{
+    std::unique_lock lock(State().channels_mutex);
+    FindOrAddChannel(channel)->level.store(level, std::memory_order_relaxed);
+}
+
+bool ParseLevel(std::string_view name, Level& level)
+{
+    for (size_t i = 0; i < level_names.size(); ++i)
+    {
+        if (level_names[i] == name)
+        {
+            level = static_cast<Level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace
+{
+bool SplitLevels(std::string_view spec, std::vector<std::pair<std::string_view, Level>>& channel_levels, bool& has_default, Level& default_level)
+{
+    while (!spec.empty())
+    {
+        size_t comma = spec.find(',');
+        std::string_view part = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        size_t equals = part.find('=');
+        Level level;
+        if (equals == std::string_view::npos)
+        {
+            if (!ParseLevel(part, level))
+            {
+                return false;
+            }
+            has_default = true;
+            default_level = level;
+        }
+        else
+        {
+            if (equals == 0 || !ParseLevel(part.substr(equals + 1), level))
+            {
+                return false;
+            }
+            channel_levels.emplace_back(part.substr(0, equals), level);
+        }
+    }
+    return true;
+}
+} // namespace
+
+bool IsValidLevels(std::string_view spec)
+{
+    std::vector<std::pair<std::string_view, Level>> channel_levels;
+    bool has_default = false;
+    Level default_level = Level::info;
+    return SplitLevels(spec, channel_levels, has_default, default_level);
+}
+
+bool ParseLevels(std::string_view spec)
+{
+    std::vector<std::pair<std::string_view, Level>> channel_levels;
+    bool has_default = false;
+    Level default_level = Level::info;
+    if (!SplitLevels(spec, channel_levels, has_default, default_level))
+    {
+        return false;
+    }
+    if (has_default)
+    {
+        SetLevel(default_level);
+    }
+    for (auto& [channel, level] : channel_levels)
+    {
+        SetLevel(channel, level);
+    }
+    return true;
+}
+
+bool ParsePolicy(std::string_view name, OverflowPolicy& policy)
+{
+    if (name == "drop")
+    {
+        policy = OverflowPolicy::Drop;
+        return true;
+    }
+    if (name == "block")
+    {
+        policy = OverflowPolicy::Block;
+        return true;
+    }
+    return false;
+}
+
+Logger::Logger(std::string_view channel)
+{
+    std::unique_lock lock(State().channels_mutex);
+    m_channel = FindOrAddChannel(channel);
+}
+} // namespace LogHelper
@@ -1,22 +1,253 @@
-#pragma once
-
-#include <string>
-
-#include <boost/log/trivial.hpp>
-#include <boost/log/sources/channel_logger.hpp>
-#include <boost/log/utility/manipulators/add_value.hpp>
-#include <boost/log/sources/severity_channel_logger.hpp>
-
-#define LOG(logger, level, message) BOOST_LOG_SEV(logger, level) << "<" << __func__ << "> " << message
-
-namespace LogHelper
-{
-static constexpr auto info = boost::log::trivial::info;
-static constexpr auto error = boost::log::trivial::error;
-static constexpr auto fatal = boost::log::trivial::fatal;
-static constexpr auto debug = boost::log::trivial::debug;
-static constexpr auto warning = boost::log::trivial::warning;
-
-void InitLogging(const int rotation_size = 10 * 1024 * 1024, const int max_files = 5, const int max_size = 5 * 1024 * 1024);
-void SetLevel(boost::log::trivial::severity_level level);
-} // namespace LogHelper
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// Records are filtered by a per-channel level before the message expression is evaluated, then copied
+// as typed arguments into a ring buffer of the calling thread. Formatting and the stdout write happen
+// on a background writer thread.
+#define LOG(logger, level, message) \
+    do \
+    { \
+        if ((logger).IsEnabled(level)) \
+        { \
+            LogHelper::Record log_record_((logger), (level), __func__); \
+            log_record_ << message; \
+        } \
+    } while (false)
+
+namespace LogHelper
+{
+enum class Level : uint8_t
+{
+    trace,
+    debug,
+    info,
+    warning,
+    error,
+    fatal
+};
+
+static constexpr auto trace = Level::trace;
+static constexpr auto debug = Level::debug;
+static constexpr auto info = Level::info;
+static constexpr auto warning = Level::warning;
+static constexpr auto error = Level::error;
+static constexpr auto fatal = Level::fatal;
+
+// What a thread does when its ring is full: lose the record or wait for the writer.
+enum class OverflowPolicy
+{
+    Drop,
+    Block
+};
+
+struct Channel
+{
+    explicit Channel(std::string_view name, Level level) : name(name), level(level) {}
+
+    const std::string name;
+    std::atomic<Level> level;
+};
+
+void InitLogging(OverflowPolicy policy = OverflowPolicy::Drop, size_t ring_size = 256 * 1024, FILE* output = stdout);
+// Writes out everything queued so far and stops the writer thread.
+void StopLogging();
+// Sets the level of every channel, including the ones created later.
+void SetLevel(Level level);
+void SetLevel(std::string_view channel, Level level);
+bool ParseLevel(std::string_view name, Level& level);
+// Applies "info" or "info,Epoll=debug,Server=warning"; false if any part is malformed.
+bool ParseLevels(std::string_view spec);
+// Checks a ParseLevels spec without applying it.
+bool IsValidLevels(std::string_view spec);
+bool ParsePolicy(std::string_view name, OverflowPolicy& policy);
+
+class Logger {
+public:
+    explicit Logger(std::string_view channel);
+
+    bool IsEnabled(Level level) const
+    {
+        return level >= m_channel->level.load(std::memory_order_relaxed);
+    }
+
+    const Channel& GetChannel() const
+    {
+        return *m_channel;
+    }
+private:
+    Channel* m_channel;
+};
+
+namespace detail
+{
+enum class Tag : uint8_t
+{
+    String,
+    Int,
+    UInt,
+    Double,
+    Char,
+    Bool
+};
+
+// Stream buffer over a fixed span, output past its end is cut.
+class SpanStreamBuf : public std::streambuf {
+public:
+    SpanStreamBuf(char* begin, size_t size)
+    {
+        setp(begin, begin + size);
+    }
+
+    size_t Size() const
+    {
+        return pptr() - pbase();
+    }
+};
+
+struct ThreadRing;
+ThreadRing* LocalRing();
+// Encoded arguments of the record being built on this thread.
+char* BeginRecord(ThreadRing* ring, size_t& capacity);
+void CommitRecord(ThreadRing* ring, Level level, const Channel& channel, const char* function, size_t size);
+} // namespace detail
+
+// Builds one record in the thread staging buffer; the destructor publishes it. Numbers are stored raw
+// and strings by value, nothing is formatted on the calling thread.
+class Record {
+public:
+    Record(const Logger& logger, Level level, const char* function) : m_channel(logger.GetChannel()), m_level(level),
+        m_function(function), m_ring(detail::LocalRing()), m_buffer(nullptr), m_capacity(0), m_size(0)
+    {
+        if (m_ring != nullptr)
+        {
+            m_buffer = detail::BeginRecord(m_ring, m_capacity);
+        }
+    }
+
+    ~Record()
+    {
+        if (m_buffer != nullptr)
+        {
+            detail::CommitRecord(m_ring, m_level, m_channel, m_function, m_size);
+        }
+    }
+
+    Record(const Record&) = delete;
+    Record& operator=(const Record&) = delete;
+
+    // Strings that do not fit into the staging buffer are cut.
+    Record& operator<<(std::string_view value)
+    {
+        if (m_buffer == nullptr || m_capacity - m_size < 1 + sizeof(uint32_t))
+        {
+            return *this;
+        }
+        auto size = static_cast<uint32_t>(std::min(value.size(), m_capacity - m_size - 1 - sizeof(uint32_t)));
+        Reserve(detail::Tag::String, sizeof(size) + size);
+        Write(&size, sizeof(size));
+        Write(value.data(), size);
+        return *this;
+    }
+
+    Record& operator<<(const char* value)
+    {
+        return *this << std::string_view(value != nullptr ? value : "(null)");
+    }
+
+    Record& operator<<(const std::string& value)
+    {
+        return *this << std::string_view(value);
+    }
+
+    Record& operator<<(char value)
+    {
+        return Put(detail::Tag::Char, value);
+    }
+
+    Record& operator<<(bool value)
+    {
+        return Put(detail::Tag::Bool, value);
+    }
+
+    template<std::signed_integral T>
+    Record& operator<<(T value)
+    {
+        return Put(detail::Tag::Int, static_cast<int64_t>(value));
+    }
+
+    template<std::unsigned_integral T>
+    Record& operator<<(T value)
+    {
+        return Put(detail::Tag::UInt, static_cast<uint64_t>(value));
+    }
+
+    template<std::floating_point T>
+    Record& operator<<(T value)
+    {
+        return Put(detail::Tag::Double, static_cast<double>(value));
+    }
+
+    // Rare types without a raw encoding are formatted eagerly, straight into the staging buffer and cut at its end.
+    template<class T>
+        requires (!std::convertible_to<const T&, std::string_view> && !std::is_arithmetic_v<T> && !std::is_pointer_v<T>)
+    Record& operator<<(const T& value)
+    {
+        if (m_buffer == nullptr || m_capacity - m_size < 1 + sizeof(uint32_t))
+        {
+            return *this;
+        }
+        detail::SpanStreamBuf buffer(m_buffer + m_size + 1 + sizeof(uint32_t), m_capacity - m_size - 1 - sizeof(uint32_t));
+        std::ostream stream(&buffer);
+        stream << value;
+        auto size = static_cast<uint32_t>(buffer.Size());
+        Reserve(detail::Tag::String, sizeof(size) + size);
+        Write(&size, sizeof(size));
+        m_size += size;
+        return *this;
+    }
+private:
+    template<class T>
+    Record& Put(detail::Tag tag, T value)
+    {
+        if (Reserve(tag, sizeof(value)))
+        {
+            Write(&value, sizeof(value));
+        }
+        return *this;
+    }
+
+    bool Reserve(detail::Tag tag, size_t size)
+    {
+        if (m_buffer == nullptr || m_capacity - m_size < 1 + size)
+        {
+            return false;
+        }
+        m_buffer[m_size++] = static_cast<char>(tag);
+        return true;
+    }
+
+    void Write(const void* data, size_t size)
+    {
+        std::memcpy(m_buffer + m_size, data, size);
+        m_size += size;
+    }
+
+    const Channel& m_channel;
+    const Level m_level;
+    const char* const m_function;
+    detail::ThreadRing* const m_ring;
+    char* m_buffer;
+    size_t m_capacity;
+    size_t m_size;
+};
+} // namespace LogHelper
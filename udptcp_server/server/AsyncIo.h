@@ -0,0 +1,93 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+#include "IoBackend.h"
+
+// Awaitables of the reactor: each parks the coroutine on the backend until the socket is ready, and the backend
+// resumes it on its reactor thread. The accept loops of the backends and streaming commands are built on them.
+//   while (is_accepting) { int client = co_await AsyncAccept(backend, listener); ... }
+
+// The next client of a stream listener, -1 if the coroutine was woken without one.
+class AsyncAccept {
+public:
+    AsyncAccept(IoBackend& backend, size_t listener) : m_backend(backend), m_listener(listener) {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return m_backend.WaitAccept(m_listener, handle, m_client);
+    }
+
+    int await_resume() const noexcept
+    {
+        return m_client;
+    }
+private:
+    IoBackend& m_backend;
+    size_t m_listener;
+    int m_client {-1};
+};
+
+// Until the read buffer of the connection holds more than seen bytes; false once the connection is closed.
+class AsyncRead {
+public:
+    AsyncRead(IoBackend& backend, Connection& connection, uint32_t generation, size_t seen) : m_backend(backend),
+        m_connection(connection), m_generation(generation), m_seen(seen) {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return m_backend.WaitReadable(m_connection, m_generation, m_seen, handle);
+    }
+
+    bool await_resume() const
+    {
+        return m_connection.IsCurrent(m_generation);
+    }
+private:
+    IoBackend& m_backend;
+    Connection& m_connection;
+    uint32_t m_generation;
+    size_t m_seen;
+};
+
+// Moves data to the output of the connection; if that leaves more than write_high_watermark bytes unsent, waits
+// until the client read it down to write_low_watermark. false once the connection is closed or failed.
+class AsyncWrite {
+public:
+    AsyncWrite(IoBackend& backend, Connection& connection, uint32_t generation, OutputQueue& data) : m_backend(backend),
+        m_connection(connection), m_generation(generation), m_data(data) {}
+
+    bool await_ready()
+    {
+        m_is_failed = !m_data.Empty() && !m_backend.Send(m_connection, m_generation, m_data);
+        return m_is_failed;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return m_backend.WaitWritable(m_connection, m_generation, handle);
+    }
+
+    bool await_resume() const
+    {
+        return !m_is_failed && m_connection.IsCurrent(m_generation);
+    }
+private:
+    IoBackend& m_backend;
+    Connection& m_connection;
+    uint32_t m_generation;
+    OutputQueue& m_data;
+    bool m_is_failed {false};
+};
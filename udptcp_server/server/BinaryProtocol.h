@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Compact request/response batches carried in a TCP frame or a UDP datagram in place of a text message.
+// A batch starts with the 4 magic bytes and holds any number of requests, each a 12-byte little-endian
+// header followed by its payload:
+//   uint32 request_id | uint16 opcode | uint16 status | uint32 payload_length | payload
+// The response batch has one entry with the same layout per request, in request order, carrying the
+// request_id and opcode of its request and the status of the answer; requests leave status at 0.
+// 0xFE never occurs in UTF-8 text, so no text command is taken for a batch. Echo payloads are arbitrary
+// bytes though: a message that starts with the magic is parsed as a batch and answered as one, most likely
+// with a Malformed entry, instead of being echoed.
+namespace BinaryProtocol
+{
+inline constexpr std::string_view magic {"\xFE" "UB\x01", 4};
+constexpr size_t header_size {12};
+
+enum class Opcode : uint16_t
+{
+    // payload comes back unchanged
+    Echo = 0,
+    // int64 nanoseconds since the Unix epoch, UTC
+    Time = 1,
+    // uint16 counters count, uint16 gauges count, then a uint64 per counter and an int64 per gauge
+    // in the order of /metrics
+    Stats = 2,
+    // payload is a text command such as "/pools", its text answer comes back
+    Command = 3
+};
+
+enum class Status : uint16_t
+{
+    Ok = 0,
+    UnknownOpcode = 1,
+    UnknownCommand = 2,
+    // the rest of the batch is shorter than the header or payload it announces, answered with request_id 0
+    Malformed = 3,
+    Busy = 4,
+    RateLimited = 5
+};
+
+struct Header
+{
+    uint32_t request_id {0};
+    uint16_t opcode {0};
+    uint16_t status {0};
+    uint32_t length {0};
+};
+
+template<class T>
+void AppendLittle(std::string& output, T value)
+{
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        output.push_back(static_cast<char>(bits >> (8 * i) & 0xff));
+    }
+}
+
+template<class T>
+T ReadLittle(const char* data)
+{
+    std::make_unsigned_t<T> bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        bits |= static_cast<std::make_unsigned_t<T>>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return static_cast<T>(bits);
+}
+
+template<class T>
+void WriteLittle(char* data, T value)
+{
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        data[i] = static_cast<char>(bits >> (8 * i) & 0xff);
+    }
+}
+
+inline bool IsBatch(std::string_view message)
+{
+    return message.starts_with(magic);
+}
+
+// True when data could be the start of a batch, for callers that look at a few bytes only.
+inline bool MayBeBatch(std::string_view data)
+{
+    return data.starts_with(magic) || (!data.empty() && magic.starts_with(data));
+}
+
+// Cuts the next request off the front of requests, the batch without its magic. False when the rest is
+// shorter than the header or the payload it announces.
+inline bool Next(std::string_view& requests, Header& header, std::string_view& payload)
+{
+    if (requests.size() < header_size)
+    {
+        return false;
+    }
+    header.request_id = ReadLittle<uint32_t>(requests.data());
+    header.opcode = ReadLittle<uint16_t>(requests.data() + 4);
+    header.status = ReadLittle<uint16_t>(requests.data() + 6);
+    header.length = ReadLittle<uint32_t>(requests.data() + 8);
+    if (requests.size() - header_size < header.length)
+    {
+        return false;
+    }
+    payload = requests.substr(header_size, header.length);
+    requests.remove_prefix(header_size + header.length);
+    return true;
+}
+
+// Appends the header of a response whose payload follows, returns its position for EndResponse.
+inline size_t BeginResponse(std::string& output, uint32_t request_id, uint16_t opcode)
+{
+    size_t position = output.size();
+    AppendLittle(output, request_id);
+    AppendLittle(output, opcode);
+    output.append(6, '\0');
+    return position;
+}
+
+// Fills in the status and the length of everything appended since BeginResponse.
+inline void EndResponse(std::string& output, size_t position, Status status)
+{
+    WriteLittle(output.data() + position + 6, static_cast<uint16_t>(status));
+    WriteLittle(output.data() + position + 8, static_cast<uint32_t>(output.size() - position - header_size));
+}
+
+// Answers every request of batch with status and no payload.
+inline void AppendRefusal(std::string_view batch, Status status, std::string& output)
+{
+    output.append(magic);
+    batch.remove_prefix(magic.size());
+    Header header;
+    std::string_view payload;
+    while (Next(batch, header, payload))
+    {
+        EndResponse(output, BeginResponse(output, header.request_id, header.opcode), status);
+    }
+}
+} // namespace BinaryProtocol
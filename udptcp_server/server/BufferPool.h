@@ -0,0 +1,33 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+
+#include "SlabAllocator.h"
+
+struct PooledBuffer
+{
+    std::unique_ptr<char[], SlabDeleter> data;
+    size_t capacity {0};
+};
+
+// I/O blocks of at least min_block_size bytes from the slab cache of the calling thread. A block may be
+// released on any thread, it goes back to the cache it came from.
+class BufferPool {
+public:
+    explicit BufferPool(size_t min_block_size = 1024) : m_min_block_size(min_block_size) {}
+
+    PooledBuffer Acquire(size_t size)
+    {
+        size_t capacity = SlabAllocator::BlockSize(std::max(m_min_block_size, size));
+        return PooledBuffer {std::unique_ptr<char[], SlabDeleter>(static_cast<char*>(SlabAllocator::Allocate(capacity))), capacity};
+    }
+
+    void Release(PooledBuffer&& buffer)
+    {
+        buffer.data.reset();
+        buffer.capacity = 0;
+    }
+private:
+    const size_t m_min_block_size;
+};
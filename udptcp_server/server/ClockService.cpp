@@ -0,0 +1,183 @@
+#include "ClockService.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace
+{
+int64_t Now(timespec& now)
+{
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec;
+}
+} // namespace
+
+ClockService::ClockService() : m_sequence(0), m_second(-1), m_is_running(false), m_timer(-1)
+{
+    for (size_t i = 0; i < m_words_count; ++i)
+    {
+        m_local[i].store(0, std::memory_order_relaxed);
+        m_utc[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+ClockService::~ClockService()
+{
+    Stop();
+}
+
+void ClockService::Start()
+{
+    if (m_is_running.load())
+    {
+        return;
+    }
+    m_timer = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    if (m_timer < 0)
+    {
+        throw std::runtime_error(std::string("timerfd_create failed: ") + strerror(errno));
+    }
+    ArmTimer();
+    timespec now;
+    Texts texts;
+    FormatSecond(Now(now), texts);
+    Publish(texts);
+    m_is_running.store(true);
+    m_thread = std::thread(&ClockService::Run, this);
+}
+
+void ClockService::Stop()
+{
+    if (!m_is_running.exchange(false))
+    {
+        return;
+    }
+    // an expiration in one nanosecond wakes the blocked read
+    itimerspec spec {};
+    spec.it_value.tv_nsec = 1;
+    timerfd_settime(m_timer, 0, &spec, nullptr);
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    close(m_timer);
+    m_timer = -1;
+}
+
+void ClockService::Append(ClockService::Format format, std::string& output) const
+{
+    timespec now;
+    int64_t second = Now(now);
+    Texts texts;
+    if (!Read(texts) || texts.second != second)
+    {
+        FormatSecond(second, texts);
+    }
+    bool is_utc = format == Format::Utc || format == Format::UtcMs;
+    char text[sizeof(Words)];
+    std::memcpy(text, is_utc ? texts.utc.data() : texts.local.data(), sizeof(text));
+    output.append(text, m_text_size);
+    if (format == Format::LocalMs || format == Format::UtcMs)
+    {
+        long ms = now.tv_nsec / 1000000;
+        char fraction[4] = {'.', static_cast<char>('0' + ms / 100), static_cast<char>('0' + ms / 10 % 10), static_cast<char>('0' + ms % 10)};
+        output.append(fraction, sizeof(fraction));
+    }
+    if (is_utc)
+    {
+        output.push_back('Z');
+    }
+}
+
+void ClockService::FormatSecond(int64_t second, Texts& texts)
+{
+    time_t time = second;
+    std::tm tm;
+    char text[sizeof(Words)] {};
+    localtime_r(&time, &tm);
+    std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+    std::memcpy(texts.local.data(), text, sizeof(text));
+    gmtime_r(&time, &tm);
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::memcpy(texts.utc.data(), text, sizeof(text));
+    texts.second = second;
+}
+
+// Single writer: only Start and the timer thread publish.
+void ClockService::Publish(const Texts& texts)
+{
+    uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < m_words_count; ++i)
+    {
+        m_local[i].store(texts.local[i], std::memory_order_relaxed);
+        m_utc[i].store(texts.utc[i], std::memory_order_relaxed);
+    }
+    m_second.store(texts.second, std::memory_order_relaxed);
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// false if the writer kept the texts busy, the caller formats them itself then.
+bool ClockService::Read(Texts& texts) const
+{
+    static constexpr int max_attempts {4};
+    for (int attempt = 0; attempt < max_attempts; ++attempt)
+    {
+        uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < m_words_count; ++i)
+        {
+            texts.local[i] = m_local[i].load(std::memory_order_relaxed);
+            texts.utc[i] = m_utc[i].load(std::memory_order_relaxed);
+        }
+        texts.second = m_second.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fires at every whole second; a change of the system clock cancels the timer and Run re-arms it.
+void ClockService::ArmTimer()
+{
+    timespec now;
+    itimerspec spec {};
+    spec.it_value.tv_sec = Now(now) + 1;
+    spec.it_interval.tv_sec = 1;
+    timerfd_settime(m_timer, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr);
+}
+
+void ClockService::Run()
+{
+    while (m_is_running.load())
+    {
+        uint64_t expirations;
+        if (read(m_timer, &expirations, sizeof(expirations)) < 0)
+        {
+            if (errno == ECANCELED)
+            {
+                ArmTimer();
+            }
+            else if (errno != EINTR)
+            {
+                return;
+            }
+        }
+        timespec now;
+        Texts texts;
+        FormatSecond(Now(now), texts);
+        Publish(texts);
+    }
+}
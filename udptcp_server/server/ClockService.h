@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Current time formatted once per second. A thread woken by a timerfd at every second boundary formats the
+// local and UTC text and publishes it under a seqlock, readers copy it without locks or localtime_r. A reader
+// that sees a second which is not published yet formats it itself, so the answer is never stale.
+class ClockService {
+public:
+    enum class Format
+    {
+        // 2025-11-28 15:04:05
+        Local,
+        // 2025-11-28 15:04:05.123
+        LocalMs,
+        // 2025-11-28T12:04:05Z
+        Utc,
+        // 2025-11-28T12:04:05.123Z
+        UtcMs
+    };
+
+    ClockService();
+    ~ClockService();
+
+    ClockService(const ClockService&) = delete;
+    ClockService& operator=(const ClockService&) = delete;
+
+    void Start();
+    void Stop();
+    void Append(Format format, std::string& output) const;
+private:
+    static constexpr size_t m_text_size {19};
+    static constexpr size_t m_words_count {(m_text_size + 7) / 8};
+
+    using Words = std::array<uint64_t, m_words_count>;
+
+    struct Texts
+    {
+        int64_t second {-1};
+        Words local {};
+        Words utc {};
+    };
+
+    static void FormatSecond(int64_t second, Texts& texts);
+    void Publish(const Texts& texts);
+    bool Read(Texts& texts) const;
+    void ArmTimer();
+    void Run();
+
+    std::atomic<uint32_t> m_sequence;
+    std::atomic<int64_t> m_second;
+    std::array<std::atomic<uint64_t>, m_words_count> m_local;
+    std::array<std::atomic<uint64_t>, m_words_count> m_utc;
+    std::atomic<bool> m_is_running;
+    int m_timer;
+    std::thread m_thread;
+};
@@ -0,0 +1,186 @@
+#include "CommandContext.h"
+
+// A frame that ends while its timer is still scheduled was resumed by a close or a drain.
+CommandContext::~CommandContext()
+{
+    if (CanStream())
+    {
+        m_stream.backend->Timers().Cancel(m_timer);
+    }
+}
+
+OutputQueue* CommandContext::EndMessage()
+{
+    if (!IsOpen())
+    {
+        return nullptr;
+    }
+    OutputQueue* data = &m_message;
+    if (!m_is_streaming)
+    {
+        // the replies of the read so far leave first, the rest of the read waits for the command
+        Framing::EndFrame(m_stream.framing, *m_reply, *m_stream.frame_start);
+        m_stream.responses->PushCopy(*m_reply);
+        m_reply->clear();
+        data = m_stream.responses;
+        m_output = &m_buffer;
+        m_is_streaming = true;
+    }
+    else
+    {
+        Framing::EndFrame(m_stream.framing, m_buffer, m_frame_start);
+        m_message.PushCopy(m_buffer);
+        m_buffer.clear();
+    }
+    m_frame_start = Framing::BeginFrame(m_stream.framing, m_buffer);
+    return data;
+}
+
+bool CommandContext::Send()
+{
+    OutputQueue* data = EndMessage();
+    if (data != nullptr && !data->Empty() && !m_stream.backend->Send(*m_stream.connection, m_stream.generation, *data))
+    {
+        m_is_failed = true;
+    }
+    return IsOpen();
+}
+
+bool CommandContext::IsOpen() const
+{
+    return CanStream() && !m_is_failed && m_stream.connection->IsCurrent(m_stream.generation);
+}
+
+bool CommandContext::CanWait() const
+{
+    return IsOpen() && !m_stream.connection->is_command_cancelled.load();
+}
+
+// Whoever takes sleep_waiter resumes the command: the timer, or a close or drain of the connection. The timer
+// is scheduled before the lock is released, the frame may be gone right after.
+bool CommandContext::Sleep(std::coroutine_handle<> handle, uint64_t ms)
+{
+    bool is_first = Suspend();
+    Connection& connection = *m_stream.connection;
+    std::unique_lock write_lock(connection.write_mutex);
+    if (!connection.IsCurrent(m_stream.generation) || connection.is_command_cancelled.load())
+    {
+        if (is_first)
+        {
+            Unsuspend();
+        }
+        return false;
+    }
+    connection.sleep_waiter = handle;
+    TimerWheel& timers = m_stream.backend->Timers();
+    timers.Schedule(m_timer, timers.Now() + ms, [this] { Wake(); });
+    return true;
+}
+
+void CommandContext::Wake()
+{
+    Connection& connection = *m_stream.connection;
+    std::coroutine_handle<> handle;
+    {
+        std::unique_lock write_lock(connection.write_mutex);
+        if (connection.IsCurrent(m_stream.generation))
+        {
+            handle = std::exchange(connection.sleep_waiter, nullptr);
+        }
+    }
+    if (handle)
+    {
+        handle.resume();
+    }
+}
+
+// Until the first suspension the caller parses the read buffer and still has to consume this request, so the
+// buffer is only looked at once suspended.
+AsyncTask<bool> CommandContext::Read(std::string& message)
+{
+    Send();
+    if (!CanWait())
+    {
+        co_return false;
+    }
+    size_t seen = 0;
+    while (true)
+    {
+        if (m_is_suspended)
+        {
+            FrameStatus status = TakeMessage(message, seen);
+            if (status != FrameStatus::Incomplete)
+            {
+                co_return status == FrameStatus::Complete;
+            }
+        }
+        AsyncRead read(*m_stream.backend, *m_stream.connection, m_stream.generation, seen);
+        if (!co_await SuspendAwaiter(*this, std::move(read)) || !CanWait())
+        {
+            co_return false;
+        }
+    }
+}
+
+FrameStatus CommandContext::TakeMessage(std::string& message, size_t& seen)
+{
+    Connection& connection = *m_stream.connection;
+    std::unique_lock read_lock(connection.read_mutex);
+    ReadBuffer& read_buffer = connection.read_buffer;
+    std::string_view frame;
+    size_t consumed = 0;
+    FrameStatus status = Framing::Next(m_stream.framing, read_buffer.Data(), m_stream.max_message_size, frame, consumed);
+    if (status == FrameStatus::Complete)
+    {
+        message.assign(frame);
+        read_buffer.Consume(consumed);
+    }
+    seen = read_buffer.Size();
+    return status;
+}
+
+// The first suspension happens within OnTCPData, which holds the connection, so it cannot close meanwhile;
+// later ones find the flag set, or cleared by the close.
+bool CommandContext::Suspend()
+{
+    if (m_is_suspended)
+    {
+        return false;
+    }
+    m_is_suspended = true;
+    m_stream.connection->is_command_running.store(true);
+    return true;
+}
+
+// Still within OnTCPData, which holds the connection, so nothing acted on the flag meanwhile.
+void CommandContext::Unsuspend()
+{
+    m_is_suspended = false;
+    m_stream.connection->is_command_running.store(false);
+}
+
+void CommandContext::Finish()
+{
+    if (!m_is_streaming)
+    {
+        return;
+    }
+    Send();
+    if (!m_is_suspended)
+    {
+        // completed within OnTCPData, which goes on with the next request in a new frame
+        *m_stream.frame_start = Framing::BeginFrame(m_stream.framing, *m_reply);
+        return;
+    }
+    Connection& connection = *m_stream.connection;
+    {
+        // a worker that still runs the read the command started in owns the connection until it returns
+        std::unique_lock read_lock(connection.read_mutex);
+        if (!connection.IsCurrent(m_stream.generation))
+        {
+            return;
+        }
+        connection.is_command_running.store(false);
+    }
+    m_stream.backend->ResumeReading(connection, m_stream.generation);
+}
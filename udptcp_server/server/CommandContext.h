@@ -0,0 +1,214 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "AsyncIo.h"
+#include "Coroutine.h"
+#include "Framing.h"
+#include "IoBackend.h"
+#include "TimerWheel.h"
+
+// Where a command on a TCP connection sends the parts of a reply it streams.
+struct CommandStream
+{
+    Connection* connection {nullptr};
+    uint32_t generation {0};
+    IoBackend* backend {nullptr};
+    FramingMode framing {FramingMode::Raw};
+    size_t max_message_size {0};
+    // the replies of the read so far, they leave ahead of the first part
+    OutputQueue* responses {nullptr};
+    // start of the reply frame in the output, see Framing::BeginFrame
+    size_t* frame_start {nullptr};
+};
+
+// What a command handler works with: the reply it appends to and three awaitables. On a TCP connection the
+// command may send parts of a long reply as messages of their own, pause in between and read what the client
+// sends; the connection answers no further request until it returns. Elsewhere, in UDP datagrams and binary
+// batches, they complete at once with false and the reply is the whole output.
+//   do { AppendLine(context.Output()); } while (co_await context.SleepFor(1000));
+class CommandContext {
+public:
+    explicit CommandContext(std::string& output) : m_output(&output), m_reply(&output) {}
+
+    // output holds the reply frame from *stream.frame_start on.
+    CommandContext(std::string& output, const CommandStream& stream) : m_output(&output), m_reply(&output),
+        m_stream(stream) {}
+
+    CommandContext(const CommandContext&) = delete;
+    CommandContext& operator=(const CommandContext&) = delete;
+
+    ~CommandContext();
+
+    // The reply being built.
+    std::string& Output()
+    {
+        return *m_output;
+    }
+
+    bool CanStream() const
+    {
+        return m_stream.connection != nullptr;
+    }
+
+    class FlushAwaiter {
+    public:
+        explicit FlushAwaiter(CommandContext& context) : m_context(context) {}
+
+        bool await_ready()
+        {
+            OutputQueue* data = m_context.EndMessage();
+            if (data == nullptr)
+            {
+                return true;
+            }
+            const CommandStream& stream = m_context.m_stream;
+            m_write.emplace(*stream.backend, *stream.connection, stream.generation, *data);
+            return m_write->await_ready();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            bool is_first = m_context.Suspend();
+            if (m_write->await_suspend(handle))
+            {
+                return true;
+            }
+            if (is_first)
+            {
+                m_context.Unsuspend();
+            }
+            return false;
+        }
+
+        bool await_resume()
+        {
+            m_context.m_is_failed = !m_write || !m_write->await_resume();
+            return !m_context.m_is_failed;
+        }
+    private:
+        CommandContext& m_context;
+        std::optional<AsyncWrite> m_write;
+    };
+
+    class SleepAwaiter {
+    public:
+        SleepAwaiter(CommandContext& context, uint64_t ms) : m_context(context), m_ms(ms) {}
+
+        bool await_ready()
+        {
+            m_context.Send();
+            return !m_context.CanWait();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            return m_context.Sleep(handle, m_ms);
+        }
+
+        bool await_resume()
+        {
+            return m_context.CanWait();
+        }
+    private:
+        CommandContext& m_context;
+        uint64_t m_ms;
+    };
+
+    // Sends the output so far as one message; if the client has more than write_high_watermark bytes unread
+    // it waits until the client read them down to write_low_watermark. false once the client is gone.
+    FlushAwaiter Flush()
+    {
+        return FlushAwaiter(*this);
+    }
+
+    // Sends the output so far, then resumes on the reactor of the connection after ms. false once the client
+    // is gone or the server drains.
+    SleepAwaiter SleepFor(uint64_t ms)
+    {
+        return SleepAwaiter(*this, ms);
+    }
+
+    // Sends the output so far, then waits for the next message of the client and copies it to message; the
+    // requests that followed the command come first. false once the client is gone, the server drains or the
+    // message exceeds max_message_size.
+    AsyncTask<bool> Read(std::string& message);
+
+    // For the server once the handler returned: sends the rest of a streamed reply and, if the command
+    // suspended, lets the connection read again.
+    void Finish();
+private:
+    // Awaits awaitable with the command marked suspended, see Suspend; a first suspension that did not park
+    // after all is taken back.
+    template<class Awaitable>
+    class SuspendAwaiter {
+    public:
+        SuspendAwaiter(CommandContext& context, Awaitable&& awaitable) : m_context(context),
+            m_awaitable(std::move(awaitable)) {}
+
+        bool await_ready()
+        {
+            return m_awaitable.await_ready();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            bool is_first = m_context.Suspend();
+            if (m_awaitable.await_suspend(handle))
+            {
+                return true;
+            }
+            if (is_first)
+            {
+                m_context.Unsuspend();
+            }
+            return false;
+        }
+
+        decltype(auto) await_resume()
+        {
+            return m_awaitable.await_resume();
+        }
+    private:
+        CommandContext& m_context;
+        Awaitable m_awaitable;
+    };
+
+    // Ends the current message and returns the queue that holds it, nullptr if it cannot stream or the client
+    // is gone.
+    OutputQueue* EndMessage();
+    // Ends the current message and hands it to the backend, false if it cannot stream or the client is gone.
+    bool Send();
+    bool IsOpen() const;
+    // Open and not cancelled by a drain, see Connection::CancelCommand.
+    bool CanWait() const;
+    // Parks handle on the connection until the timer fires, false if the command cannot wait.
+    bool Sleep(std::coroutine_handle<> handle, uint64_t ms);
+    // The timer of Sleep.
+    void Wake();
+    // Cuts the next message off the read buffer; seen is what it holds when the message is incomplete.
+    FrameStatus TakeMessage(std::string& message, size_t& seen);
+    // Marks the command suspended before it parks, true the first time.
+    bool Suspend();
+    // Takes back the first Suspend when the command did not park after all.
+    void Unsuspend();
+
+    std::string* m_output;
+    // the caller's buffer, valid until the first suspension
+    std::string* m_reply;
+    CommandStream m_stream;
+    // output once the reply streams
+    std::string m_buffer;
+    // the message EndMessage ended
+    OutputQueue m_message;
+    size_t m_frame_start {0};
+    bool m_is_streaming {false};
+    bool m_is_suspended {false};
+    // a send failed, the socket reports the error to the backend later
+    bool m_is_failed {false};
+    TimerNode m_timer;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Coroutine.h"
+
+class CommandContext;
+
+// Handlers of the "/name" commands. Names are registered up front, then Build searches for a seed that puts
+// every name into its own slot of a power of two table, so Find costs one hash and one compare no matter
+// how many commands there are, and never allocates.
+class CommandRegistry {
+public:
+    // Appends the reply to output, which may already hold earlier replies. Nothing appended means no reply.
+    using Handler = std::function<void(std::string_view args, std::string& output)>;
+    // A coroutine for commands that stream their reply or wait, see CommandContext. It appends to
+    // context.Output() like a Handler; args stays valid until it returns. Its frame is only created for
+    // these commands, the others are plain calls.
+    using AsyncHandler = std::function<AsyncTask<>(std::string_view args, CommandContext& context)>;
+
+    void Register(std::string_view name, Handler&& handler)
+    {
+        Add(name).handler = std::move(handler);
+    }
+
+    void RegisterAsync(std::string_view name, AsyncHandler&& handler)
+    {
+        Add(name).async_handler = std::move(handler);
+    }
+
+    void Build()
+    {
+        if (IsBuilt() || m_entries.empty())
+        {
+            return;
+        }
+        static constexpr uint64_t seeds_per_size {256};
+        for (size_t size = m_min_table_size; ; size *= 2)
+        {
+            if (size < m_entries.size() * 2)
+            {
+                continue;
+            }
+            for (uint64_t seed = 0; seed < seeds_per_size; ++seed)
+            {
+                if (TryBuild(size, seed))
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    bool IsBuilt() const
+    {
+        return !m_slots.empty();
+    }
+
+    // nullptr for an unknown name, an async command or before Build.
+    const Handler* Find(std::string_view name) const
+    {
+        int32_t index = FindIndex(name);
+        return index < 0 || IsAsync(index) ? nullptr : &m_entries[index].handler;
+    }
+
+    // Registration order of the command, -1 for an unknown name or before Build. Lets callers keep
+    // per-command data in a plain array.
+    int32_t FindIndex(std::string_view name) const
+    {
+        if (m_slots.empty())
+        {
+            return -1;
+        }
+        int32_t index = m_slots[Hash(name, m_seed) & (m_slots.size() - 1)];
+        if (index < 0 || m_entries[index].name != name)
+        {
+            return -1;
+        }
+        return index;
+    }
+
+    size_t Size() const
+    {
+        return m_entries.size();
+    }
+
+    bool IsAsync(size_t index) const
+    {
+        return static_cast<bool>(m_entries[index].async_handler);
+    }
+
+    const Handler& HandlerAt(size_t index) const
+    {
+        return m_entries[index].handler;
+    }
+
+    const AsyncHandler& AsyncHandlerAt(size_t index) const
+    {
+        return m_entries[index].async_handler;
+    }
+
+    std::string_view NameAt(size_t index) const
+    {
+        return m_entries[index].name;
+    }
+
+    // Seeded FNV-1a.
+    static constexpr uint64_t Hash(std::string_view name, uint64_t seed)
+    {
+        uint64_t hash = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+        for (char c : name)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash ^ (hash >> 29);
+    }
+private:
+    static constexpr size_t m_min_table_size {8};
+
+    struct Entry
+    {
+        std::string name;
+        // one of the two is set
+        Handler handler;
+        AsyncHandler async_handler;
+    };
+
+    Entry& Add(std::string_view name)
+    {
+        if (IsBuilt())
+        {
+            throw std::runtime_error("command registered after the server start: " + std::string(name));
+        }
+        for (const auto& entry : m_entries)
+        {
+            if (entry.name == name)
+            {
+                throw std::runtime_error("command registered twice: " + std::string(name));
+            }
+        }
+        return m_entries.emplace_back(Entry {std::string(name), {}, {}});
+    }
+
+    bool TryBuild(size_t size, uint64_t seed)
+    {
+        std::vector<int32_t> slots(size, -1);
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            int32_t& slot = slots[Hash(m_entries[i].name, seed) & (size - 1)];
+            if (slot >= 0)
+            {
+                return false;
+            }
+            slot = static_cast<int32_t>(i);
+        }
+        m_slots = std::move(slots);
+        m_seed = seed;
+        return true;
+    }
+
+    std::vector<Entry> m_entries;
+    std::vector<int32_t> m_slots;
+    uint64_t m_seed {0};
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <sys/ioctl.h>
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#include "OutputQueue.h"
+#include "ReadBuffer.h"
+#include "TimerWheel.h"
+
+// One slot of the ConnectionTable. Slots are reused for every socket that gets the same descriptor, the
+// generation tells the current connection from events that were queued for a previous one.
+struct Connection
+{
+    Connection(int socket, BufferPool& pool) : socket(socket), read_buffer(pool) {}
+
+    // true if the slot still holds the connection an event was registered for
+    bool IsCurrent(uint32_t event_generation) const
+    {
+        return is_open.load(std::memory_order_acquire) && generation.load(std::memory_order_acquire) == event_generation;
+    }
+
+    // Nothing half read, unanswered or unsent, so closing loses no request. false while another thread holds
+    // the connection.
+    bool IsQuiescent()
+    {
+        std::unique_lock read_lock(read_mutex, std::try_to_lock);
+        std::unique_lock write_lock(write_mutex, std::try_to_lock);
+        int unread = 0;
+        return read_lock && write_lock && !is_command_running.load() && read_buffer.Size() == 0 && output.Empty() && ioctl(socket, FIONREAD, &unread) == 0 && unread == 0;
+    }
+
+    // Tells the command suspended on the connection to end, its SleepFor and Read return false, and takes the
+    // coroutines parked on it for the backend to resume. A close takes write_waiter as well, a drain lets it
+    // deliver the output.
+    std::array<std::coroutine_handle<>, 3> CancelCommand(bool is_closing)
+    {
+        std::unique_lock write_lock(write_mutex);
+        is_command_cancelled.store(true);
+        return {std::exchange(read_waiter, nullptr), std::exchange(sleep_waiter, nullptr),
+            is_closing ? std::exchange(write_waiter, nullptr) : std::coroutine_handle<>()};
+    }
+
+    const int socket;
+    std::atomic<bool> is_open {false};
+    std::atomic<uint32_t> generation {0};
+    std::atomic<bool> is_read_paused {false};
+    // epoll backend: the generation in the high half, the work queued for the one task that serves the
+    // connection in the low one. See EpollBackend::Schedule
+    std::atomic<uint64_t> dispatch_state {0};
+    // a command suspended in the middle of its reply, the requests behind it wait in read_buffer
+    std::atomic<bool> is_command_running {false};
+    // set by CancelCommand until the next generation
+    std::atomic<bool> is_command_cancelled {false};
+    // output, is_write_armed and the waiters are guarded by write_mutex
+    bool is_write_armed {false};
+    // coroutines parked in AsyncRead and AsyncWrite, see IoBackend::WaitReadable and WaitWritable
+    std::coroutine_handle<> read_waiter;
+    // read_waiter resumes once read_buffer holds more than this
+    size_t read_waiter_seen {0};
+    std::coroutine_handle<> write_waiter;
+    // a command in SleepFor, its timer resumes it
+    std::coroutine_handle<> sleep_waiter;
+    std::mutex read_mutex;
+    std::mutex write_mutex;
+    ReadBuffer read_buffer;
+    OutputQueue output;
+    // TimerWheel::Now of the last transfer, of the start of a partial frame and of the last progress of blocked
+    // output; 0 while there is no partial frame or blocked output. See ConnectionTimeouts
+    std::atomic<uint64_t> last_activity_ms {0};
+    std::atomic<uint64_t> read_pending_since_ms {0};
+    std::atomic<uint64_t> write_blocked_since_ms {0};
+    TimerNode timer;
+    // RateLimiter::SourceKey of the peer, 0 when rate limiting was off at accept
+    uint64_t source {0};
+    // id of the reactor that serves it
+    unsigned int reactor {0};
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+
+#include "Connection.h"
+
+// Connection slots indexed by file descriptor. Slots are allocated in chunks on first use and live as long
+// as the table, so Find is a lock-free array walk and a stale pointer never dangles; the generation counter
+// rejects events that belong to an earlier connection on a reused descriptor. Open and Close of one
+// descriptor are serialized by the kernel: it is not handed out again before the previous owner closes it.
+class ConnectionTable {
+public:
+    ConnectionTable(BufferPool& pool, size_t capacity) : m_pool(pool), m_capacity(capacity),
+        m_chunks_count((capacity + m_chunk_size - 1) / m_chunk_size), m_chunks(std::make_unique<std::atomic<Chunk*>[]>(m_chunks_count)),
+        m_open_count(0)
+    {
+        for (size_t i = 0; i < m_chunks_count; ++i)
+        {
+            m_chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ConnectionTable()
+    {
+        for (size_t i = 0; i < m_chunks_count; ++i)
+        {
+            delete m_chunks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    // Largest descriptor count the process may open, so every accepted socket fits.
+    static size_t DefaultCapacity()
+    {
+        static constexpr size_t max_capacity {1 << 20};
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+        {
+            return max_capacity;
+        }
+        return std::min<size_t>(limit.rlim_cur, max_capacity);
+    }
+
+    // Starts a new generation in the slot of socket, nullptr if the descriptor is beyond the capacity.
+    Connection* Open(int socket)
+    {
+        if (socket < 0 || static_cast<size_t>(socket) >= m_capacity)
+        {
+            return nullptr;
+        }
+        Connection& connection = Slot(socket);
+        connection.generation.fetch_add(1, std::memory_order_relaxed);
+        connection.is_command_cancelled.store(false, std::memory_order_relaxed);
+        connection.is_open.store(true, std::memory_order_release);
+        m_open_count.fetch_add(1, std::memory_order_relaxed);
+        return &connection;
+    }
+
+    Connection* Find(int socket, uint32_t generation) const
+    {
+        Connection* connection = Find(socket);
+        return connection != nullptr && connection->IsCurrent(generation) ? connection : nullptr;
+    }
+
+    Connection* Find(int socket) const
+    {
+        if (socket < 0 || static_cast<size_t>(socket) >= m_capacity)
+        {
+            return nullptr;
+        }
+        Chunk* chunk = m_chunks[socket / m_chunk_size].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+        {
+            return nullptr;
+        }
+        Connection& connection = chunk->slots[socket % m_chunk_size];
+        return connection.is_open.load(std::memory_order_acquire) ? &connection : nullptr;
+    }
+
+    // Ends the given generation and drops its buffered data; false if it was already closed. The caller closes
+    // the descriptor afterwards and must not hold the connection mutexes.
+    bool Close(Connection& connection, uint32_t generation)
+    {
+        std::scoped_lock lock(connection.read_mutex, connection.write_mutex);
+        if (!connection.IsCurrent(generation))
+        {
+            return false;
+        }
+        connection.is_open.store(false, std::memory_order_release);
+        connection.is_read_paused.store(false, std::memory_order_relaxed);
+        connection.is_command_running.store(false, std::memory_order_relaxed);
+        connection.is_write_armed = false;
+        connection.read_buffer.Clear();
+        connection.output.Clear();
+        m_open_count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Not thread safe, for shutdown once the reactors are stopped.
+    template<class F>
+    void ForEachOpen(F&& callback)
+    {
+        for (size_t i = 0; i < m_chunks_count; ++i)
+        {
+            Chunk* chunk = m_chunks[i].load(std::memory_order_acquire);
+            for (size_t j = 0; chunk != nullptr && j < m_chunk_size; ++j)
+            {
+                if (chunk->slots[j].is_open.load(std::memory_order_relaxed))
+                {
+                    callback(chunk->slots[j]);
+                }
+            }
+        }
+    }
+
+    size_t Size() const
+    {
+        return m_open_count.load(std::memory_order_relaxed);
+    }
+private:
+    static constexpr size_t m_chunk_size {1024};
+
+    struct Chunk
+    {
+        Chunk(BufferPool& pool, int first_socket) : slots(static_cast<Connection*>(::operator new(sizeof(Connection) * m_chunk_size,
+            std::align_val_t(alignof(Connection)))))
+        {
+            for (size_t i = 0; i < m_chunk_size; ++i)
+            {
+                new (&slots[i]) Connection(first_socket + static_cast<int>(i), pool);
+            }
+        }
+
+        ~Chunk()
+        {
+            for (size_t i = 0; i < m_chunk_size; ++i)
+            {
+                slots[i].~Connection();
+            }
+            ::operator delete(slots, std::align_val_t(alignof(Connection)));
+        }
+
+        Connection* const slots;
+    };
+
+    Connection& Slot(int socket)
+    {
+        std::atomic<Chunk*>& entry = m_chunks[socket / m_chunk_size];
+        Chunk* chunk = entry.load(std::memory_order_acquire);
+        if (chunk == nullptr)
+        {
+            // shards accept concurrently, the loser of the race frees its chunk
+            auto new_chunk = std::make_unique<Chunk>(m_pool, socket - socket % m_chunk_size);
+            if (entry.compare_exchange_strong(chunk, new_chunk.get(), std::memory_order_acq_rel))
+            {
+                chunk = new_chunk.release();
+            }
+        }
+        return chunk->slots[socket % m_chunk_size];
+    }
+
+    BufferPool& m_pool;
+    const size_t m_capacity;
+    const size_t m_chunks_count;
+    std::unique_ptr<std::atomic<Chunk*>[]> m_chunks;
+    std::atomic<size_t> m_open_count;
+};
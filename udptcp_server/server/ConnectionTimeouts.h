@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "Connection.h"
+#include "ServerConfig.h"
+#include "TimerWheel.h"
+
+// Idle, read and write timeouts of the connections of one reactor. The I/O paths only store coarse
+// timestamps in the connection; its timer runs a check when the earliest deadline may have passed, which
+// either finds the connection expired or moves the timer to the next deadline. A busy connection costs one
+// check per timeout period and its transfers take the wheel lock only when a partial frame or blocked
+// output starts.
+class ConnectionTimeouts {
+public:
+    enum class Reason
+    {
+        None,
+        Idle,
+        Read,
+        Write
+    };
+
+    // Runs on the reactor thread with the socket and generation of the connection to check.
+    using CheckHandler = std::function<void(int, uint32_t)>;
+
+    ConnectionTimeouts(TimerWheel& wheel, const ServerConfig& config, CheckHandler&& on_check) : m_wheel(wheel),
+        m_on_check(std::move(on_check))
+    {
+        Configure(config);
+    }
+
+    // New values apply to the next check of every connection; a connection opened while the idle timeout
+    // was disabled is only checked once it has a partial frame or blocked output.
+    void Configure(const ServerConfig& config)
+    {
+        m_idle_ms.store(config.idle_timeout_ms, std::memory_order_relaxed);
+        m_read_ms.store(config.read_timeout_ms, std::memory_order_relaxed);
+        m_write_ms.store(config.write_timeout_ms, std::memory_order_relaxed);
+    }
+
+    static const char* Name(Reason reason)
+    {
+        switch (reason)
+        {
+        case Reason::Idle:
+            return "idle";
+        case Reason::Read:
+            return "read";
+        case Reason::Write:
+            return "write";
+        default:
+            return "no";
+        }
+    }
+
+    void Open(Connection& connection)
+    {
+        uint64_t now = m_wheel.Now();
+        connection.last_activity_ms.store(now, std::memory_order_relaxed);
+        connection.read_pending_since_ms.store(0, std::memory_order_relaxed);
+        connection.write_blocked_since_ms.store(0, std::memory_order_relaxed);
+        unsigned int idle_ms = m_idle_ms.load(std::memory_order_relaxed);
+        std::unique_lock lock(m_mutex);
+        if (idle_ms > 0)
+        {
+            m_wheel.Schedule(connection.timer, now + idle_ms, MakeCheck(connection.socket, connection.generation.load()));
+        }
+        else
+        {
+            m_wheel.Cancel(connection.timer);
+        }
+    }
+
+    // Before the descriptor is closed: another reactor may open the slot right after.
+    void Close(Connection& connection)
+    {
+        std::unique_lock lock(m_mutex);
+        m_wheel.Cancel(connection.timer);
+    }
+
+    // After the handler consumed a read: has_progress if it took whole frames, is_pending if a partial frame
+    // waits for more bytes from the peer, which is not the case while reads are paused. Caller holds the
+    // connection read_mutex.
+    void OnRead(Connection& connection, bool has_progress, bool is_pending)
+    {
+        uint64_t now = m_wheel.Now();
+        connection.last_activity_ms.store(now, std::memory_order_relaxed);
+        Track(connection, connection.read_pending_since_ms, m_read_ms.load(std::memory_order_relaxed), now, has_progress, is_pending);
+    }
+
+    // After a send of written bytes, is_pending if output is left. Caller holds the connection write_mutex.
+    void OnWrite(Connection& connection, size_t written, bool is_pending)
+    {
+        uint64_t now = m_wheel.Now();
+        if (written > 0)
+        {
+            connection.last_activity_ms.store(now, std::memory_order_relaxed);
+        }
+        Track(connection, connection.write_blocked_since_ms, m_write_ms.load(std::memory_order_relaxed), now, written > 0, is_pending);
+    }
+
+    // Returns why the connection expired, or schedules its next check and returns Reason::None.
+    Reason Check(Connection& connection, uint32_t generation)
+    {
+        uint64_t now = m_wheel.Now();
+        uint64_t next = UINT64_MAX;
+        Reason reason = Reason::None;
+        auto deadline = [&](const std::atomic<uint64_t>& since, unsigned int timeout_ms, Reason candidate) {
+            uint64_t start = since.load(std::memory_order_relaxed);
+            if (timeout_ms == 0 || start == 0 || reason != Reason::None)
+            {
+                return;
+            }
+            if (start + timeout_ms <= now)
+            {
+                reason = candidate;
+            }
+            next = std::min(next, start + timeout_ms);
+        };
+        // while reads are paused for backpressure the partial frame waits for the server, not the peer
+        if (!connection.is_read_paused.load(std::memory_order_relaxed))
+        {
+            deadline(connection.read_pending_since_ms, m_read_ms.load(std::memory_order_relaxed), Reason::Read);
+        }
+        deadline(connection.write_blocked_since_ms, m_write_ms.load(std::memory_order_relaxed), Reason::Write);
+        deadline(connection.last_activity_ms, m_idle_ms.load(std::memory_order_relaxed), Reason::Idle);
+        if (reason != Reason::None || next == UINT64_MAX)
+        {
+            return reason;
+        }
+        // a check of a connection that was closed meanwhile must not take the timer of the next one
+        std::unique_lock lock(m_mutex);
+        if (connection.IsCurrent(generation))
+        {
+            m_wheel.ScheduleBefore(connection.timer, next, MakeCheck(connection.socket, generation));
+        }
+        return reason;
+    }
+private:
+    Task MakeCheck(int socket, uint32_t generation)
+    {
+        return Task([this, socket, generation] { m_on_check(socket, generation); });
+    }
+
+    // since is the start of the state or its last progress. Only the start may need a check earlier than the
+    // scheduled one, progress just lets the next check find a later deadline.
+    void Track(Connection& connection, std::atomic<uint64_t>& since, unsigned int timeout_ms, uint64_t now, bool has_progress,
+        bool is_pending)
+    {
+        if (!is_pending)
+        {
+            since.store(0, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t previous = since.load(std::memory_order_relaxed);
+        if (previous != 0 && !has_progress)
+        {
+            return;
+        }
+        since.store(now, std::memory_order_relaxed);
+        if (previous == 0 && timeout_ms > 0)
+        {
+            m_wheel.ScheduleBefore(connection.timer, now + timeout_ms, MakeCheck(connection.socket, connection.generation.load()));
+        }
+    }
+
+    TimerWheel& m_wheel;
+    std::atomic<unsigned int> m_idle_ms {0};
+    std::atomic<unsigned int> m_read_ms {0};
+    std::atomic<unsigned int> m_write_ms {0};
+    CheckHandler m_on_check;
+    // orders Open, Close and the rescheduling in Check, see there
+    std::mutex m_mutex;
+};
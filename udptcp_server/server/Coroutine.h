@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include "SlabAllocator.h"
+
+template<class T = void>
+class AsyncTask;
+
+namespace CoroutineDetail
+{
+// Frames come from the SlabAllocator: starting a coroutine on the request path pops a block off the thread
+// cache instead of calling malloc.
+class PromiseBase {
+public:
+    static void* operator new(size_t size)
+    {
+        return SlabAllocator::Allocate(size);
+    }
+
+    static void operator delete(void* frame) noexcept
+    {
+        SlabAllocator::Free(frame);
+    }
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template<class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            PromiseBase& promise = handle.promise();
+            if (promise.m_continuation)
+            {
+                return promise.m_continuation;
+            }
+            if (promise.m_state.fetch_or(finished, std::memory_order_acq_rel) & detached)
+            {
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        m_exception = std::current_exception();
+    }
+protected:
+    template<class>
+    friend class ::AsyncTask;
+
+    static constexpr uint8_t finished {1};
+    static constexpr uint8_t detached {2};
+
+    void Rethrow()
+    {
+        if (m_exception)
+        {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+    std::coroutine_handle<> m_continuation;
+    std::exception_ptr m_exception;
+    // finished and detached bits, whichever of Start and the final suspend sets the second one owns the frame
+    std::atomic<uint8_t> m_state {0};
+};
+
+template<class T>
+class Promise : public PromiseBase {
+public:
+    AsyncTask<T> get_return_object() noexcept;
+
+    template<class U>
+    void return_value(U&& value)
+    {
+        m_value.emplace(std::forward<U>(value));
+    }
+
+    T Result()
+    {
+        Rethrow();
+        return std::move(*m_value);
+    }
+private:
+    std::optional<T> m_value;
+};
+
+template<>
+class Promise<void> : public PromiseBase {
+public:
+    AsyncTask<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void Result()
+    {
+        Rethrow();
+    }
+};
+} // namespace CoroutineDetail
+
+// Lazily started coroutine that produces a T. co_await task runs it and resumes the awaiting coroutine with
+// its value, or its exception, once it completes. Start runs it from plain code: the caller keeps a task that
+// completed without suspending, one that suspended frees itself when it completes and its exception is lost.
+template<class T>
+class AsyncTask {
+public:
+    using promise_type = CoroutineDetail::Promise<T>;
+
+    AsyncTask() noexcept = default;
+
+    explicit AsyncTask(std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {}
+
+    AsyncTask(AsyncTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    AsyncTask& operator=(AsyncTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    AsyncTask(const AsyncTask&) = delete;
+    AsyncTask& operator=(const AsyncTask&) = delete;
+
+    ~AsyncTask()
+    {
+        Reset();
+    }
+
+    // Runs the task until it completes or first suspends, true when it completed and Result is ready.
+    bool Start()
+    {
+        m_handle.resume();
+        // completed on this thread, the common case needs no read-modify-write
+        std::atomic<uint8_t>& state = m_handle.promise().m_state;
+        if ((state.load(std::memory_order_acquire) & promise_type::finished) ||
+            (state.fetch_or(promise_type::detached, std::memory_order_acq_rel) & promise_type::finished))
+        {
+            return true;
+        }
+        m_handle = nullptr;
+        return false;
+    }
+
+    // The value of a task Start completed, rethrows its exception.
+    T Result()
+    {
+        return m_handle.promise().Result();
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle.promise().m_continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume()
+            {
+                return handle.promise().Result();
+            }
+
+            std::coroutine_handle<promise_type> handle;
+        };
+        return Awaiter {m_handle};
+    }
+private:
+    void Reset() noexcept
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace CoroutineDetail
+{
+template<class T>
+AsyncTask<T> Promise<T>::get_return_object() noexcept
+{
+    return AsyncTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline AsyncTask<void> Promise<void>::get_return_object() noexcept
+{
+    return AsyncTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+} // namespace CoroutineDetail
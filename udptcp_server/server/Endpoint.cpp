@@ -0,0 +1,203 @@
+#include "Endpoint.h"
+
+#include <arpa/inet.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <charconv>
+#include <utility>
+
+namespace
+{
+constexpr std::pair<std::string_view, EndpointKind> schemes[] {
+    {"tcp", EndpointKind::Tcp}, {"udp", EndpointKind::Udp},
+    {"unix", EndpointKind::UnixStream}, {"unixgram", EndpointKind::UnixDatagram}};
+
+template<class Number>
+bool ParseNumber(std::string_view text, Number& number, int base = 10)
+{
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number, base);
+    return !text.empty() && error == std::errc() && end == text.data() + text.size();
+}
+
+bool ParseFlag(std::string_view text, bool& flag)
+{
+    if (text != "0" && text != "1")
+    {
+        return false;
+    }
+    flag = text == "1";
+    return true;
+}
+
+bool ParseAddress(std::string_view address, Endpoint& endpoint)
+{
+    std::string_view port;
+    if (address.starts_with('['))
+    {
+        size_t close = address.find(']');
+        if (close == std::string_view::npos)
+        {
+            return false;
+        }
+        endpoint.host = address.substr(1, close - 1);
+        port = address.substr(close + 1);
+    }
+    else
+    {
+        size_t colon = address.find(':');
+        endpoint.host = address.substr(0, colon);
+        port = colon == std::string_view::npos ? std::string_view() : address.substr(colon);
+    }
+    if (endpoint.host == "*")
+    {
+        endpoint.host = "::";
+    }
+    if (!port.empty() && (!port.starts_with(':') || !ParseNumber(port.substr(1), endpoint.port) || endpoint.port < 1 || endpoint.port > 65535))
+    {
+        return false;
+    }
+    unsigned char bytes[sizeof(in6_addr)];
+    return inet_pton(endpoint.IsIPv6() ? AF_INET6 : AF_INET, endpoint.host.c_str(), bytes) == 1;
+}
+
+bool ParseOption(std::string_view name, std::string_view value, Endpoint& endpoint)
+{
+    bool is_ip = !endpoint.IsUnix();
+    if (name == "rcvbuf")
+    {
+        return ParseNumber(value, endpoint.receive_buffer) && endpoint.receive_buffer > 0;
+    }
+    if (name == "sndbuf")
+    {
+        return ParseNumber(value, endpoint.send_buffer) && endpoint.send_buffer > 0;
+    }
+    if (name == "busy_poll")
+    {
+        return ParseNumber(value, endpoint.busy_poll_us) && endpoint.busy_poll_us >= 0;
+    }
+    if (name == "tos")
+    {
+        return is_ip && ParseNumber(value, endpoint.tos) && endpoint.tos >= 0 && endpoint.tos <= 255;
+    }
+    if (name == "nodelay")
+    {
+        return endpoint.kind == EndpointKind::Tcp && ParseFlag(value, endpoint.is_nodelay);
+    }
+    if (name == "v6only")
+    {
+        return is_ip && endpoint.IsIPv6() && ParseFlag(value, endpoint.is_v6only);
+    }
+    if (name == "mode")
+    {
+        // abstract names have no file to chmod
+        return endpoint.IsUnix() && !endpoint.path.starts_with('@') && ParseNumber(value, endpoint.mode, 8) && endpoint.mode <= 07777;
+    }
+    return false;
+}
+} // namespace
+
+bool Endpoint::Parse(std::string_view text, Endpoint& endpoint)
+{
+    size_t separator = text.find("://");
+    if (separator == std::string_view::npos)
+    {
+        return false;
+    }
+    Endpoint result;
+    std::string_view scheme = text.substr(0, separator);
+    bool is_known = false;
+    for (const auto& [name, kind] : schemes)
+    {
+        if (scheme == name)
+        {
+            result.kind = kind;
+            is_known = true;
+        }
+    }
+    text.remove_prefix(separator + 3);
+    size_t question = text.find('?');
+    std::string_view address = text.substr(0, question);
+    std::string_view query = question == std::string_view::npos ? std::string_view() : text.substr(question + 1);
+    if (!is_known || address.empty())
+    {
+        return false;
+    }
+
+    if (result.IsUnix())
+    {
+        // sun_path keeps a terminating zero for paths, an abstract name uses it for the leading zero instead
+        if (address.size() >= sizeof(sockaddr_un::sun_path))
+        {
+            return false;
+        }
+        result.path = address;
+    }
+    else if (!ParseAddress(address, result))
+    {
+        return false;
+    }
+
+    while (!query.empty())
+    {
+        std::string_view option = query.substr(0, query.find('&'));
+        query.remove_prefix(std::min(query.size(), option.size() + 1));
+        size_t equals = option.find('=');
+        if (equals == std::string_view::npos || !ParseOption(option.substr(0, equals), option.substr(equals + 1), result))
+        {
+            return false;
+        }
+    }
+    endpoint = std::move(result);
+    return true;
+}
+
+bool Endpoint::ParseList(std::string_view text, std::vector<Endpoint>& endpoints)
+{
+    std::vector<Endpoint> result;
+    while (!text.empty())
+    {
+        size_t end = text.find_first_of(", \t");
+        std::string_view item = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (item.empty())
+        {
+            continue;
+        }
+        if (!Parse(item, result.emplace_back()))
+        {
+            return false;
+        }
+    }
+    if (result.empty())
+    {
+        return false;
+    }
+    endpoints = std::move(result);
+    return true;
+}
+
+std::string Endpoint::ToString(int default_port) const
+{
+    std::string text;
+    for (const auto& [name, scheme_kind] : schemes)
+    {
+        if (scheme_kind == kind)
+        {
+            text.append(name).append("://");
+        }
+    }
+    if (IsUnix())
+    {
+        return text.append(path);
+    }
+    if (IsIPv6())
+    {
+        text.append("[").append(host).append("]");
+    }
+    else
+    {
+        text.append(host);
+    }
+    return text.append(":").append(std::to_string(port == 0 ? default_port : port));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class EndpointKind
+{
+    Tcp,
+    Udp,
+    UnixStream,
+    UnixDatagram
+};
+
+// One address the server listens on, with the socket options of its sockets. Written as
+//   tcp://0.0.0.0:8087  udp://[::1]:9000  tcp://*  unix:///run/server.sock  unixgram://@server?rcvbuf=262144
+// IPv6 addresses accept IPv4 clients too unless v6only=1, "*" is short for [::]. A missing port is the server
+// port, "@" starts an abstract Unix name.
+// Options follow "?" joined by "&": rcvbuf, sndbuf, busy_poll (microseconds), tos, nodelay and v6only.
+// mode (octal permissions of the socket file) is for Unix paths only.
+struct Endpoint
+{
+    bool IsStream() const
+    {
+        return kind == EndpointKind::Tcp || kind == EndpointKind::UnixStream;
+    }
+
+    bool IsUnix() const
+    {
+        return kind == EndpointKind::UnixStream || kind == EndpointKind::UnixDatagram;
+    }
+
+    bool IsIPv6() const
+    {
+        return host.find(':') != std::string::npos;
+    }
+
+    // The spec form without the options, with the port filled in.
+    std::string ToString(int default_port) const;
+
+    // Endpoints separated by commas or spaces; endpoints is left unchanged when one is invalid.
+    static bool ParseList(std::string_view text, std::vector<Endpoint>& endpoints);
+    static bool Parse(std::string_view text, Endpoint& endpoint);
+
+    // Every IPv4 address on the port the server was started with, like "tcp://0.0.0.0".
+    static Endpoint AnyIPv4(EndpointKind kind)
+    {
+        Endpoint endpoint;
+        endpoint.kind = kind;
+        endpoint.host = "0.0.0.0";
+        return endpoint;
+    }
+
+    EndpointKind kind {EndpointKind::Tcp};
+    // IPv4 or IPv6 literal of an IP endpoint
+    std::string host;
+    // 0 takes the port the server was started with
+    int port {0};
+    // filesystem path or abstract name (leading '@') of a Unix endpoint
+    std::string path;
+    bool is_v6only {false};
+    // 0 keeps the kernel default
+    int receive_buffer {0};
+    int send_buffer {0};
+    int busy_poll_us {0};
+    // IP_TOS / IPV6_TCLASS, -1 keeps the default
+    int tos {-1};
+    bool is_nodelay {false};
+    // 0 keeps the permissions the umask gives
+    unsigned int mode {0};
+};
@@ -0,0 +1,1174 @@
+#include "EpollBackend.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+#include "AsyncIo.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+namespace
+{
+// Pipe of the calling thread for splicing echoed streams, it is empty again after every SpliceEcho.
+class SplicePipe {
+public:
+    ~SplicePipe()
+    {
+        Close();
+    }
+
+    // Discards whatever the pipe still holds, the next Open creates a new one.
+    void Close()
+    {
+        for (int& fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    bool Open(size_t capacity)
+    {
+        if (m_fds[0] >= 0)
+        {
+            return true;
+        }
+        if (pipe2(m_fds, O_NONBLOCK | O_CLOEXEC) < 0)
+        {
+            return false;
+        }
+        // a bigger pipe moves a whole message per splice, the kernel caps it at fs.pipe-max-size
+        int size = fcntl(m_fds[1], F_SETPIPE_SZ, static_cast<int>(std::min<size_t>(capacity, 1 << 20)));
+        m_capacity = size > 0 ? size : fcntl(m_fds[1], F_GETPIPE_SZ);
+        return m_capacity > 0;
+    }
+
+    int ReadEnd() const
+    {
+        return m_fds[0];
+    }
+
+    int WriteEnd() const
+    {
+        return m_fds[1];
+    }
+
+    size_t Capacity() const
+    {
+        return m_capacity;
+    }
+private:
+    int m_fds[2] {-1, -1};
+    int m_capacity {0};
+};
+
+thread_local SplicePipe t_splice_pipe;
+} // namespace
+
+EpollBackend::EpollBackend(Reactor& reactor, IoHandler& handler, Metrics& metrics, const ServerConfig& config, ThreadPoolQueue* task_queue) :
+    m_reactor(reactor), m_handler(handler), m_metrics(metrics), m_config(config), m_task_queue(task_queue), m_epoll_fd(-1), m_event_fd(-1), m_timer_fd(-1),
+    m_hangup_mask(EPOLLHUP | EPOLLRDHUP), m_client_events(EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP),
+    m_is_zerocopy_enabled(config.zerocopy_threshold > 0), m_is_splice_enabled(config.zerocopy_threshold > 0 && config.framing == FramingMode::Raw),
+    m_is_draining(false), m_is_listening(true),
+    m_timers(config.timer_tick_ms, TimerWheel::MonotonicMs()),
+    m_timeouts(m_timers, config, [this](int client_socket, uint32_t generation) { CheckTimeouts(client_socket, generation); }),
+    m_logger("Epoll") {}
+
+EpollBackend::~EpollBackend()
+{
+    Close();
+}
+
+void EpollBackend::Init()
+{
+    m_epoll_fd = epoll_create1(0);
+    if (m_epoll_fd < 0)
+    {
+        throw std::runtime_error("epoll creation error");
+    }
+
+    m_event_fd = eventfd(0, EFD_NONBLOCK);
+    if (m_event_fd < 0)
+    {
+        throw std::runtime_error("eventfd creation error");
+    }
+    AddSocketToEpoll(m_event_fd, EPOLLIN);
+    m_timer_fd = m_timers.OpenTickTimer();
+    AddSocketToEpoll(m_timer_fd, EPOLLIN);
+    for (const ListenerSet::Listener& listener : m_reactor.listeners.Streams())
+    {
+        if (listener.kind == EndpointKind::Tcp)
+        {
+            EnableZerocopy(listener.socket);
+        }
+        AddSocketToEpoll(listener.socket, EPOLLIN | EPOLLET);
+        m_accept_waiters.emplace_back();
+    }
+    const auto& datagrams = m_reactor.listeners.Datagrams();
+    m_udp_channels.reserve(datagrams.size());
+    for (const ListenerSet::Listener& listener : datagrams)
+    {
+        m_udp_channels.emplace_back(listener.socket, m_config);
+        // with a thread pool a datagram socket is re-armed after every drain so only one worker batches it at a time
+        AddSocketToEpoll(listener.socket, m_task_queue == nullptr ? EPOLLIN : EPOLLIN | EPOLLONESHOT);
+    }
+}
+
+void EpollBackend::Close()
+{
+    if (m_epoll_fd >= 0)
+    {
+        // the reactor and the pool are stopped: the connections left open close here and the commands they held
+        // run to their end on this thread
+        m_reactor.connections->ForEachOpen([this](Connection& connection) {
+            if (connection.reactor == m_reactor.id)
+            {
+                CloseSocket(connection.socket, connection.generation.load());
+            }
+        });
+        ResumeQueued();
+    }
+    // a loop still parked never runs again
+    for (AcceptWaiter& waiter : m_accept_waiters)
+    {
+        if (waiter.handle)
+        {
+            std::exchange(waiter.handle, nullptr).destroy();
+        }
+    }
+    for (int* fd : {&m_epoll_fd, &m_event_fd, &m_timer_fd})
+    {
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void EpollBackend::Wakeup()
+{
+    uint64_t value = 1;
+    write(m_event_fd, &value, sizeof(value));
+}
+
+TimerWheel& EpollBackend::Timers()
+{
+    return m_timers;
+}
+
+void EpollBackend::Reload(const ServerConfig& config)
+{
+    m_timeouts.Configure(config);
+}
+
+void EpollBackend::Drain()
+{
+    m_is_draining.store(true);
+    Wakeup();
+}
+
+// Errors are left to the next event of the socket: the caller may hold the read_mutex that closing takes.
+bool EpollBackend::Send(Connection& connection, uint32_t generation, OutputQueue& data)
+{
+    std::unique_lock write_lock(connection.write_mutex);
+    if (!connection.IsCurrent(generation))
+    {
+        return false;
+    }
+    connection.output.Append(std::move(data));
+    return connection.is_write_armed || FlushOutput(connection);
+}
+
+void EpollBackend::ResumeReading(Connection& connection, uint32_t generation)
+{
+    // edge triggered epoll will not report what arrived while the command ran
+    Schedule(connection.socket, generation, EPOLLIN);
+}
+
+// Accepts until the listener has no client left, then parks the loop; a listener event that comes while the
+// loop is not parked makes it try again.
+bool EpollBackend::WaitAccept(size_t listener, std::coroutine_handle<> handle, int& client)
+{
+    AcceptWaiter& waiter = m_accept_waiters[listener];
+    int listener_socket = m_reactor.listeners.Streams()[listener].socket;
+    while (IsAccepting())
+    {
+        client = accept4(listener_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client >= 0)
+        {
+            return false;
+        }
+        if (errno == EINTR || errno == ECONNABORTED)
+        {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG(m_logger, LogHelper::error, "Error while accepting new tcp client: " << strerror(errno));
+        }
+        std::unique_lock lock(waiter.mutex);
+        if (!std::exchange(waiter.is_ready, false))
+        {
+            waiter.handle = handle;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EpollBackend::WaitReadable(Connection& connection, uint32_t generation, size_t seen, std::coroutine_handle<> handle)
+{
+    {
+        std::unique_lock write_lock(connection.write_mutex);
+        if (!connection.IsCurrent(generation) || connection.is_command_cancelled.load())
+        {
+            return false;
+        }
+        connection.read_waiter = handle;
+        connection.read_waiter_seen = seen;
+    }
+    // edge triggered epoll will not report what arrived before, the connection task reads it, see ReadForCommand
+    Schedule(connection.socket, generation, EPOLLIN);
+    return true;
+}
+
+// EPOLLOUT is armed while the output holds more than the high watermark, HandleTCPClientWrite resumes the waiter.
+bool EpollBackend::WaitWritable(Connection& connection, uint32_t generation, std::coroutine_handle<> handle)
+{
+    std::unique_lock write_lock(connection.write_mutex);
+    if (!connection.IsCurrent(generation) || connection.output.Size() <= m_config.write_high_watermark)
+    {
+        return false;
+    }
+    connection.write_waiter = handle;
+    return true;
+}
+
+uint64_t EpollBackend::EventData(int socket, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(socket);
+}
+
+void EpollBackend::AddSocketToEpoll(int socket, uint32_t events, uint32_t generation)
+{
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = EventData(socket, generation);
+
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket, &event) == -1)
+    {
+        throw std::runtime_error("epoll_ctl add error");
+    }
+}
+
+void EpollBackend::ModifySocket(int socket, uint32_t events, uint32_t generation)
+{
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = EventData(socket, generation);
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, socket, &event);
+}
+
+template<class T>
+void EpollBackend::Dispatch(T&& task)
+{
+    if (m_task_queue == nullptr)
+    {
+        task();
+    }
+    else
+    {
+        m_task_queue->Push(std::forward<T>(task));
+    }
+}
+
+void EpollBackend::Run()
+{
+    for (size_t listener = 0; listener < m_accept_waiters.size(); ++listener)
+    {
+        AsyncTask<> accept = AcceptConnections(listener);
+        accept.Start();
+    }
+    std::vector<epoll_event> events(m_config.max_events);
+    while(m_handler.IsRunning())
+    {
+        if (m_is_listening && m_is_draining.load())
+        {
+            StopListening();
+        }
+        int num_events = epoll_wait(m_epoll_fd, events.data(), m_config.max_events, -1);
+        if (num_events == -1)
+        {
+            if (errno != EINTR)
+            {
+                LOG(m_logger, LogHelper::error, "Error while epoll wait");
+            }
+            continue;
+        }
+        m_metrics.Record(Distribution::ReactorBatch, num_events);
+
+        for (int i = 0; i < num_events; ++i)
+        {
+            if (!m_handler.IsRunning())
+            {
+                break;
+            }
+            int fd = static_cast<int>(events[i].data.u64 & 0xffffffff);
+            auto generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+            uint32_t event_flag = events[i].events;
+            if (event_flag & (m_hangup_mask))
+            {
+                if (!m_reactor.IsListener(fd) && fd != m_event_fd)
+                {
+                    Schedule(fd, generation, m_work_close);
+                    continue;
+                }
+            }
+
+            if (const ListenerSet::Listener* listener = m_reactor.listeners.FindStream(fd))
+            {
+                ResumeAccept(listener - m_reactor.listeners.Streams().data());
+            }
+            else if (int channel = m_reactor.listeners.FindDatagram(fd); channel >= 0)
+            {
+                Dispatch([this, channel] { HandleUDPData(m_udp_channels[channel]); });
+            }
+            else if (fd == m_event_fd)
+            {
+                uint64_t value;
+                // the rest of the batch is still served, edge triggered events are not reported again
+                read(m_event_fd, &value, sizeof(value));
+            }
+            else if (fd == m_timer_fd)
+            {
+                HandleTimer();
+            }
+            else
+            {
+                Schedule(fd, generation, event_flag & (EPOLLIN | EPOLLOUT | EPOLLERR));
+            }
+        }
+        ResumeQueued();
+    }
+}
+
+// Adds work for the connection task and dispatches one unless it is already scheduled. Work for an earlier
+// generation is dropped: the slot state carries the generation, so an event queued before a close cannot
+// reach the connection that reuses the descriptor.
+void EpollBackend::Schedule(int client_socket, uint32_t generation, uint32_t work)
+{
+    Connection* connection = m_reactor.connections->Find(client_socket);
+    if (connection == nullptr)
+    {
+        return;
+    }
+    std::atomic<uint64_t>& dispatch_state = connection->dispatch_state;
+    uint64_t state = dispatch_state.load(std::memory_order_relaxed);
+    do
+    {
+        if (state >> 32 != generation)
+        {
+            return;
+        }
+    } while (!dispatch_state.compare_exchange_weak(state, state | work | m_work_scheduled, std::memory_order_acq_rel,
+        std::memory_order_relaxed));
+    if (state & m_work_scheduled)
+    {
+        // the task takes the work before it goes idle, no second worker waits on the connection
+        return;
+    }
+    Dispatch([this, client_socket, generation] { HandleTCPClient(client_socket, generation); });
+}
+
+// Only this task reads, writes or closes a connection of the pool, one at a time, until no work is left.
+// After a close the slot is left alone: the next Open of the descriptor resets its state.
+void EpollBackend::HandleTCPClient(int client_socket, uint32_t generation)
+{
+    Connection* connection = m_reactor.connections->Find(client_socket, generation);
+    if (connection == nullptr)
+    {
+        return;
+    }
+    const uint64_t idle = static_cast<uint64_t>(generation) << 32;
+    while (true)
+    {
+        auto work = static_cast<uint32_t>(connection->dispatch_state.exchange(idle | m_work_scheduled, std::memory_order_acq_rel));
+        if (work & m_work_close || (work & m_work_drain && connection->IsQuiescent()))
+        {
+            CloseSocket(client_socket, generation);
+            return;
+        }
+        if (work & EPOLLERR)
+        {
+            HandleTCPClientError(client_socket, generation);
+        }
+        if (work & EPOLLOUT && connection->IsCurrent(generation))
+        {
+            HandleTCPClientWrite(client_socket, generation);
+        }
+        if (work & EPOLLIN && connection->IsCurrent(generation))
+        {
+            HandleTCPClientData(client_socket, generation);
+        }
+        uint64_t expected = idle | m_work_scheduled;
+        if (!connection->IsCurrent(generation) ||
+            connection->dispatch_state.compare_exchange_strong(expected, idle, std::memory_order_acq_rel))
+        {
+            return;
+        }
+    }
+}
+
+// Serves one listener until the reactor stops accepting. Clients come out non-blocking and inherit keepalive
+// and SO_ZEROCOPY from the listener, so a connection costs one accept4 and one epoll_ctl. With the thread pool
+// the loop runs on the worker its listener event went to.
+AsyncTask<> EpollBackend::AcceptConnections(size_t listener)
+{
+    // Unix sockets have no MSG_ZEROCOPY, a send would never report its completion
+    bool is_tcp = m_reactor.listeners.Streams()[listener].kind == EndpointKind::Tcp;
+    while (IsAccepting())
+    {
+        int client_socket = co_await AsyncAccept(*this, listener);
+        if (client_socket < 0)
+        {
+            continue;
+        }
+        Connection* connection = m_handler.OnAccept(m_reactor, client_socket);
+        if (connection == nullptr)
+        {
+            close(client_socket);
+            continue;
+        }
+        if (is_tcp && m_is_zerocopy_enabled.load(std::memory_order_relaxed))
+        {
+            connection->output.EnableZerocopy(m_config.zerocopy_threshold);
+        }
+        m_timeouts.Open(*connection);
+        connection->dispatch_state.store(static_cast<uint64_t>(connection->generation.load()) << 32, std::memory_order_release);
+        AddSocketToEpoll(client_socket, m_client_events, connection->generation.load());
+    }
+}
+
+bool EpollBackend::IsAccepting() const
+{
+    return m_handler.IsRunning() && !m_is_draining.load();
+}
+
+void EpollBackend::ResumeAccept(size_t listener)
+{
+    AcceptWaiter& waiter = m_accept_waiters[listener];
+    {
+        std::unique_lock lock(waiter.mutex);
+        if (!waiter.handle)
+        {
+            waiter.is_ready = true;
+            return;
+        }
+        if (std::exchange(waiter.is_resuming, true))
+        {
+            return;
+        }
+    }
+    Dispatch([&waiter] {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock lock(waiter.mutex);
+            handle = std::exchange(waiter.handle, nullptr);
+            waiter.is_resuming = false;
+        }
+        handle.resume();
+    });
+}
+
+void EpollBackend::EnableZerocopy(int tcp_socket)
+{
+    if (!m_is_zerocopy_enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    int enable = 1;
+    if (setsockopt(tcp_socket, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) < 0)
+    {
+        m_is_zerocopy_enabled.store(false);
+        LOG(m_logger, LogHelper::warning, "MSG_ZEROCOPY is unavailable, large responses are copied: " << strerror(errno));
+    }
+}
+
+void EpollBackend::HandleTCPClientData(int client_socket, uint32_t generation)
+{
+    if (!m_handler.IsRunning())
+    {
+        return;
+    }
+    Connection* connection = m_reactor.connections->Find(client_socket, generation);
+    if (connection == nullptr || connection->is_read_paused.load())
+    {
+        return;
+    }
+    if (connection->is_command_running.load())
+    {
+        ReadForCommand(*connection, generation);
+        return;
+    }
+
+    std::unique_lock read_lock(connection->read_mutex);
+    if (!connection->IsCurrent(generation) || connection->is_read_paused.load())
+    {
+        return;
+    }
+    if (connection->is_command_running.load())
+    {
+        read_lock.unlock();
+        ReadForCommand(*connection, generation);
+        return;
+    }
+    ReadBuffer& read_buffer = connection->read_buffer;
+    OutputQueue responses;
+    bool is_closed = false;
+    bool is_paused = false;
+    bool has_progress = false;
+    while (m_handler.IsRunning() && !is_paused)
+    {
+        // rate limited and shed messages must reach the handler, spliced bytes bypass it
+        if (m_is_splice_enabled.load(std::memory_order_relaxed) && read_buffer.Size() == 0 && connection->source == 0 &&
+            ThreadPoolQueue::ShedPolicy() == OverloadPolicy::Run)
+        {
+            SpliceStatus status = SpliceEcho(*connection);
+            if (status == SpliceStatus::Closed)
+            {
+                is_closed = true;
+                break;
+            }
+            if (status == SpliceStatus::Spliced)
+            {
+                has_progress = true;
+                continue;
+            }
+        }
+        size_t space = 0;
+        char* buffer = read_buffer.PrepareWrite(m_config.read_buffer_size, space);
+        ssize_t bytes_read = recv(client_socket, buffer, space, 0);
+        bool is_drained = false;
+        size_t buffered = read_buffer.Size();
+        if (bytes_read > 0)
+        {
+            read_buffer.Commit(bytes_read);
+            m_metrics.Add(Counter::TcpBytesIn, bytes_read);
+            buffered += bytes_read;
+            is_closed = !m_handler.OnTCPData(*connection, false, responses);
+        }
+        else if (bytes_read == 0)
+        {
+            is_closed = true;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            is_closed = !m_handler.OnTCPData(*connection, true, responses);
+            is_drained = true;
+        }
+        else
+        {
+            LOG(m_logger, LogHelper::error, "Reading error: " << strerror(errno) << " for client " << client_socket);
+            m_metrics.Add(Counter::TcpErrors);
+            is_closed = true;
+        }
+        has_progress = has_progress || read_buffer.Size() < buffered;
+
+        if (!responses.Empty())
+        {
+            std::unique_lock write_lock(connection->write_mutex);
+            connection->output.Append(std::move(responses));
+            if (connection->output.Size() > m_config.write_high_watermark && !is_closed)
+            {
+                is_closed = !FlushOutput(*connection);
+                if (!is_closed && connection->output.Size() > m_config.write_high_watermark)
+                {
+                    // the rest stays in the socket, HandleTCPClientWrite resumes reading below the low watermark
+                    LOG(m_logger, LogHelper::info, "Pausing reads from client " << client_socket << " with "
+                        << connection->output.Size() << " bytes queued");
+                    connection->is_read_paused.store(true);
+                    is_paused = true;
+                }
+            }
+        }
+        if (is_closed || is_drained || connection->is_command_running.load())
+        {
+            break;
+        }
+    }
+
+    if (!m_handler.IsRunning())
+    {
+        return;
+    }
+    if (!is_closed)
+    {
+        m_timeouts.OnRead(*connection, has_progress, read_buffer.Size() > 0 && !is_paused && !connection->is_command_running.load());
+    }
+
+    {
+        std::unique_lock write_lock(connection->write_mutex);
+        if (!connection->output.Empty() && !connection->is_write_armed && !FlushOutput(*connection))
+        {
+            is_closed = true;
+        }
+    }
+
+    if (is_closed)
+    {
+        read_lock.unlock();
+        CloseSocket(client_socket, generation);
+    }
+}
+
+void EpollBackend::HandleTCPClientWrite(int client_socket, uint32_t generation)
+{
+    if (!m_handler.IsRunning())
+    {
+        return;
+    }
+    Connection* connection = m_reactor.connections->Find(client_socket, generation);
+    if (connection == nullptr)
+    {
+        return;
+    }
+
+    bool is_resumed = false;
+    std::coroutine_handle<> waiter;
+    {
+        std::unique_lock write_lock(connection->write_mutex);
+        if (!connection->IsCurrent(generation))
+        {
+            return;
+        }
+        if (!FlushOutput(*connection))
+        {
+            write_lock.unlock();
+            CloseSocket(client_socket, generation);
+            return;
+        }
+        if (connection->output.Size() <= m_config.write_low_watermark)
+        {
+            waiter = std::exchange(connection->write_waiter, nullptr);
+            is_resumed = connection->is_read_paused.exchange(false);
+        }
+    }
+    if (waiter)
+    {
+        QueueResume(waiter);
+    }
+    if (is_resumed)
+    {
+        // edge triggered epoll will not report the bytes left in the socket while reads were paused
+        HandleTCPClientData(client_socket, generation);
+    }
+}
+
+// While a command holds the connection its requests wait in the socket, unless the command waits for them in
+// AsyncRead: then they are read into the buffer for it, up to max_message_size, and it resumes once there is
+// more than it has seen.
+void EpollBackend::ReadForCommand(Connection& connection, uint32_t generation)
+{
+    size_t seen = 0;
+    {
+        std::unique_lock write_lock(connection.write_mutex);
+        if (!connection.read_waiter)
+        {
+            return;
+        }
+        seen = connection.read_waiter_seen;
+    }
+    bool is_closed = false;
+    bool is_ready = false;
+    {
+        std::unique_lock read_lock(connection.read_mutex);
+        if (!connection.IsCurrent(generation))
+        {
+            return;
+        }
+        ReadBuffer& read_buffer = connection.read_buffer;
+        while (read_buffer.Size() <= seen || read_buffer.Size() < m_config.max_message_size)
+        {
+            size_t space = 0;
+            char* buffer = read_buffer.PrepareWrite(m_config.read_buffer_size, space);
+            ssize_t bytes_read = recv(connection.socket, buffer, space, 0);
+            if (bytes_read > 0)
+            {
+                read_buffer.Commit(bytes_read);
+                m_metrics.Add(Counter::TcpBytesIn, bytes_read);
+                continue;
+            }
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read == 0)
+            {
+                is_closed = true;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                LOG(m_logger, LogHelper::error, "Reading error: " << strerror(errno) << " for client " << connection.socket);
+                m_metrics.Add(Counter::TcpErrors);
+                is_closed = true;
+            }
+            break;
+        }
+        is_ready = read_buffer.Size() > seen;
+        m_timeouts.OnRead(connection, is_ready, false);
+    }
+    if (is_closed)
+    {
+        CloseSocket(connection.socket, generation);
+        return;
+    }
+    std::coroutine_handle<> waiter;
+    if (is_ready)
+    {
+        std::unique_lock write_lock(connection.write_mutex);
+        waiter = std::exchange(connection.read_waiter, nullptr);
+    }
+    if (waiter)
+    {
+        QueueResume(waiter);
+    }
+}
+
+// Zerocopy completions arrive on the error queue and report EPOLLERR, the connection only closes on a socket error.
+void EpollBackend::HandleTCPClientError(int client_socket, uint32_t generation)
+{
+    Connection* connection = m_reactor.connections->Find(client_socket, generation);
+    if (connection == nullptr)
+    {
+        return;
+    }
+    bool is_failed = false;
+    {
+        std::unique_lock write_lock(connection->write_mutex);
+        if (!connection->IsCurrent(generation))
+        {
+            return;
+        }
+        ReadZerocopyCompletions(*connection);
+        int error = 0;
+        socklen_t length = sizeof(error);
+        is_failed = getsockopt(client_socket, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0;
+    }
+    if (is_failed)
+    {
+        CloseSocket(client_socket, generation);
+    }
+}
+
+// Caller holds the connection write_mutex.
+void EpollBackend::ReadZerocopyCompletions(Connection& connection)
+{
+    char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+    while (true)
+    {
+        msghdr message {};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(connection.socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return;
+        }
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+        {
+            bool is_recverr = (header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) ||
+                (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR);
+            if (!is_recverr)
+            {
+                continue;
+            }
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+            if (error.ee_errno == 0 && error.ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+            {
+                // ee_info..ee_data is the range of completed sends
+                connection.output.CompleteZerocopy(error.ee_data, error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+            }
+        }
+    }
+}
+
+// Raw framing echoes input that does not start with a command socket to pipe to socket, the bytes never
+// reach user space. Caller holds read_mutex and the read buffer is empty.
+EpollBackend::SpliceStatus EpollBackend::SpliceEcho(Connection& connection)
+{
+    int available = 0;
+    if (ioctl(connection.socket, FIONREAD, &available) < 0 || static_cast<size_t>(available) < m_config.zerocopy_threshold)
+    {
+        return SpliceStatus::Skipped;
+    }
+    char first = 0;
+    if (recv(connection.socket, &first, 1, MSG_PEEK) != 1 || !m_handler.IsEcho(std::string_view(&first, 1)))
+    {
+        return SpliceStatus::Skipped;
+    }
+    {
+        // replies queued before must leave first
+        std::unique_lock write_lock(connection.write_mutex);
+        if (!connection.output.Empty())
+        {
+            return SpliceStatus::Skipped;
+        }
+    }
+    SplicePipe& pipe = t_splice_pipe;
+    if (!pipe.Open(m_config.max_message_size))
+    {
+        if (m_is_splice_enabled.exchange(false))
+        {
+            LOG(m_logger, LogHelper::warning, "Cannot create a splice pipe, echoing through user space: " << strerror(errno));
+        }
+        return SpliceStatus::Skipped;
+    }
+    size_t size = std::min({static_cast<size_t>(available), m_config.max_message_size, pipe.Capacity()});
+    ssize_t spliced = splice(connection.socket, nullptr, pipe.WriteEnd(), nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (spliced <= 0)
+    {
+        if (spliced < 0 && errno != EAGAIN && errno != EINTR && m_is_splice_enabled.exchange(false))
+        {
+            LOG(m_logger, LogHelper::warning, "splice is unavailable, echoing through user space: " << strerror(errno));
+        }
+        return SpliceStatus::Skipped;
+    }
+    m_metrics.Add(Counter::TcpBytesIn, spliced);
+    m_metrics.Add(Counter::TcpMessages);
+
+    size_t sent = 0;
+    bool is_failed = false;
+    while (sent < static_cast<size_t>(spliced))
+    {
+        ssize_t written = splice(pipe.ReadEnd(), nullptr, connection.socket, nullptr, spliced - sent, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (written > 0)
+        {
+            sent += written;
+            continue;
+        }
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        is_failed = written < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+        break;
+    }
+    m_metrics.Add(Counter::TcpBytesOut, sent);
+    if (sent == static_cast<size_t>(spliced))
+    {
+        return SpliceStatus::Spliced;
+    }
+
+    // the socket is full, the rest leaves the shared pipe through the output queue
+    std::string rest(spliced - sent, '\0');
+    size_t drained = 0;
+    while (drained < rest.size())
+    {
+        ssize_t bytes_read = read(pipe.ReadEnd(), rest.data() + drained, rest.size() - drained);
+        if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+        drained += bytes_read;
+    }
+    if (drained < rest.size())
+    {
+        // the reply would miss bytes, and the ones left in the pipe would lead the next echo of this thread
+        LOG(m_logger, LogHelper::error, "Error while draining the splice pipe for TCP client " << connection.socket << ": "
+            << strerror(errno));
+        pipe.Close();
+        is_failed = true;
+        rest.resize(drained);
+    }
+    else if (is_failed)
+    {
+        LOG(m_logger, LogHelper::error, "Error while splicing to TCP client " << connection.socket << ": " << strerror(errno));
+    }
+    if (is_failed)
+    {
+        m_metrics.Add(Counter::TcpErrors);
+        return SpliceStatus::Closed;
+    }
+    std::unique_lock write_lock(connection.write_mutex);
+    connection.output.Push(std::move(rest));
+    return SpliceStatus::Spliced;
+}
+
+// Caller holds the connection write_mutex. EPOLLOUT stays armed only while output is blocked.
+bool EpollBackend::FlushOutput(Connection& connection)
+{
+    size_t written = 0;
+    OutputQueue::Status status = connection.output.Flush(connection.socket, written);
+    m_metrics.Add(Counter::TcpBytesOut, written);
+    if (status == OutputQueue::Status::Error)
+    {
+        m_metrics.Add(Counter::TcpErrors);
+        LOG(m_logger, LogHelper::error, "Error while sending " << connection.output.Size() << " bytes to TCP client "
+            << connection.socket << ": " << strerror(errno));
+        return false;
+    }
+    m_timeouts.OnWrite(connection, written, !connection.output.Empty());
+    bool is_blocked = status == OutputQueue::Status::Blocked;
+    if (is_blocked != connection.is_write_armed)
+    {
+        connection.is_write_armed = is_blocked;
+        ModifySocket(connection.socket, is_blocked ? m_client_events | EPOLLOUT : m_client_events, connection.generation.load());
+    }
+    return true;
+}
+
+void EpollBackend::CloseSocket(int client_socket, uint32_t generation)
+{
+    Connection* connection = m_reactor.connections->Find(client_socket);
+    if (connection == nullptr || !m_handler.OnClose(m_reactor, *connection, generation))
+    {
+        return;
+    }
+    m_timeouts.Close(*connection);
+    ReleaseWaiters(*connection, true);
+    // deregister before the descriptor is released: once closed, accept may hand the number to a new client
+    // whose fresh registration a late EPOLL_CTL_DEL would remove
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, client_socket, nullptr);
+    close(client_socket);
+}
+
+void EpollBackend::ReleaseWaiters(Connection& connection, bool is_closing)
+{
+    for (std::coroutine_handle<> waiter : connection.CancelCommand(is_closing))
+    {
+        if (waiter)
+        {
+            QueueResume(waiter);
+        }
+    }
+}
+
+// Coroutines run on the reactor thread like the timers that resume them, never on a worker that may still hold
+// the connection they wait on.
+void EpollBackend::QueueResume(std::coroutine_handle<> handle)
+{
+    {
+        std::unique_lock lock(m_resume_mutex);
+        m_resume_queue.push_back(handle);
+    }
+    if (m_task_queue != nullptr)
+    {
+        Wakeup();
+    }
+}
+
+void EpollBackend::ResumeQueued()
+{
+    while (true)
+    {
+        {
+            std::unique_lock lock(m_resume_mutex);
+            if (m_resume_queue.empty())
+            {
+                return;
+            }
+            m_resuming.swap(m_resume_queue);
+        }
+        for (std::coroutine_handle<> handle : m_resuming)
+        {
+            handle.resume();
+        }
+        m_resuming.clear();
+    }
+}
+
+void EpollBackend::HandleTimer()
+{
+    uint64_t expirations = 0;
+    read(m_timer_fd, &expirations, sizeof(expirations));
+    m_timers.Advance(TimerWheel::MonotonicMs());
+    if (!m_is_listening)
+    {
+        CloseQuiescent();
+    }
+}
+
+void EpollBackend::StopListening()
+{
+    m_is_listening = false;
+    for (const auto* listeners : {&m_reactor.listeners.Streams(), &m_reactor.listeners.Datagrams()})
+    {
+        for (const ListenerSet::Listener& listener : *listeners)
+        {
+            epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, listener.socket, nullptr);
+        }
+    }
+    // the accept loops end once resumed
+    for (size_t listener = 0; listener < m_accept_waiters.size(); ++listener)
+    {
+        ResumeAccept(listener);
+    }
+    // suspended commands end so their connections can go quiet, the output they left is still sent
+    m_reactor.connections->ForEachOpen([this](Connection& connection) {
+        if (connection.reactor == m_reactor.id)
+        {
+            ReleaseWaiters(connection, false);
+        }
+    });
+    CloseQuiescent();
+}
+
+// Closes through the connection task like a timeout, which checks again since a request may arrive meanwhile.
+void EpollBackend::CloseQuiescent()
+{
+    m_reactor.connections->ForEachOpen([this](Connection& connection) {
+        uint32_t generation = connection.generation.load();
+        if (connection.reactor == m_reactor.id && connection.IsCurrent(generation) && connection.IsQuiescent())
+        {
+            Schedule(connection.socket, generation, m_work_drain);
+        }
+    });
+}
+
+// Runs on the reactor thread; the close goes to the connection task since a worker may hold the connection.
+void EpollBackend::CheckTimeouts(int client_socket, uint32_t generation)
+{
+    Connection* connection = m_reactor.connections->Find(client_socket, generation);
+    if (connection == nullptr)
+    {
+        return;
+    }
+    ConnectionTimeouts::Reason reason = m_timeouts.Check(*connection, generation);
+    if (reason == ConnectionTimeouts::Reason::None)
+    {
+        return;
+    }
+    LOG(m_logger, LogHelper::info, "Closing client " << client_socket << " after the " << ConnectionTimeouts::Name(reason) << " timeout");
+    m_metrics.Add(Counter::TcpTimeouts);
+    Schedule(client_socket, generation, m_work_close);
+}
+
+void EpollBackend::HandleUDPData(UdpChannel& channel)
+{
+    UdpBatch& batch = channel.batch;
+    bool is_blocked = !FlushUDPReplies(channel);
+    for (unsigned int round = 0; round < m_udp_max_rounds && !is_blocked && m_handler.IsRunning(); ++round)
+    {
+        batch.PrepareReceive();
+        int messages_count = recvmmsg(channel.socket, batch.recv_messages.data(), batch.batch_size, MSG_DONTWAIT, nullptr);
+        if (messages_count < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG(m_logger, LogHelper::error, "UDP recvmmsg error: " << strerror(errno));
+                m_metrics.Add(Counter::UdpErrors);
+            }
+            break;
+        }
+
+        unsigned int replies_count = 0;
+        for (int i = 0; i < messages_count; ++i)
+        {
+            if (batch.recv_messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                LOG(m_logger, LogHelper::warning, "UDP datagram truncated to " << batch.datagram_size << " bytes");
+                m_metrics.Add(Counter::UdpErrors);
+            }
+            std::string_view message = batch.Datagram(i);
+            m_metrics.Add(Counter::UdpBytesIn, message.size());
+            if (message.empty())
+            {
+                continue;
+            }
+            std::string& response = batch.responses[replies_count];
+            response.clear();
+            m_handler.OnUDPData(batch.addresses[i], message, response);
+            if (response.empty() || !batch.CanReply(i))
+            {
+                continue;
+            }
+            batch.PrepareSend(replies_count, i);
+            ++replies_count;
+        }
+
+        channel.pending_begin = 0;
+        channel.pending_end = replies_count;
+        is_blocked = !FlushUDPReplies(channel);
+
+        if (static_cast<unsigned int>(messages_count) < batch.batch_size)
+        {
+            break;
+        }
+    }
+
+    if (m_handler.IsRunning())
+    {
+        // a full socket buffer parks receiving until EPOLLOUT, the replies still reference the batch
+        ArmUDPSocket(channel, is_blocked ? EPOLLOUT : EPOLLIN);
+    }
+}
+
+bool EpollBackend::FlushUDPReplies(UdpChannel& channel)
+{
+    while (channel.pending_begin < channel.pending_end)
+    {
+        int result = sendmmsg(channel.socket, channel.batch.send_messages.data() + channel.pending_begin,
+            channel.pending_end - channel.pending_begin, MSG_DONTWAIT);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return false;
+            }
+            LOG(m_logger, LogHelper::error, "Error while sending " << channel.pending_end - channel.pending_begin << " UDP replies: " << strerror(errno));
+            m_metrics.Add(Counter::UdpErrors, channel.pending_end - channel.pending_begin);
+            channel.pending_begin = channel.pending_end;
+            break;
+        }
+        size_t sent_bytes = 0;
+        for (int i = 0; i < result; ++i)
+        {
+            sent_bytes += channel.batch.send_iovecs[channel.pending_begin + i].iov_len;
+        }
+        m_metrics.Add(Counter::UdpBytesOut, sent_bytes);
+        channel.pending_begin += result;
+    }
+    return true;
+}
+
+void EpollBackend::ArmUDPSocket(UdpChannel& channel, uint32_t events)
+{
+    // with a thread pool the socket is one-shot and must be re-armed after every drain
+    if (m_task_queue != nullptr)
+    {
+        events |= EPOLLONESHOT;
+    }
+    else if (events == channel.events)
+    {
+        return;
+    }
+    channel.events = events;
+    ModifySocket(channel.socket, events);
+}
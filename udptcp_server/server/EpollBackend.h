@@ -0,0 +1,139 @@
+#pragma once
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "ConnectionTimeouts.h"
+#include "Coroutine.h"
+#include "IoBackend.h"
+#include "Metrics.h"
+#include "Reactor.h"
+#include "ServerConfig.h"
+#include "ThreadPoolQueue.h"
+#include "UdpBatch.h"
+#include "../logging/Logging.h"
+
+// Readiness based backend: epoll reports ready sockets and the handlers run accept/recv/send either inline
+// (sharded mode) or on the shared thread pool. Events of a client connection are coalesced into one task at a
+// time, see Schedule. Every stream listener is served by an accept loop coroutine that its events resume.
+class EpollBackend : public IoBackend
+{
+public:
+    EpollBackend(Reactor& reactor, IoHandler& handler, Metrics& metrics, const ServerConfig& config, ThreadPoolQueue* task_queue);
+    ~EpollBackend() override;
+    void Init() override;
+    void Run() override;
+    void Wakeup() override;
+    void Close() override;
+    TimerWheel& Timers() override;
+    void Reload(const ServerConfig& config) override;
+    void Drain() override;
+    bool Send(Connection& connection, uint32_t generation, OutputQueue& data) override;
+    void ResumeReading(Connection& connection, uint32_t generation) override;
+    bool WaitAccept(size_t listener, std::coroutine_handle<> handle, int& client) override;
+    bool WaitReadable(Connection& connection, uint32_t generation, size_t seen, std::coroutine_handle<> handle) override;
+    bool WaitWritable(Connection& connection, uint32_t generation, std::coroutine_handle<> handle) override;
+private:
+    template<class T>
+    void Dispatch(T&& task);
+    // epoll data carries the descriptor and its connection generation, listeners use generation 0
+    static uint64_t EventData(int socket, uint32_t generation);
+    void AddSocketToEpoll(int socket, uint32_t events, uint32_t generation = 0);
+    void ModifySocket(int socket, uint32_t events, uint32_t generation = 0);
+    AsyncTask<> AcceptConnections(size_t listener);
+    bool IsAccepting() const;
+    // Resumes the accept loop of listener on the pool, or lets it accept again if it is running.
+    void ResumeAccept(size_t listener);
+    // work is a mask of EPOLLIN, EPOLLOUT, EPOLLERR and the m_work bits
+    void Schedule(int client_socket, uint32_t generation, uint32_t work);
+    void HandleTCPClient(int client_socket, uint32_t generation);
+    void HandleTCPClientData(int client_socket, uint32_t generation);
+    void HandleTCPClientWrite(int client_socket, uint32_t generation);
+    void HandleTCPClientError(int client_socket, uint32_t generation);
+    void ReadForCommand(Connection& connection, uint32_t generation);
+    void ReadZerocopyCompletions(Connection& connection);
+    void EnableZerocopy(int tcp_socket);
+    enum class SpliceStatus
+    {
+        Skipped,
+        Spliced,
+        Closed
+    };
+    SpliceStatus SpliceEcho(Connection& connection);
+    bool FlushOutput(Connection& connection);
+    // The batch state of one datagram listener.
+    struct UdpChannel
+    {
+        UdpChannel(int socket, const ServerConfig& config) : socket(socket), batch(config.udp_batch_size, config.udp_datagram_size) {}
+
+        int socket;
+        UdpBatch batch;
+        // replies [begin, end) of the last batch still wait for room in the socket buffer
+        unsigned int pending_begin {0};
+        unsigned int pending_end {0};
+        uint32_t events {EPOLLIN};
+    };
+    void HandleUDPData(UdpChannel& channel);
+    bool FlushUDPReplies(UdpChannel& channel);
+    void ArmUDPSocket(UdpChannel& channel, uint32_t events);
+    void CloseSocket(int client_socket, uint32_t generation);
+    // Wakes the coroutines parked on the connection, which find it closed or their command cancelled, see
+    // Connection::CancelCommand.
+    void ReleaseWaiters(Connection& connection, bool is_closing);
+    // Resumes handle on the reactor thread after the current event batch. Any thread.
+    void QueueResume(std::coroutine_handle<> handle);
+    void ResumeQueued();
+    void HandleTimer();
+    // Reactor thread side of Drain: StopListening once, then CloseQuiescent at every tick.
+    void StopListening();
+    void CloseQuiescent();
+    void CheckTimeouts(int client_socket, uint32_t generation);
+
+    // work bits of Connection::dispatch_state beside the epoll events; epoll reports none of them
+    static constexpr uint32_t m_work_close {1u << 29};
+    // close once quiescent, for Drain
+    static constexpr uint32_t m_work_drain {1u << 30};
+    // a task is queued or running
+    static constexpr uint32_t m_work_scheduled {1u << 31};
+    // bounds how many recvmmsg batches one UDP task drains before yielding the worker
+    static constexpr unsigned int m_udp_max_rounds {16};
+    Reactor& m_reactor;
+    IoHandler& m_handler;
+    Metrics& m_metrics;
+    const ServerConfig& m_config;
+    ThreadPoolQueue* m_task_queue;
+    int m_epoll_fd;
+    int m_event_fd;
+    int m_timer_fd;
+    const uint32_t m_hangup_mask;
+    const uint32_t m_client_events;
+    // The accept loop of one stream listener while it waits for a client.
+    struct AcceptWaiter
+    {
+        std::mutex mutex;
+        std::coroutine_handle<> handle;
+        // the listener reported a client while the loop was not parked
+        bool is_ready {false};
+        // a pool task is about to resume handle, which stays parked until then so Close finds a dropped one
+        bool is_resuming {false};
+    };
+    // indexed like the stream listeners of the reactor
+    std::deque<AcceptWaiter> m_accept_waiters;
+    // indexed like the datagram listeners of the reactor
+    std::vector<UdpChannel> m_udp_channels;
+    std::mutex m_resume_mutex;
+    std::vector<std::coroutine_handle<>> m_resume_queue;
+    std::vector<std::coroutine_handle<>> m_resuming;
+    std::atomic<bool> m_is_zerocopy_enabled;
+    std::atomic<bool> m_is_splice_enabled;
+    std::atomic<bool> m_is_draining;
+    bool m_is_listening;
+    TimerWheel m_timers;
+    ConnectionTimeouts m_timeouts;
+    mutable LogHelper::Logger m_logger;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class FramingMode
+{
+    Raw,
+    Newline,
+    LengthPrefixed
+};
+
+enum class FrameStatus
+{
+    Complete,
+    Incomplete,
+    Oversized
+};
+
+namespace Framing
+{
+static constexpr size_t length_header_size {4};
+
+// Cuts the next frame off the front of data. consumed is the number of bytes including delimiters or headers.
+inline FrameStatus Next(FramingMode mode, std::string_view data, size_t max_size, std::string_view& frame, size_t& consumed)
+{
+    switch (mode)
+    {
+    case FramingMode::Raw:
+        if (data.empty())
+        {
+            return FrameStatus::Incomplete;
+        }
+        frame = data.substr(0, max_size);
+        consumed = frame.size();
+        return FrameStatus::Complete;
+    case FramingMode::Newline:
+    {
+        size_t pos = data.find('\n');
+        if (pos == std::string_view::npos)
+        {
+            return data.size() > max_size ? FrameStatus::Oversized : FrameStatus::Incomplete;
+        }
+        if (pos > max_size)
+        {
+            return FrameStatus::Oversized;
+        }
+        consumed = pos + 1;
+        frame = data.substr(0, pos);
+        if (frame.ends_with('\r'))
+        {
+            frame.remove_suffix(1);
+        }
+        return FrameStatus::Complete;
+    }
+    case FramingMode::LengthPrefixed:
+    {
+        if (data.size() < length_header_size)
+        {
+            return FrameStatus::Incomplete;
+        }
+        auto bytes = reinterpret_cast<const unsigned char*>(data.data());
+        size_t length = (size_t(bytes[0]) << 24) | (size_t(bytes[1]) << 16) | (size_t(bytes[2]) << 8) | size_t(bytes[3]);
+        if (length > max_size)
+        {
+            return FrameStatus::Oversized;
+        }
+        if (data.size() < length_header_size + length)
+        {
+            return FrameStatus::Incomplete;
+        }
+        consumed = length_header_size + length;
+        frame = data.substr(length_header_size, length);
+        return FrameStatus::Complete;
+    }
+    }
+    return FrameStatus::Incomplete;
+}
+
+// Starts a frame at the end of out and returns its start for EndFrame; the payload is appended in between.
+inline size_t BeginFrame(FramingMode mode, std::string& out)
+{
+    size_t start = out.size();
+    if (mode == FramingMode::LengthPrefixed)
+    {
+        out.append(length_header_size, '\0');
+    }
+    return start;
+}
+
+// Completes the frame, or removes it when no payload was appended.
+inline void EndFrame(FramingMode mode, std::string& out, size_t start)
+{
+    size_t header_size = mode == FramingMode::LengthPrefixed ? length_header_size : 0;
+    uint32_t length = out.size() - start - header_size;
+    if (length == 0)
+    {
+        out.resize(start);
+        return;
+    }
+    if (mode == FramingMode::LengthPrefixed)
+    {
+        out[start] = static_cast<char>(length >> 24);
+        out[start + 1] = static_cast<char>(length >> 16);
+        out[start + 2] = static_cast<char>(length >> 8);
+        out[start + 3] = static_cast<char>(length);
+    }
+    else if (mode == FramingMode::Newline)
+    {
+        out.push_back('\n');
+    }
+}
+
+// true if the reply to an echoed frame is the frame itself: consumed bytes are payload plus framing and
+// encoding the payload yields them again.
+inline bool IsVerbatim(FramingMode mode, std::string_view frame, size_t consumed)
+{
+    return mode != FramingMode::Newline || consumed == frame.size() + 1;
+}
+
+inline bool Parse(std::string_view name, FramingMode& mode)
+{
+    if (name == "raw")
+    {
+        mode = FramingMode::Raw;
+    }
+    else if (name == "newline")
+    {
+        mode = FramingMode::Newline;
+    }
+    else if (name == "length")
+    {
+        mode = FramingMode::LengthPrefixed;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+} // namespace Framing
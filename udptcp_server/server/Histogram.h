@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// Log-linear histogram of unsigned values: 0..7 get a bucket each, then every power of two is split into 8
+// equal buckets, so a bucket bound is within 12.5% of any value it holds. Record is two relaxed atomic adds
+// on the shard of the calling thread; readers sum the shards without a lock.
+class Histogram {
+public:
+    static constexpr unsigned int sub_bits {3};
+    static constexpr unsigned int sub_count {1u << sub_bits};
+    // values of 2^40 and more share the last bucket, which has no upper bound
+    static constexpr unsigned int max_bits {40};
+    static constexpr unsigned int buckets_count {(max_bits - sub_bits + 1) * sub_count};
+
+    struct Snapshot
+    {
+        uint64_t Count() const
+        {
+            uint64_t count = 0;
+            for (uint64_t bucket : buckets)
+            {
+                count += bucket;
+            }
+            return count;
+        }
+
+        std::array<uint64_t, buckets_count> buckets {};
+        uint64_t sum {0};
+    };
+
+    void Record(uint64_t value)
+    {
+        Shard& shard = m_shards[LocalShard()];
+        shard.buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    Snapshot Read() const
+    {
+        Snapshot snapshot;
+        for (const Shard& shard : m_shards)
+        {
+            for (unsigned int i = 0; i < buckets_count; ++i)
+            {
+                snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+            }
+            snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    static constexpr unsigned int BucketIndex(uint64_t value)
+    {
+        if (value < sub_count)
+        {
+            return static_cast<unsigned int>(value);
+        }
+        unsigned int exponent = 63 - std::countl_zero(value);
+        if (exponent >= max_bits)
+        {
+            return buckets_count - 1;
+        }
+        auto sub = static_cast<unsigned int>(value >> (exponent - sub_bits)) & (sub_count - 1);
+        return (exponent - sub_bits + 1) * sub_count + sub;
+    }
+
+    // Largest value of the bucket, inclusive.
+    static constexpr uint64_t UpperBound(unsigned int index)
+    {
+        if (index < sub_count)
+        {
+            return index;
+        }
+        unsigned int exponent = index / sub_count + sub_bits - 1;
+        uint64_t width = uint64_t {1} << (exponent - sub_bits);
+        return (sub_count + index % sub_count) * width + width - 1;
+    }
+private:
+    static constexpr unsigned int m_shards_count {4};
+
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<uint64_t>, buckets_count> buckets {};
+        std::atomic<uint64_t> sum {0};
+    };
+
+    static unsigned int LocalShard()
+    {
+        static std::atomic<unsigned int> next_shard {0};
+        static thread_local unsigned int shard = next_shard.fetch_add(1, std::memory_order_relaxed) % m_shards_count;
+        return shard;
+    }
+
+    std::array<Shard, m_shards_count> m_shards;
+};
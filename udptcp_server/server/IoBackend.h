@@ -0,0 +1,76 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <coroutine>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Connection.h"
+#include "TimerWheel.h"
+
+struct Reactor;
+struct ServerConfig;
+
+enum class IoBackendType
+{
+    Epoll,
+    IoUring
+};
+
+// Protocol side of the server that the I/O backends drive.
+class IoHandler
+{
+public:
+    virtual ~IoHandler() = default;
+    virtual bool IsRunning() const = 0;
+    // Registers the socket, nullptr rejects it and the backend closes the descriptor.
+    virtual Connection* OnAccept(Reactor& reactor, int client_socket) = 0;
+    // Consumes complete frames from the connection read buffer and appends the framed replies. false closes the connection.
+    virtual bool OnTCPData(Connection& connection, bool is_drained, OutputQueue& responses) = 0;
+    // true if the message is answered with itself, so a backend may echo raw input without parsing it.
+    virtual bool IsEcho(std::string_view message) const = 0;
+    // source is the sender of the datagram; an empty response sends no reply.
+    virtual void OnUDPData(const sockaddr_storage& source, std::string_view message, std::string& response) = 0;
+    // Ends the connection generation, returns false if it was already closed. The backend closes the descriptor.
+    virtual bool OnClose(Reactor& reactor, Connection& connection, uint32_t generation) = 0;
+};
+
+// Event loop of one reactor. Init and Close run on the owning thread, Run on the reactor thread, Wakeup on any thread.
+class IoBackend
+{
+public:
+    virtual ~IoBackend() = default;
+    virtual void Init() = 0;
+    virtual void Run() = 0;
+    virtual void Wakeup() = 0;
+    virtual void Close() = 0;
+    // Timers of the reactor; callbacks run on the reactor thread.
+    virtual TimerWheel& Timers() = 0;
+    // Applies the settings that may change while running, from any thread.
+    virtual void Reload(const ServerConfig& config) = 0;
+    // Stops accepting connections and receiving datagrams, then closes every connection once it is quiescent.
+    // Open connections are served meanwhile. Any thread.
+    virtual void Drain() = 0;
+    // Moves data to the output of the connection and starts sending it, for replies that leave outside
+    // OnTCPData such as the later parts of a streamed command reply. false once the connection is closed.
+    // Reactor thread, or within OnTCPData.
+    virtual bool Send(Connection& connection, uint32_t generation, OutputQueue& data) = 0;
+    // Answers the requests that waited in the read buffer while a command held the connection, then reads on.
+    // Reactor thread.
+    virtual void ResumeReading(Connection& connection, uint32_t generation) = 0;
+    // The coroutine layer, see AsyncIo.h. Each parks handle until a socket is ready and resumes it on the
+    // reactor thread after the call returned; false resumes it at once instead.
+    // Until stream listener index has a client, which goes to client; it stays -1 when the coroutine is woken
+    // without one or the reactor stops accepting. The thread of the accept loop.
+    virtual bool WaitAccept(size_t listener, std::coroutine_handle<> handle, int& client) = 0;
+    // Until the read buffer of the connection holds more than seen bytes, false once it is closed or its
+    // command cancelled, see Connection::CancelCommand. A command that waits keeps the connection, the bytes
+    // are left for it to take. Reactor thread, or within OnTCPData.
+    virtual bool WaitReadable(Connection& connection, uint32_t generation, size_t seen, std::coroutine_handle<> handle) = 0;
+    // Until the output of the connection drained to write_low_watermark, if it holds more than
+    // write_high_watermark. false if it does not, or once the connection is closed. Reactor thread, or within
+    // OnTCPData.
+    virtual bool WaitWritable(Connection& connection, uint32_t generation, std::coroutine_handle<> handle) = 0;
+};
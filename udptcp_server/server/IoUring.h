@@ -0,0 +1,366 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// Minimal io_uring ring over the raw syscalls: one submission queue, one completion queue and
+// optional provided buffer rings. Not thread safe, owned by a single reactor thread.
+class IoUring {
+public:
+    IoUring(unsigned int entries, unsigned int flags) : m_ring_fd(-1), m_sq_ring(MAP_FAILED), m_cq_ring(MAP_FAILED), m_sqes(MAP_FAILED)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = flags;
+        m_ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (m_ring_fd < 0 && flags != 0 && errno == EINVAL)
+        {
+            memset(&params, 0, sizeof(params));
+            m_ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+        }
+        if (m_ring_fd < 0)
+        {
+            throw std::runtime_error(std::string("io_uring_setup error: ") + strerror(errno));
+        }
+
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+        m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+        m_cq_ring = single_mmap ? m_sq_ring : mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+        if (m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED || m_sqes == MAP_FAILED)
+        {
+            Release();
+            throw std::runtime_error("io_uring mmap error");
+        }
+
+        char* sq_ring = static_cast<char*>(m_sq_ring);
+        m_sq_head = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.head);
+        m_sq_tail = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.ring_mask);
+        m_sq_entries = params.sq_entries;
+        unsigned int* sq_array = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.array);
+        for (unsigned int i = 0; i < m_sq_entries; ++i)
+        {
+            sq_array[i] = i;
+        }
+        m_sqe_tail = *m_sq_tail;
+
+        char* cq_ring = static_cast<char*>(m_cq_ring);
+        m_cq_head = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+    }
+
+    ~IoUring()
+    {
+        Release();
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Returns a zeroed entry, flushing the queue to the kernel first if it is full. While the kernel takes no
+    // more entries, as when its completion queue is backed up, the entry waits in memory for the next Submit.
+    io_uring_sqe* GetSqe()
+    {
+        if (m_deferred.empty() && IsFull())
+        {
+            Submit(0);
+        }
+        if (!m_deferred.empty() || IsFull())
+        {
+            // entries keep their order, a cancel never overtakes the request it cancels
+            return &m_deferred.emplace_back(io_uring_sqe {});
+        }
+        io_uring_sqe* sqe = &static_cast<io_uring_sqe*>(m_sqes)[m_sqe_tail & m_sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        ++m_sqe_tail;
+        return sqe;
+    }
+
+    // Publishes queued entries and optionally blocks until wait_count completions are ready. Deferred entries
+    // go in as the kernel makes room, the wait starts once all of them are submitted.
+    int Submit(unsigned int wait_count)
+    {
+        while (true)
+        {
+            while (!m_deferred.empty() && !IsFull())
+            {
+                static_cast<io_uring_sqe*>(m_sqes)[m_sqe_tail++ & m_sq_mask] = m_deferred.front();
+                m_deferred.pop_front();
+            }
+            __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+            unsigned int to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+            unsigned int wait = m_deferred.empty() ? wait_count : 0;
+            if (to_submit == 0 && wait == 0)
+            {
+                return 0;
+            }
+            unsigned int flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+            int result = syscall(__NR_io_uring_enter, m_ring_fd, to_submit, wait, flags, nullptr, 0);
+            if (result <= 0 || m_deferred.empty())
+            {
+                return result < 0 ? -errno : result;
+            }
+        }
+    }
+
+    template<class F>
+    unsigned int ForEachCompletion(F&& callback)
+    {
+        unsigned int head = *m_cq_head;
+        unsigned int tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        unsigned int count = 0;
+        for (; head != tail; ++head, ++count)
+        {
+            callback(m_cqes[head & m_cq_mask]);
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    void UnregisterBufferRing(unsigned short group_id)
+    {
+        io_uring_buf_reg registration;
+        memset(&registration, 0, sizeof(registration));
+        registration.bgid = group_id;
+        syscall(__NR_io_uring_register, m_ring_fd, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    }
+
+    void RegisterBufferRing(io_uring_buf_ring* ring, unsigned int entries, unsigned short group_id)
+    {
+        io_uring_buf_reg registration;
+        memset(&registration, 0, sizeof(registration));
+        registration.ring_addr = reinterpret_cast<uint64_t>(ring);
+        registration.ring_entries = entries;
+        registration.bgid = group_id;
+        if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+        {
+            throw std::runtime_error(std::string("io_uring buffer ring registration error: ") + strerror(errno));
+        }
+    }
+private:
+    bool IsFull() const
+    {
+        return m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries;
+    }
+
+    void Release()
+    {
+        if (m_sqes != MAP_FAILED)
+        {
+            munmap(m_sqes, m_sqes_size);
+            m_sqes = MAP_FAILED;
+        }
+        if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+        {
+            munmap(m_cq_ring, m_cq_ring_size);
+        }
+        m_cq_ring = MAP_FAILED;
+        if (m_sq_ring != MAP_FAILED)
+        {
+            munmap(m_sq_ring, m_sq_ring_size);
+            m_sq_ring = MAP_FAILED;
+        }
+        if (m_ring_fd >= 0)
+        {
+            close(m_ring_fd);
+            m_ring_fd = -1;
+        }
+    }
+
+    int m_ring_fd;
+    void* m_sq_ring;
+    void* m_cq_ring;
+    void* m_sqes;
+    size_t m_sq_ring_size;
+    size_t m_cq_ring_size;
+    size_t m_sqes_size;
+    unsigned int* m_sq_head;
+    unsigned int* m_sq_tail;
+    unsigned int m_sq_mask;
+    unsigned int m_sq_entries;
+    unsigned int m_sqe_tail;
+    unsigned int* m_cq_head;
+    unsigned int* m_cq_tail;
+    unsigned int m_cq_mask;
+    io_uring_cqe* m_cqes;
+    // entries that found the submission queue full, see GetSqe
+    std::deque<io_uring_sqe> m_deferred;
+};
+
+// Provided buffers for multishot recv. A registered buffer ring is used when the kernel supports it,
+// otherwise the buffers are handed over with IORING_OP_PROVIDE_BUFFERS; the owner returns every
+// buffer with Add after consuming its data and makes them visible with Publish.
+class BufferRing {
+public:
+    BufferRing(IoUring& ring, unsigned int entries, size_t buffer_size, unsigned short group_id, uint64_t provide_user_data) : m_io_uring(ring),
+        m_entries(entries), m_mask(entries - 1), m_buffer_size(buffer_size), m_group_id(group_id), m_provide_user_data(provide_user_data),
+        m_tail(0), m_ring_size(0), m_ring(MAP_FAILED), m_is_mapped(false)
+    {
+        if (entries == 0 || (entries & m_mask) != 0 || entries > 32768)
+        {
+            throw std::runtime_error("io_uring buffer ring size must be a power of two up to 32768");
+        }
+        m_buffers = std::make_unique_for_overwrite<char[]>(entries * buffer_size);
+        m_ring_size = entries * sizeof(io_uring_buf);
+        m_ring = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_ring == MAP_FAILED)
+        {
+            throw std::runtime_error("io_uring buffer ring allocation error");
+        }
+        try
+        {
+            ring.RegisterBufferRing(Ring(), entries, group_id);
+            m_is_mapped = true;
+            for (unsigned int i = 0; i < entries; ++i)
+            {
+                Add(i);
+            }
+            Publish();
+            m_is_mapped = Probe();
+        }
+        catch (const std::exception&)
+        {
+            m_is_mapped = false;
+        }
+        if (!m_is_mapped)
+        {
+            ring.UnregisterBufferRing(group_id);
+            munmap(m_ring, m_ring_size);
+            m_ring = MAP_FAILED;
+            Provide(0, entries);
+        }
+    }
+
+    ~BufferRing()
+    {
+        if (m_ring != MAP_FAILED)
+        {
+            munmap(m_ring, m_ring_size);
+        }
+    }
+
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+
+    char* Buffer(unsigned short buffer_id)
+    {
+        return m_buffers.get() + buffer_id * m_buffer_size;
+    }
+
+    void Add(unsigned short buffer_id)
+    {
+        if (!m_is_mapped)
+        {
+            Provide(buffer_id, 1);
+            return;
+        }
+        io_uring_buf& buffer = Ring()->bufs[m_tail & m_mask];
+        buffer.addr = reinterpret_cast<uint64_t>(Buffer(buffer_id));
+        buffer.len = m_buffer_size;
+        buffer.bid = buffer_id;
+        ++m_tail;
+    }
+
+    void Publish()
+    {
+        if (m_is_mapped)
+        {
+            __atomic_store_n(&Ring()->tail, m_tail, __ATOMIC_RELEASE);
+        }
+    }
+
+    unsigned short GroupId() const
+    {
+        return m_group_id;
+    }
+
+    bool IsMapped() const
+    {
+        return m_is_mapped;
+    }
+private:
+    io_uring_buf_ring* Ring()
+    {
+        return static_cast<io_uring_buf_ring*>(m_ring);
+    }
+
+    void Provide(unsigned short first_id, unsigned int count)
+    {
+        io_uring_sqe* sqe = m_io_uring.GetSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = count;
+        sqe->addr = reinterpret_cast<uint64_t>(Buffer(first_id));
+        sqe->len = m_buffer_size;
+        sqe->off = first_id;
+        sqe->buf_group = m_group_id;
+        sqe->user_data = m_provide_user_data;
+    }
+
+    // Some kernels accept the registration but never select from the ring, one recv on a socketpair tells.
+    bool Probe()
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) < 0)
+        {
+            return false;
+        }
+        char byte = 0;
+        bool is_selected = false;
+        if (write(sockets[1], &byte, 1) == 1)
+        {
+            io_uring_sqe* sqe = m_io_uring.GetSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = sockets[0];
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = m_group_id;
+            sqe->user_data = m_provide_user_data;
+            if (m_io_uring.Submit(1) >= 0)
+            {
+                m_io_uring.ForEachCompletion([this, &is_selected](const io_uring_cqe& cqe) {
+                    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+                    {
+                        is_selected = true;
+                        Add(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                        Publish();
+                    }
+                });
+            }
+        }
+        close(sockets[0]);
+        close(sockets[1]);
+        return is_selected;
+    }
+
+    IoUring& m_io_uring;
+    const unsigned int m_entries;
+    const unsigned int m_mask;
+    const size_t m_buffer_size;
+    const unsigned short m_group_id;
+    const uint64_t m_provide_user_data;
+    unsigned short m_tail;
+    size_t m_ring_size;
+    void* m_ring;
+    bool m_is_mapped;
+    std::unique_ptr<char[]> m_buffers;
+};
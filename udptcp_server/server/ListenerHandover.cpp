@@ -0,0 +1,309 @@
+#include "ListenerHandover.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+// Messages: 'S' with up to max_fds_per_message sockets and their endpoints separated by '\n', 'E' after the
+// last one; the new process answers 'R' once it serves.
+constexpr char sockets_message {'S'};
+constexpr char end_message {'E'};
+constexpr char ready_message {'R'};
+constexpr size_t max_fds_per_message {64};
+constexpr size_t max_message_size {64 * 1024};
+constexpr time_t receive_timeout_s {5};
+// the new process confirms after its own start, which may open an io_uring per reactor
+constexpr time_t confirm_timeout_s {60};
+
+sockaddr_un MakeAddress(const std::string& path)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("handover path is too long: " + path);
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+    return address;
+}
+
+void SetTimeouts(int socket, time_t seconds)
+{
+    timeval timeout {seconds, 0};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+} // namespace
+
+ListenerHandover::ListenerHandover() : m_socket(-1), m_peer(-1), m_stop_event(-1), m_is_running(false),
+    m_is_handed_over(false), m_logger("Handover") {}
+
+ListenerHandover::~ListenerHandover()
+{
+    Stop();
+}
+
+std::vector<ListenerHandover::Socket> ListenerHandover::Receive(const std::string& path)
+{
+    sockaddr_un address = MakeAddress(path);
+    int peer = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (peer < 0)
+    {
+        throw std::runtime_error("handover socket creating error");
+    }
+    if (connect(peer, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        int error = errno;
+        close(peer);
+        if (error == ENOENT || error == ECONNREFUSED)
+        {
+            return {};
+        }
+        throw std::runtime_error("handover connect to " + path + " error: " + strerror(error));
+    }
+    SetTimeouts(peer, receive_timeout_s);
+
+    std::vector<Socket> sockets;
+    auto fail = [&](const std::string& message) {
+        for (const Socket& socket : sockets)
+        {
+            close(socket.socket);
+        }
+        close(peer);
+        throw std::runtime_error("handover from " + path + " failed: " + message);
+    };
+    std::string payload(max_message_size, '\0');
+    char control[CMSG_SPACE(sizeof(int) * max_fds_per_message)];
+    while (true)
+    {
+        iovec vector {payload.data(), payload.size()};
+        msghdr message {};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t received = recvmsg(peer, &message, MSG_CMSG_CLOEXEC);
+        if (received <= 0)
+        {
+            fail(received < 0 ? strerror(errno) : "connection closed");
+        }
+        size_t first = sockets.size();
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+            {
+                size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    int fd;
+                    memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(fd));
+                    sockets.push_back({{}, fd});
+                }
+            }
+        }
+        if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+        {
+            fail("message truncated");
+        }
+        if (payload[0] == end_message)
+        {
+            break;
+        }
+        std::string_view endpoints(payload.data() + 1, received - 1);
+        for (size_t i = first; i < sockets.size(); ++i)
+        {
+            size_t end = endpoints.find('\n');
+            sockets[i].endpoint = endpoints.substr(0, end);
+            endpoints.remove_prefix(end == std::string_view::npos ? endpoints.size() : end + 1);
+        }
+        if (payload[0] != sockets_message || !endpoints.empty())
+        {
+            fail("unexpected message");
+        }
+    }
+    m_peer = peer;
+    LOG(m_logger, LogHelper::info, "Received " << sockets.size() << " listening sockets from " << path);
+    return sockets;
+}
+
+void ListenerHandover::Confirm()
+{
+    if (m_peer < 0)
+    {
+        return;
+    }
+    if (send(m_peer, &ready_message, 1, MSG_NOSIGNAL) != 1)
+    {
+        LOG(m_logger, LogHelper::warning, "Previous server did not take the confirmation: " << strerror(errno));
+    }
+    close(m_peer);
+    m_peer = -1;
+}
+
+void ListenerHandover::Open(const std::string& path)
+{
+    sockaddr_un address = MakeAddress(path);
+    m_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (m_socket < 0)
+    {
+        throw std::runtime_error("handover socket creating error");
+    }
+    // the file of a previous server, or of one that crashed
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(path.c_str());
+    }
+    // whoever connects gets the listening sockets, so only the owner may
+    mode_t mask = umask(0077);
+    int result = bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    umask(mask);
+    if (result < 0 || listen(m_socket, 4) < 0)
+    {
+        std::string error = strerror(errno);
+        close(m_socket);
+        m_socket = -1;
+        throw std::runtime_error("handover path " + path + " bind error: " + error);
+    }
+    m_path = path;
+}
+
+void ListenerHandover::Start(Collector&& collector, Callback&& on_handover)
+{
+    if (m_socket < 0 || m_is_running.exchange(true))
+    {
+        return;
+    }
+    m_stop_event = eventfd(0, EFD_CLOEXEC);
+    if (m_stop_event < 0)
+    {
+        m_is_running.store(false);
+        throw std::runtime_error("handover eventfd creating error");
+    }
+    m_collector = std::move(collector);
+    m_on_handover = std::move(on_handover);
+    m_thread = std::thread(&ListenerHandover::Run, this);
+}
+
+void ListenerHandover::Stop()
+{
+    m_is_running.store(false);
+    if (m_thread.joinable())
+    {
+        // wakes the blocked accept, or a Serve waiting for the new process
+        shutdown(m_socket, SHUT_RDWR);
+        uint64_t value = 1;
+        write(m_stop_event, &value, sizeof(value));
+        m_thread.join();
+    }
+    if (m_stop_event >= 0)
+    {
+        close(m_stop_event);
+        m_stop_event = -1;
+    }
+    if (m_socket >= 0)
+    {
+        close(m_socket);
+        m_socket = -1;
+        if (!m_is_handed_over)
+        {
+            unlink(m_path.c_str());
+        }
+    }
+    if (m_peer >= 0)
+    {
+        close(m_peer);
+        m_peer = -1;
+    }
+}
+
+void ListenerHandover::Run()
+{
+    while (m_is_running.load())
+    {
+        int peer = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (peer < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED && m_is_running.load())
+            {
+                LOG(m_logger, LogHelper::error, "Error while accepting handover client: " << strerror(errno));
+            }
+            continue;
+        }
+        bool is_confirmed = Serve(peer);
+        close(peer);
+        if (is_confirmed)
+        {
+            // the new process has replaced the socket file by now
+            m_is_handed_over = true;
+            LOG(m_logger, LogHelper::info, "New server process took over the listening sockets");
+            m_on_handover();
+            return;
+        }
+        if (m_is_running.load())
+        {
+            LOG(m_logger, LogHelper::warning, "Handover aborted, the new server process did not confirm");
+        }
+    }
+}
+
+bool ListenerHandover::Wait(int peer, short events)
+{
+    pollfd fds[2] {{peer, events, 0}, {m_stop_event, POLLIN, 0}};
+    int result;
+    do
+    {
+        result = poll(fds, 2, static_cast<int>(confirm_timeout_s * 1000));
+    } while (result < 0 && errno == EINTR);
+    return result > 0 && !(fds[1].revents & POLLIN) && fds[0].revents != 0;
+}
+
+bool ListenerHandover::Serve(int peer)
+{
+    std::vector<Socket> sockets = m_collector();
+    LOG(m_logger, LogHelper::info, "Handing " << sockets.size() << " listening sockets over");
+    std::string payload;
+    std::vector<int> fds;
+    for (size_t begin = 0; begin < sockets.size(); begin += max_fds_per_message)
+    {
+        size_t end = std::min(sockets.size(), begin + max_fds_per_message);
+        payload.assign(1, sockets_message);
+        fds.clear();
+        for (size_t i = begin; i < end; ++i)
+        {
+            payload.append(i == begin ? "" : "\n").append(sockets[i].endpoint);
+            fds.push_back(sockets[i].socket);
+        }
+        char control[CMSG_SPACE(sizeof(int) * max_fds_per_message)] {};
+        iovec vector {payload.data(), payload.size()};
+        msghdr message {};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+        if (!Wait(peer, POLLOUT) || sendmsg(peer, &message, MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+        {
+            LOG(m_logger, LogHelper::error, "Error while handing sockets over: " << strerror(errno));
+            return false;
+        }
+    }
+    char reply = 0;
+    return Wait(peer, POLLOUT) && send(peer, &end_message, 1, MSG_NOSIGNAL | MSG_DONTWAIT) == 1 && Wait(peer, POLLIN) &&
+        recv(peer, &reply, 1, MSG_DONTWAIT) == 1 && reply == ready_message;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../logging/Logging.h"
+
+// Passes the listening sockets of a running server to the process that replaces it, over a Unix seqpacket
+// socket with SCM_RIGHTS. Both processes accept from the same sockets until the new one confirms, then the
+// old one drains, so an upgrade neither refuses connects nor drops datagrams.
+//   old: Open, Start ... a new process connects, gets every listener, confirms ... on_handover
+//   new: Receive before opening its own listeners, Confirm once it serves, then Open and Start itself
+class ListenerHandover {
+public:
+    struct Socket
+    {
+        // Endpoint::ToString of the endpoint the socket is bound to
+        std::string endpoint;
+        int socket {-1};
+    };
+
+    // The sockets to pass on, they stay open in this process.
+    using Collector = std::function<std::vector<Socket>()>;
+    using Callback = std::function<void()>;
+
+    ListenerHandover();
+    ~ListenerHandover();
+
+    ListenerHandover(const ListenerHandover&) = delete;
+    ListenerHandover& operator=(const ListenerHandover&) = delete;
+
+    // Asks the server listening on path for its sockets. Empty when none answers; throws std::runtime_error
+    // when one answers but the transfer fails.
+    std::vector<Socket> Receive(const std::string& path);
+    // Tells the server the sockets came from that this process serves them.
+    void Confirm();
+
+    // Binds path, replacing the socket file of a previous server. Throws std::runtime_error when it cannot.
+    void Open(const std::string& path);
+    void Start(Collector&& collector, Callback&& on_handover);
+    // Removes the socket file unless another process took over.
+    void Stop();
+private:
+    void Run();
+    // Sends the sockets and waits for the confirmation, true once the peer confirmed.
+    bool Serve(int peer);
+    // Until the peer is ready for events, false after confirm_timeout_s or once Stop is called.
+    bool Wait(int peer, short events);
+
+    std::string m_path;
+    int m_socket;
+    // the connection to the previous server between Receive and Confirm
+    int m_peer;
+    // signalled by Stop, so a Serve waiting for the new process returns at once
+    int m_stop_event;
+    std::atomic<bool> m_is_running;
+    bool m_is_handed_over;
+    Collector m_collector;
+    Callback m_on_handover;
+    std::thread m_thread;
+    LogHelper::Logger m_logger;
+};
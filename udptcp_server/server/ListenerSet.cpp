@@ -0,0 +1,268 @@
+#include "ListenerSet.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+// The address of an endpoint, its length is the one bind and connect expect.
+socklen_t MakeAddress(const Endpoint& endpoint, int port, sockaddr_storage& storage)
+{
+    memset(&storage, 0, sizeof(storage));
+    if (endpoint.IsUnix())
+    {
+        auto& address = reinterpret_cast<sockaddr_un&>(storage);
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, endpoint.path.data(), endpoint.path.size());
+        if (endpoint.path.starts_with('@'))
+        {
+            // abstract names are not zero terminated, the leading zero marks them
+            address.sun_path[0] = '\0';
+            return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + endpoint.path.size());
+        }
+        return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + endpoint.path.size() + 1);
+    }
+    if (endpoint.IsIPv6())
+    {
+        auto& address = reinterpret_cast<sockaddr_in6&>(storage);
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(static_cast<uint16_t>(port));
+        inet_pton(AF_INET6, endpoint.host.c_str(), &address.sin6_addr);
+        return sizeof(address);
+    }
+    auto& address = reinterpret_cast<sockaddr_in&>(storage);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, endpoint.host.c_str(), &address.sin_addr);
+    return sizeof(address);
+}
+
+// A socket file left by a server that did not shut down cleanly makes bind fail with EADDRINUSE.
+void RemoveStaleSocket(const std::string& path)
+{
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(path.c_str());
+    }
+}
+} // namespace
+
+ListenerSet::ListenerSet() : m_logger("Listeners") {}
+
+ListenerSet::~ListenerSet()
+{
+    Close();
+}
+
+void ListenerSet::Open(const ServerConfig& config, bool reuse_port, bool has_unix, std::vector<ListenerHandover::Socket>& inherited)
+{
+    try
+    {
+        for (const Endpoint& endpoint : config.endpoints)
+        {
+            if (endpoint.IsUnix() && !has_unix)
+            {
+                continue;
+            }
+            unsigned int copies = endpoint.kind == EndpointKind::Tcp ? std::max(1u, config.accept_listeners) : 1;
+            auto& listeners = endpoint.IsStream() ? m_streams : m_datagrams;
+            for (unsigned int i = 0; i < copies; ++i)
+            {
+                int listener = TakeInherited(endpoint, config, inherited);
+                if (listener < 0)
+                {
+                    listener = OpenSocket(endpoint, config, reuse_port || copies > 1);
+                }
+                listeners.push_back({listener, endpoint.kind, endpoint.ToString(config.port)});
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        Close();
+        throw;
+    }
+}
+
+void ListenerSet::Close()
+{
+    for (auto* listeners : {&m_streams, &m_datagrams})
+    {
+        for (const Listener& listener : *listeners)
+        {
+            close(listener.socket);
+        }
+        listeners->clear();
+    }
+    for (const std::string& path : m_unix_paths)
+    {
+        unlink(path.c_str());
+    }
+    m_unix_paths.clear();
+}
+
+const ListenerSet::Listener* ListenerSet::FindStream(int fd) const
+{
+    auto found = std::find_if(m_streams.begin(), m_streams.end(), [fd](const Listener& listener) { return listener.socket == fd; });
+    return found == m_streams.end() ? nullptr : &*found;
+}
+
+int ListenerSet::FindDatagram(int fd) const
+{
+    for (size_t i = 0; i < m_datagrams.size(); ++i)
+    {
+        if (m_datagrams[i].socket == fd)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// Accepted sockets inherit the socket options of their listener, so keepalive and the endpoint options are
+// set here once instead of on every client.
+int ListenerSet::OpenSocket(const Endpoint& endpoint, const ServerConfig& config, bool reuse_port)
+{
+    int family = endpoint.IsUnix() ? AF_UNIX : endpoint.IsIPv6() ? AF_INET6 : AF_INET;
+    int type = endpoint.IsStream() ? SOCK_STREAM : SOCK_DGRAM;
+    int listener = socket(family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    auto fail = [&](const char* message) {
+        std::string error = endpoint.ToString(config.port) + ": " + message + ": " + strerror(errno);
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        throw std::runtime_error(error);
+    };
+    if (listener < 0)
+    {
+        fail("socket creating error");
+    }
+
+    int enable = 1;
+    if (endpoint.kind == EndpointKind::Tcp && setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0)
+    {
+        fail("reuse failed");
+    }
+    if (!endpoint.IsUnix() && reuse_port && setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0)
+    {
+        fail("reuse port failed");
+    }
+    // set either way, the net.ipv6.bindv6only default differs between systems
+    int v6only = endpoint.is_v6only ? 1 : 0;
+    if (family == AF_INET6 && setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) < 0)
+    {
+        fail("v6only failed");
+    }
+    ApplyOptions(listener, endpoint, config);
+
+    sockaddr_storage address;
+    socklen_t address_length = MakeAddress(endpoint, endpoint.port == 0 ? config.port : endpoint.port, address);
+    bool is_unix_path = endpoint.IsUnix() && !endpoint.path.starts_with('@');
+    if (is_unix_path)
+    {
+        RemoveStaleSocket(endpoint.path);
+    }
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), address_length) < 0)
+    {
+        fail("bind address error");
+    }
+    if (is_unix_path)
+    {
+        m_unix_paths.push_back(endpoint.path);
+        if (endpoint.mode != 0 && chmod(endpoint.path.c_str(), endpoint.mode) < 0)
+        {
+            fail("chmod failed");
+        }
+    }
+    if (endpoint.IsStream() && listen(listener, static_cast<int>(std::min<unsigned int>(config.listen_backlog, INT_MAX))) < 0)
+    {
+        fail("listen error");
+    }
+    return listener;
+}
+
+int ListenerSet::TakeInherited(const Endpoint& endpoint, const ServerConfig& config, std::vector<ListenerHandover::Socket>& inherited)
+{
+    std::string name = endpoint.ToString(config.port);
+    auto found = std::find_if(inherited.begin(), inherited.end(), [&name](const ListenerHandover::Socket& socket) {
+        return socket.socket >= 0 && socket.endpoint == name;
+    });
+    if (found == inherited.end())
+    {
+        return -1;
+    }
+    int listener = std::exchange(found->socket, -1);
+    // the options and the backlog may have changed along with the binary
+    ApplyOptions(listener, endpoint, config);
+    if (endpoint.IsStream())
+    {
+        listen(listener, static_cast<int>(std::min<unsigned int>(config.listen_backlog, INT_MAX)));
+    }
+    if (endpoint.IsUnix() && !endpoint.path.starts_with('@'))
+    {
+        m_unix_paths.push_back(endpoint.path);
+    }
+    return listener;
+}
+
+// An option the kernel refuses, such as busy polling without CAP_NET_ADMIN, costs performance but not
+// correctness, so it is reported and the socket is used anyway.
+void ListenerSet::ApplyOptions(int listener, const Endpoint& endpoint, const ServerConfig& config)
+{
+    auto set = [&](int level, int name, int value, const char* option) {
+        if (setsockopt(listener, level, name, &value, sizeof(value)) < 0)
+        {
+            LOG(m_logger, LogHelper::warning, endpoint.ToString(config.port) << ": " << option << " is not applied: " << strerror(errno));
+        }
+    };
+    if (endpoint.kind == EndpointKind::Tcp)
+    {
+        set(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+        set(IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(std::max(1u, config.keepalive_idle_s)), "TCP_KEEPIDLE");
+        set(IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(std::max(1u, config.keepalive_interval_s)), "TCP_KEEPINTVL");
+        set(IPPROTO_TCP, TCP_KEEPCNT, static_cast<int>(std::max(1u, config.keepalive_count)), "TCP_KEEPCNT");
+    }
+    if (endpoint.is_nodelay)
+    {
+        set(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if (endpoint.receive_buffer > 0)
+    {
+        set(SOL_SOCKET, SO_RCVBUF, endpoint.receive_buffer, "SO_RCVBUF");
+    }
+    if (endpoint.send_buffer > 0)
+    {
+        set(SOL_SOCKET, SO_SNDBUF, endpoint.send_buffer, "SO_SNDBUF");
+    }
+    if (endpoint.busy_poll_us > 0)
+    {
+        set(SOL_SOCKET, SO_BUSY_POLL, endpoint.busy_poll_us, "SO_BUSY_POLL");
+    }
+    if (endpoint.tos >= 0)
+    {
+        if (endpoint.IsIPv6())
+        {
+            set(IPPROTO_IPV6, IPV6_TCLASS, endpoint.tos, "IPV6_TCLASS");
+        }
+        // IPv4 clients of a dual-stack socket take IP_TOS
+        if (!endpoint.IsIPv6() || !endpoint.is_v6only)
+        {
+            set(IPPROTO_IP, IP_TOS, endpoint.tos, "IP_TOS");
+        }
+    }
+}
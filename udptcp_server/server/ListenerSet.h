@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Endpoint.h"
+#include "ListenerHandover.h"
+#include "ServerConfig.h"
+#include "../logging/Logging.h"
+
+// The listening sockets of one reactor: stream sockets it accepts from and datagram sockets it answers,
+// one or more per endpoint of the configuration.
+class ListenerSet {
+public:
+    struct Listener
+    {
+        int socket {-1};
+        EndpointKind kind {EndpointKind::Tcp};
+        // Endpoint::ToString, names the socket in a handover
+        std::string endpoint;
+    };
+
+    ListenerSet();
+    ~ListenerSet();
+
+    ListenerSet(const ListenerSet&) = delete;
+    ListenerSet& operator=(const ListenerSet&) = delete;
+
+    // Opens every endpoint of config, TCP ones accept_listeners times. reuse_port lets other reactors bind the
+    // same IP endpoints; a Unix path has one owner, it is opened only with has_unix. Throws std::runtime_error
+    // naming the endpoint that cannot be bound, with the sockets opened so far closed.
+    // A socket of inherited, sockets a previous server handed over, is taken in place of a new one for the
+    // endpoint it is bound to and set to -1 in inherited.
+    void Open(const ServerConfig& config, bool reuse_port, bool has_unix, std::vector<ListenerHandover::Socket>& inherited);
+    // Closes the sockets and removes the socket files this set created.
+    void Close();
+    // Leaves the socket files to the server the sockets were handed over to, Close then only closes.
+    void Release()
+    {
+        m_unix_paths.clear();
+    }
+
+    const std::vector<Listener>& Streams() const
+    {
+        return m_streams;
+    }
+
+    const std::vector<Listener>& Datagrams() const
+    {
+        return m_datagrams;
+    }
+
+    const Listener* FindStream(int fd) const;
+    // Index in Datagrams(), -1 when fd is not a datagram listener.
+    int FindDatagram(int fd) const;
+
+    bool Contains(int fd) const
+    {
+        return FindStream(fd) != nullptr || FindDatagram(fd) >= 0;
+    }
+private:
+    int OpenSocket(const Endpoint& endpoint, const ServerConfig& config, bool reuse_port);
+    // The inherited socket bound to endpoint with the options of config, -1 when there is none.
+    int TakeInherited(const Endpoint& endpoint, const ServerConfig& config, std::vector<ListenerHandover::Socket>& inherited);
+    void ApplyOptions(int listener, const Endpoint& endpoint, const ServerConfig& config);
+
+    std::vector<Listener> m_streams;
+    std::vector<Listener> m_datagrams;
+    std::vector<std::string> m_unix_paths;
+    LogHelper::Logger m_logger;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#include "Histogram.h"
+
+enum class Counter : unsigned int
+{
+    // closes come first so a snapshot reads them before accepts, see Metrics::Snapshot
+    TcpCloses,
+    TcpAccepts,
+    TcpBytesIn,
+    TcpBytesOut,
+    TcpMessages,
+    TcpErrors,
+    // closed by an idle, read or write timeout
+    TcpTimeouts,
+    UdpBytesIn,
+    UdpBytesOut,
+    UdpMessages,
+    UdpErrors,
+    // requests refused by the per-source rate limit or shed by the thread pool overload policy
+    TcpRateLimited,
+    TcpShed,
+    UdpRateLimited,
+    UdpShed,
+    // requests of binary batches, over TCP and UDP
+    BinaryRequests,
+    Count
+};
+
+// Derived from the counters by Metrics::Snapshot.
+enum class Gauge : unsigned int
+{
+    // accepts - closes
+    TcpConnections,
+    Count
+};
+
+enum class Distribution : unsigned int
+{
+    // nanoseconds a task waited in the thread pool queue
+    QueueWait,
+    // events returned by one epoll wait or completions reaped in one io_uring pass
+    ReactorBatch,
+    Count
+};
+
+struct MetricsSnapshot
+{
+    uint64_t Get(Counter counter) const
+    {
+        return counters[static_cast<unsigned int>(counter)];
+    }
+
+    int64_t Get(Gauge gauge) const
+    {
+        return gauges[static_cast<unsigned int>(gauge)];
+    }
+
+    std::array<uint64_t, static_cast<unsigned int>(Counter::Count)> counters {};
+    std::array<int64_t, static_cast<unsigned int>(Gauge::Count)> gauges {};
+};
+
+// Process metrics split into cache-line sized shards. Every thread updates its own shard, so the hot
+// paths never share a line; readers sum the shards without taking any lock.
+class Metrics {
+public:
+    void Add(Counter counter, uint64_t value = 1)
+    {
+        LocalShard().counters[static_cast<unsigned int>(counter)].fetch_add(value, std::memory_order_release);
+    }
+
+    void Record(Distribution distribution, uint64_t value)
+    {
+        m_distributions[static_cast<unsigned int>(distribution)].Record(value);
+    }
+
+    Histogram& Get(Distribution distribution)
+    {
+        return m_distributions[static_cast<unsigned int>(distribution)];
+    }
+
+    const Histogram& Get(Distribution distribution) const
+    {
+        return m_distributions[static_cast<unsigned int>(distribution)];
+    }
+
+    // Counters only grow and closes are read before accepts, so a snapshot taken under load can lag a few
+    // events but never shows more closes than accepts. The open connections are their difference: a gauge
+    // summed over shards could read the -1 of a close without the +1 of its accept on another shard.
+    MetricsSnapshot Snapshot() const
+    {
+        MetricsSnapshot snapshot;
+        for (unsigned int i = 0; i < snapshot.counters.size(); ++i)
+        {
+            for (const Shard& shard : m_shards)
+            {
+                snapshot.counters[i] += shard.counters[i].load(std::memory_order_acquire);
+            }
+        }
+        snapshot.gauges[static_cast<unsigned int>(Gauge::TcpConnections)] =
+            static_cast<int64_t>(snapshot.Get(Counter::TcpAccepts) - snapshot.Get(Counter::TcpCloses));
+        return snapshot;
+    }
+
+    static std::string_view Name(Counter counter)
+    {
+        static constexpr std::array<std::string_view, static_cast<unsigned int>(Counter::Count)> names {
+            "tcp_closes", "tcp_accepts", "tcp_bytes_in", "tcp_bytes_out", "tcp_messages", "tcp_errors",
+            "tcp_timeouts", "udp_bytes_in", "udp_bytes_out", "udp_messages", "udp_errors", "tcp_rate_limited", "tcp_shed",
+            "udp_rate_limited", "udp_shed", "binary_requests"};
+        return names[static_cast<unsigned int>(counter)];
+    }
+
+    static std::string_view Name(Gauge gauge)
+    {
+        static constexpr std::array<std::string_view, static_cast<unsigned int>(Gauge::Count)> names {
+            "tcp_connections"};
+        return names[static_cast<unsigned int>(gauge)];
+    }
+
+    static std::string_view Help(Counter counter)
+    {
+        static constexpr std::array<std::string_view, static_cast<unsigned int>(Counter::Count)> help {
+            "TCP connections closed.", "TCP connections accepted.", "Bytes received from TCP clients.",
+            "Bytes sent to TCP clients.", "TCP messages received.", "TCP read, write and protocol errors.",
+            "TCP connections closed by an idle, read or write timeout.", "Bytes received in UDP datagrams.",
+            "Bytes sent in UDP datagrams.", "UDP datagrams received.", "UDP receive and send errors.",
+            "TCP connections and messages refused by the per-source rate limit.",
+            "TCP messages shed by the overload policy.",
+            "UDP datagrams dropped by the per-source rate limit.", "UDP datagrams shed by the overload policy.",
+            "Requests received in binary protocol batches."};
+        return help[static_cast<unsigned int>(counter)];
+    }
+
+    static std::string_view Help(Gauge gauge)
+    {
+        static constexpr std::array<std::string_view, static_cast<unsigned int>(Gauge::Count)> help {
+            "Open TCP connections."};
+        return help[static_cast<unsigned int>(gauge)];
+    }
+private:
+    static constexpr unsigned int m_shards_count {32};
+
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<uint64_t>, static_cast<unsigned int>(Counter::Count)> counters {};
+    };
+
+    Shard& LocalShard()
+    {
+        static std::atomic<unsigned int> next_shard {0};
+        static thread_local unsigned int shard = next_shard.fetch_add(1, std::memory_order_relaxed) % m_shards_count;
+        return m_shards[shard];
+    }
+
+    std::array<Shard, m_shards_count> m_shards;
+    std::array<Histogram, static_cast<unsigned int>(Distribution::Count)> m_distributions;
+};
@@ -0,0 +1,152 @@
+#include "MetricsListener.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+constexpr size_t max_request_size {8192};
+constexpr time_t io_timeout_s {2};
+} // namespace
+
+MetricsListener::MetricsListener(std::string_view content_type, Writer&& writer) : m_content_type(content_type),
+    m_writer(std::move(writer)), m_socket(-1), m_is_running(false), m_logger("Metrics") {}
+
+MetricsListener::~MetricsListener()
+{
+    Stop();
+}
+
+void MetricsListener::Open(int port)
+{
+    m_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_socket < 0)
+    {
+        throw std::runtime_error("metrics socket creating error");
+    }
+    int reuse = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // a server taking over from this one binds the port while this one drains
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(m_socket, (sockaddr*)&address, sizeof(address)) < 0 || listen(m_socket, 16) < 0)
+    {
+        close(m_socket);
+        m_socket = -1;
+        throw std::runtime_error("metrics port " + std::to_string(port) + " bind error: " + strerror(errno));
+    }
+}
+
+void MetricsListener::Start()
+{
+    if (m_socket < 0 || m_is_running.exchange(true))
+    {
+        return;
+    }
+    m_thread = std::thread(&MetricsListener::Run, this);
+}
+
+void MetricsListener::Stop()
+{
+    if (m_is_running.exchange(false))
+    {
+        // wakes the blocked accept
+        shutdown(m_socket, SHUT_RDWR);
+        m_thread.join();
+    }
+    if (m_socket >= 0)
+    {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
+
+void MetricsListener::Run()
+{
+    while (m_is_running.load())
+    {
+        int client = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED && m_is_running.load())
+            {
+                LOG(m_logger, LogHelper::error, "Error while accepting metrics client: " << strerror(errno));
+            }
+            continue;
+        }
+        Serve(client);
+        close(client);
+    }
+}
+
+// A client that stalls is dropped after io_timeout_s, it only delays the next scrape.
+void MetricsListener::Serve(int client)
+{
+    timeval timeout {io_timeout_s, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos)
+    {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0 || request.size() + received > max_request_size)
+        {
+            return;
+        }
+        request.append(buffer, received);
+    }
+
+    // "GET /metrics?query HTTP/1.1"
+    std::string_view line(request.data(), request.find("\r\n"));
+    size_t path_begin = line.find(' ') + 1;
+    std::string_view method = line.substr(0, path_begin - 1);
+    std::string_view path = line.substr(path_begin, line.find(' ', path_begin) - path_begin);
+    path = path.substr(0, path.find('?'));
+
+    std::string_view status = "200 OK";
+    m_body.clear();
+    if (method != "GET")
+    {
+        status = "405 Method Not Allowed";
+    }
+    else if (path != "/metrics")
+    {
+        status = "404 Not Found";
+    }
+    else
+    {
+        m_writer(m_body);
+    }
+    std::string header = "HTTP/1.1 " + std::string(status) + "\r\nContent-Type: " + m_content_type + "\r\nContent-Length: " +
+        std::to_string(m_body.size()) + "\r\nConnection: close\r\n\r\n";
+    if (SendAll(client, header))
+    {
+        SendAll(client, m_body);
+    }
+}
+
+bool MetricsListener::SendAll(int client, std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t sent = send(client, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data.remove_prefix(sent);
+    }
+    return true;
+}
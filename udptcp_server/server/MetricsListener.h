@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "../logging/Logging.h"
+
+// Answers HTTP GET /metrics on a port of its own, so Prometheus can scrape without speaking the server
+// protocol. Scrapes are rare and small: one blocking thread serves one request per connection at a time.
+class MetricsListener {
+public:
+    // Appends the response body.
+    using Writer = std::function<void(std::string& output)>;
+
+    MetricsListener(std::string_view content_type, Writer&& writer);
+    ~MetricsListener();
+
+    MetricsListener(const MetricsListener&) = delete;
+    MetricsListener& operator=(const MetricsListener&) = delete;
+
+    // Binds the port on all interfaces, throws std::runtime_error when it cannot.
+    void Open(int port);
+    void Start();
+    void Stop();
+private:
+    void Run();
+    void Serve(int client);
+    bool SendAll(int client, std::string_view data);
+
+    std::string m_content_type;
+    Writer m_writer;
+    int m_socket;
+    std::atomic<bool> m_is_running;
+    std::thread m_thread;
+    std::string m_body;
+    LogHelper::Logger m_logger;
+};
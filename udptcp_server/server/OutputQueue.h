@@ -0,0 +1,263 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+
+#include "BufferPool.h"
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// Pending TCP output of one connection. Responses are queued as whole buffers and written with one
+// vectored call from the first unsent byte, so a partial write resumes exactly where it stopped.
+// A buffer is either an owned string or a slab block, e.g. echoed input handed over without copying.
+// The queue nodes come from the slab allocator too, so a warm connection queues without calling malloc.
+class OutputQueue {
+public:
+    enum class Status
+    {
+        Drained,
+        Blocked,
+        Error
+    };
+
+    static constexpr size_t max_iovecs {64};
+
+    void Push(std::string&& data)
+    {
+        if (data.empty())
+        {
+            return;
+        }
+        m_size += data.size();
+        m_buffers.emplace_back(std::move(data));
+    }
+
+    // Queues bytes [begin, end) of block, which goes back to its slab cache once they are sent.
+    void Push(PooledBuffer&& block, size_t begin, size_t end)
+    {
+        if (begin == end)
+        {
+            return;
+        }
+        m_size += end - begin;
+        m_buffers.emplace_back(std::move(block), begin, end);
+    }
+
+    // Queues a copy of data in a slab block, for responses built in a reused buffer.
+    void PushCopy(std::string_view data)
+    {
+        if (data.empty())
+        {
+            return;
+        }
+        size_t capacity = SlabAllocator::BlockSize(data.size());
+        PooledBuffer block {std::unique_ptr<char[], SlabDeleter>(static_cast<char*>(SlabAllocator::Allocate(capacity))), capacity};
+        std::memcpy(block.data.get(), data.data(), data.size());
+        Push(std::move(block), 0, data.size());
+    }
+
+    // Moves all buffers of an unsent queue behind the ones of this queue.
+    void Append(OutputQueue&& other)
+    {
+        for (auto& buffer : other.m_buffers)
+        {
+            m_size += buffer.Size();
+            m_buffers.push_back(std::move(buffer));
+        }
+        other.Clear();
+    }
+
+    // Points up to count iovecs at the unsent bytes and returns how many were filled.
+    size_t Gather(iovec* iovecs, size_t count) const
+    {
+        size_t filled = 0;
+        size_t offset = m_offset;
+        for (auto it = m_buffers.begin(); it != m_buffers.end() && filled < count; ++it, ++filled)
+        {
+            iovecs[filled].iov_base = const_cast<char*>(it->Data()) + offset;
+            iovecs[filled].iov_len = it->Size() - offset;
+            offset = 0;
+        }
+        return filled;
+    }
+
+    void Consume(size_t size)
+    {
+        Consume(size, false);
+    }
+
+    // Writes until the queue is empty or the socket buffer is full; errno is kept on Error.
+    Status Flush(int socket, size_t& written_total)
+    {
+        written_total = 0;
+        iovec iovecs[max_iovecs];
+        bool is_zerocopy_allowed = true;
+        while (!m_buffers.empty())
+        {
+            msghdr message {};
+            message.msg_iov = iovecs;
+            message.msg_iovlen = Gather(iovecs, max_iovecs);
+            bool is_zerocopy = is_zerocopy_allowed && m_zerocopy_threshold > 0 && m_size >= m_zerocopy_threshold &&
+                !HasInlineText(message.msg_iovlen);
+            // sendmsg is writev with MSG_NOSIGNAL, a reset peer must not raise SIGPIPE
+            ssize_t written = sendmsg(socket, &message, MSG_NOSIGNAL | (is_zerocopy ? MSG_ZEROCOPY : 0));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (is_zerocopy && errno == ENOBUFS)
+                {
+                    // out of option memory for completions, the rest of this flush is copied
+                    is_zerocopy_allowed = false;
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK ? Status::Blocked : Status::Error;
+            }
+            if (is_zerocopy)
+            {
+                ++m_zerocopy_sends;
+            }
+            Consume(written, is_zerocopy);
+            written_total += written;
+        }
+        return Status::Drained;
+    }
+
+    // Sends of at least threshold queued bytes use MSG_ZEROCOPY; the socket must have SO_ZEROCOPY set.
+    void EnableZerocopy(size_t threshold)
+    {
+        m_zerocopy_threshold = threshold;
+    }
+
+    // Completion of the zerocopy sends up to last_send, counted from 0 like the kernel does per socket.
+    // TCP completes sends in order, so every buffer last referenced by an earlier send is released too.
+    // is_copied means the kernel fell back to copying, then zerocopy is only overhead and gets disabled.
+    void CompleteZerocopy(uint32_t last_send, bool is_copied)
+    {
+        while (!m_zerocopy_buffers.empty() && static_cast<int32_t>(m_zerocopy_buffers.front().zerocopy_send - last_send) <= 0)
+        {
+            m_zerocopy_buffers.pop_front();
+        }
+        if (is_copied)
+        {
+            m_zerocopy_threshold = 0;
+        }
+    }
+
+    void Clear()
+    {
+        m_buffers.clear();
+        m_zerocopy_buffers.clear();
+        m_offset = 0;
+        m_size = 0;
+        m_zerocopy_threshold = 0;
+        m_zerocopy_sends = 0;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    bool Empty() const
+    {
+        return m_buffers.empty();
+    }
+private:
+    struct Buffer
+    {
+        explicit Buffer(std::string&& text) : text(std::move(text)) {}
+        Buffer(PooledBuffer&& block, size_t begin, size_t end) : block(std::move(block)), begin(begin), end(end) {}
+
+        const char* Data() const
+        {
+            return block.data ? block.data.get() + begin : text.data();
+        }
+
+        size_t Size() const
+        {
+            return block.data ? end - begin : text.size();
+        }
+
+        // a short string keeps its bytes inside the object, they move with it
+        bool IsInline() const
+        {
+            const char* data = text.data();
+            return !block.data && data >= reinterpret_cast<const char*>(this) && data < reinterpret_cast<const char*>(this + 1);
+        }
+
+        std::string text;
+        PooledBuffer block;
+        size_t begin {0};
+        size_t end {0};
+        // the kernel may read a buffer until the last zerocopy send that covered it completes
+        bool is_zerocopy {false};
+        uint32_t zerocopy_send {0};
+    };
+
+    // Zerocopy sends must not cover inline strings: they move to m_zerocopy_buffers while the kernel still reads them.
+    bool HasInlineText(size_t count) const
+    {
+        for (size_t i = 0; i < count && i < m_buffers.size(); ++i)
+        {
+            if (m_buffers[i].IsInline())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Consume(size_t size, bool is_zerocopy)
+    {
+        m_size -= size;
+        if (is_zerocopy)
+        {
+            // every buffer the send covered, the first one from the offset on
+            size_t covered = 0;
+            size_t offset = m_offset;
+            for (auto it = m_buffers.begin(); it != m_buffers.end() && covered < size; ++it)
+            {
+                it->is_zerocopy = true;
+                it->zerocopy_send = m_zerocopy_sends - 1;
+                covered += it->Size() - offset;
+                offset = 0;
+            }
+        }
+        while (size > 0)
+        {
+            size_t left = m_buffers.front().Size() - m_offset;
+            if (size < left)
+            {
+                m_offset += size;
+                return;
+            }
+            size -= left;
+            m_offset = 0;
+            if (m_buffers.front().is_zerocopy)
+            {
+                m_zerocopy_buffers.push_back(std::move(m_buffers.front()));
+            }
+            m_buffers.pop_front();
+        }
+    }
+
+    std::deque<Buffer, SlabStlAllocator<Buffer>> m_buffers;
+    // sent buffers that wait for their zerocopy completion
+    std::deque<Buffer, SlabStlAllocator<Buffer>> m_zerocopy_buffers;
+    size_t m_offset {0};
+    size_t m_size {0};
+    size_t m_zerocopy_threshold {0};
+    uint32_t m_zerocopy_sends {0};
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Histogram.h"
+
+// Appends metrics in the Prometheus text exposition format 0.0.4. Labels are passed preformatted, without
+// braces, as built by AppendLabel.
+class PrometheusText {
+public:
+    static constexpr std::string_view content_type {"text/plain; version=0.0.4; charset=utf-8"};
+
+    explicit PrometheusText(std::string& output) : m_output(output) {}
+
+    void Family(std::string_view name, std::string_view type, std::string_view help)
+    {
+        m_output.append("# HELP ").append(name).push_back(' ');
+        m_output.append(help).append("\n# TYPE ").append(name).push_back(' ');
+        m_output.append(type).push_back('\n');
+    }
+
+    template<class T>
+    void Sample(std::string_view name, std::string_view labels, T value)
+    {
+        m_output.append(name);
+        if (!labels.empty())
+        {
+            m_output.push_back('{');
+            m_output.append(labels).push_back('}');
+        }
+        m_output.push_back(' ');
+        AppendValue(value);
+        m_output.push_back('\n');
+    }
+
+    // Cumulative buckets of a histogram family; recorded values are divided by unit for export, 1e9 turns
+    // nanoseconds into seconds.
+    // Empty buckets are left out to keep a scrape small, a missing bound reads like the one below it.
+    void HistogramSamples(std::string_view name, std::string_view labels, const Histogram::Snapshot& snapshot, double unit)
+    {
+        m_name.assign(name).append("_bucket");
+        uint64_t count = 0;
+        for (unsigned int i = 0; i + 1 < Histogram::buckets_count; ++i)
+        {
+            if (snapshot.buckets[i] == 0)
+            {
+                continue;
+            }
+            count += snapshot.buckets[i];
+            m_labels.assign(labels);
+            AppendLabel(m_labels, "le", static_cast<double>(Histogram::UpperBound(i)) / unit);
+            Sample(m_name, m_labels, count);
+        }
+        count += snapshot.buckets[Histogram::buckets_count - 1];
+        m_labels.assign(labels);
+        AppendLabel(m_labels, "le", "+Inf");
+        Sample(m_name, m_labels, count);
+        m_name.assign(name).append("_sum");
+        Sample(m_name, labels, static_cast<double>(snapshot.sum) / unit);
+        m_name.assign(name).append("_count");
+        Sample(m_name, labels, count);
+    }
+
+    static void AppendLabel(std::string& labels, std::string_view key, std::string_view value)
+    {
+        if (!labels.empty())
+        {
+            labels.push_back(',');
+        }
+        labels.append(key).append("=\"");
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                labels.push_back('\\');
+                labels.push_back(c);
+            }
+            else if (c == '\n')
+            {
+                labels.append("\\n");
+            }
+            else
+            {
+                labels.push_back(c);
+            }
+        }
+        labels.push_back('"');
+    }
+
+    static void AppendLabel(std::string& labels, std::string_view key, double value)
+    {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        AppendLabel(labels, key, std::string_view(buffer, result.ptr - buffer));
+    }
+private:
+    template<class T>
+    void AppendValue(T value)
+    {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        m_output.append(buffer, result.ptr);
+    }
+
+    std::string& m_output;
+    std::string m_name;
+    std::string m_labels;
+};
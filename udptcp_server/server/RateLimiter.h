@@ -0,0 +1,173 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Token bucket per source address in a fixed open-addressing table. An entry is a key word and a state word
+// holding the milli-tokens left and the millisecond of the last refill, so a check is one probe and one CAS:
+// no locks, no allocation. A source that finds its probe window full takes over the entry refilled longest
+// ago; the evicted source starts again from a full bucket, which only ever errs on the side of admitting.
+class RateLimiter {
+public:
+    explicit RateLimiter(size_t capacity) : m_capacity(std::bit_ceil(std::max<size_t>(capacity, m_probe_window))),
+        m_mask(m_capacity - 1), m_entries(std::make_unique<Entry[]>(m_capacity)), m_rate(0), m_burst_milli(0) {}
+
+    // rate tokens per second, 0 disables; burst is the bucket size, 0 for one second worth. Any thread.
+    void Configure(unsigned int rate, unsigned int burst)
+    {
+        uint64_t tokens = std::clamp<uint64_t>(burst == 0 ? rate : burst, 1, m_max_burst);
+        m_burst_milli.store(tokens * 1000, std::memory_order_relaxed);
+        m_rate.store(rate, std::memory_order_relaxed);
+    }
+
+    bool IsEnabled() const
+    {
+        return m_rate.load(std::memory_order_relaxed) != 0;
+    }
+
+    // Takes a token from the bucket of source. Unknown sources (key 0) are always admitted.
+    bool Allow(uint64_t source)
+    {
+        uint64_t rate = m_rate.load(std::memory_order_relaxed);
+        if (rate == 0 || source == 0)
+        {
+            return true;
+        }
+        uint64_t burst = m_burst_milli.load(std::memory_order_relaxed);
+        uint32_t now = NowMs();
+        Entry* entry = Find(source, now, burst);
+        if (entry == nullptr)
+        {
+            return true;
+        }
+        uint64_t state = entry->state.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto last = static_cast<uint32_t>(state >> 32);
+            uint32_t elapsed = now - last;
+            // another thread stored a later millisecond than the one read here
+            if (elapsed > INT32_MAX)
+            {
+                elapsed = 0;
+                now = last;
+            }
+            uint64_t tokens = std::min(burst, (state & 0xffffffff) + elapsed * rate);
+            if (tokens < 1000)
+            {
+                return false;
+            }
+            uint64_t next = static_cast<uint64_t>(now) << 32 | (tokens - 1000);
+            if (entry->state.compare_exchange_weak(state, next, std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+    }
+
+    // Key of the IPv4 or IPv6 address of a peer, 0 for other families. An IPv4 client of a dual-stack socket
+    // gets the key it would have on an IPv4 socket.
+    static uint64_t SourceKey(const sockaddr_storage& address)
+    {
+        if (address.ss_family == AF_INET)
+        {
+            return reinterpret_cast<const sockaddr_in&>(address).sin_addr.s_addr | uint64_t {1} << 32;
+        }
+        if (address.ss_family != AF_INET6)
+        {
+            return 0;
+        }
+        const in6_addr& ip = reinterpret_cast<const sockaddr_in6&>(address).sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&ip))
+        {
+            uint32_t ipv4;
+            memcpy(&ipv4, ip.s6_addr + 12, sizeof(ipv4));
+            return ipv4 | uint64_t {1} << 32;
+        }
+        uint64_t high;
+        uint64_t low;
+        memcpy(&high, ip.s6_addr, sizeof(high));
+        memcpy(&low, ip.s6_addr + 8, sizeof(low));
+        uint64_t key = Mix(high) ^ low ^ uint64_t {2} << 32;
+        return key == 0 ? 1 : key;
+    }
+private:
+    static constexpr size_t m_probe_window {8};
+    // milli-tokens must fit the 32 bits of the state word
+    static constexpr uint64_t m_max_burst {4000000};
+
+    struct alignas(16) Entry
+    {
+        std::atomic<uint64_t> key {0};
+        std::atomic<uint64_t> state {0};
+    };
+
+    Entry* Find(uint64_t source, uint32_t now, uint64_t burst)
+    {
+        size_t index = Mix(source) & m_mask;
+        Entry* oldest = nullptr;
+        uint32_t oldest_age = 0;
+        for (size_t i = 0; i < m_probe_window; ++i)
+        {
+            Entry& entry = m_entries[(index + i) & m_mask];
+            uint64_t key = entry.key.load(std::memory_order_acquire);
+            if (key == source)
+            {
+                return &entry;
+            }
+            if (key == 0)
+            {
+                if (entry.key.compare_exchange_strong(key, source, std::memory_order_acq_rel))
+                {
+                    entry.state.store(static_cast<uint64_t>(now) << 32 | burst, std::memory_order_relaxed);
+                    return &entry;
+                }
+                if (key == source)
+                {
+                    return &entry;
+                }
+            }
+            uint32_t age = now - static_cast<uint32_t>(entry.state.load(std::memory_order_relaxed) >> 32);
+            if (oldest == nullptr || (age <= INT32_MAX && age > oldest_age))
+            {
+                oldest = &entry;
+                oldest_age = age;
+            }
+        }
+        uint64_t key = oldest->key.load(std::memory_order_relaxed);
+        if (!oldest->key.compare_exchange_strong(key, source, std::memory_order_acq_rel))
+        {
+            return key == source ? oldest : nullptr;
+        }
+        oldest->state.store(static_cast<uint64_t>(now) << 32 | burst, std::memory_order_relaxed);
+        return oldest;
+    }
+
+    static uint64_t Mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        return value;
+    }
+
+    static uint32_t NowMs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        return static_cast<uint32_t>(static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000);
+    }
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<Entry[]> m_entries;
+    std::atomic<uint64_t> m_rate;
+    std::atomic<uint64_t> m_burst_milli;
+};
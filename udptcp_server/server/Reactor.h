@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ConnectionTable.h"
+#include "IoBackend.h"
+#include "ListenerSet.h"
+
+struct Reactor
+{
+    unsigned int id {0};
+    // the sockets of the configured endpoints; the IP ones are bound by every reactor with SO_REUSEPORT
+    ListenerSet listeners;
+    std::unique_ptr<IoBackend> backend;
+    std::thread thread;
+    // shared by every reactor, descriptors are unique per process
+    ConnectionTable* connections {nullptr};
+
+    bool IsListener(int fd) const
+    {
+        return listeners.Contains(fd);
+    }
+};
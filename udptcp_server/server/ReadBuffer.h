@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+#include "BufferPool.h"
+
+class ReadBuffer {
+public:
+    explicit ReadBuffer(BufferPool& pool) : m_pool(pool), m_begin(0), m_end(0) {}
+
+    ~ReadBuffer()
+    {
+        m_pool.Release(std::move(m_buffer));
+    }
+
+    ReadBuffer(const ReadBuffer&) = delete;
+    ReadBuffer& operator=(const ReadBuffer&) = delete;
+
+    char* PrepareWrite(size_t min_space, size_t& space)
+    {
+        if (m_buffer.capacity - m_end < min_space)
+        {
+            size_t size = Size();
+            if (m_buffer.capacity - size >= min_space)
+            {
+                std::memmove(m_buffer.data.get(), m_buffer.data.get() + m_begin, size);
+            }
+            else
+            {
+                PooledBuffer buffer = m_pool.Acquire(size + min_space);
+                if (size > 0)
+                {
+                    std::memcpy(buffer.data.get(), m_buffer.data.get() + m_begin, size);
+                }
+                m_pool.Release(std::move(m_buffer));
+                m_buffer = std::move(buffer);
+            }
+            m_begin = 0;
+            m_end = size;
+        }
+        space = m_buffer.capacity - m_end;
+        return m_buffer.data.get() + m_end;
+    }
+
+    void Commit(size_t size)
+    {
+        m_end += size;
+    }
+
+    void Consume(size_t size)
+    {
+        m_begin += size;
+        if (m_begin == m_end)
+        {
+            // idle connections should not pin a block
+            m_pool.Release(std::move(m_buffer));
+            m_begin = 0;
+            m_end = 0;
+        }
+    }
+
+    void Clear()
+    {
+        m_pool.Release(std::move(m_buffer));
+        m_begin = 0;
+        m_end = 0;
+    }
+
+    // Hands over the block that holds the next size bytes, which start at offset in it. The bytes after them
+    // move to a new block and stay readable.
+    PooledBuffer Detach(size_t size, size_t& offset)
+    {
+        size_t rest = Size() - size;
+        PooledBuffer block = std::move(m_buffer);
+        m_buffer = PooledBuffer {};
+        offset = m_begin;
+        m_begin = 0;
+        m_end = 0;
+        if (rest > 0)
+        {
+            m_buffer = m_pool.Acquire(rest);
+            std::memcpy(m_buffer.data.get(), block.data.get() + offset + size, rest);
+            m_end = rest;
+        }
+        return block;
+    }
+
+    std::string_view Data() const
+    {
+        return std::string_view(m_buffer.data.get() + m_begin, Size());
+    }
+
+    size_t Size() const
+    {
+        return m_end - m_begin;
+    }
+private:
+    BufferPool& m_pool;
+    PooledBuffer m_buffer;
+    size_t m_begin;
+    size_t m_end;
+};
@@ -1,16 +1,49 @@
 #include "Server.h"
+#include "EpollBackend.h"
+#include "UringBackend.h"
+#include "PrometheusText.h"
 
-#include <netinet/tcp.h>
-#include <sys/epoll.h>
-#include <fcntl.h>
 #include <unistd.h>
-#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <concepts>
 #include <cstring>
 
-TCPUPDServer::TCPUPDServer() : m_server_run(false), m_tcp_socket(-1), m_udp_socket(-1), m_epoll_fd(-1), m_error_mask(EPOLLHUP | EPOLLERR | EPOLLRDHUP),
-m_shutdown_event_fd(-1), m_is_shutdown(false), m_task_queue(std::make_unique<ThreadPoolQueue>()), m_logger(boost::log::keywords::channel = "Server") {}
+namespace
+{
+template<std::integral T>
+void AppendNumber(std::string& output, T value)
+{
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    output.append(buffer, result.ptr);
+}
+
+// Responses are built here and copied into a slab block, the string keeps its capacity between requests.
+thread_local std::string t_response_text;
+
+constexpr double ns_per_second {1e9};
+
+constexpr std::string_view busy_reply {"Server busy"};
+constexpr std::string_view rate_limited_reply {"Too many requests"};
+
+uint64_t NowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+} // namespace
+
+TCPUPDServer::TCPUPDServer() : m_is_shutdown(false), m_is_drained(false), m_is_handed_over(false), m_is_sharded(false),
+m_server_run(false), m_task_queue(std::make_unique<ThreadPoolQueue>()), m_logger("Server")
+{
+    RegisterBuiltinCommands();
+}
 
 TCPUPDServer::~TCPUPDServer()
 {
@@ -25,385 +58,738 @@ TCPUPDServer::~TCPUPDServer()
 
 void TCPUPDServer::Stop()
 {
-    if (!m_server_run)
+    if (!m_server_run.exchange(false))
     {
         return;
     }
-    m_server_run.store(false);
-    uint64_t value = 1;
-    write(m_shutdown_event_fd, &value, sizeof(value));
-    close(m_udp_socket);
-    for (auto& client_socket : m_client_sockets) 
+    m_handover.Stop();
+    for (auto& reactor : m_reactors)
     {
-        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, client_socket, nullptr);
-        shutdown(client_socket, SHUT_RDWR);
-        close(client_socket);
+        reactor->backend->Wakeup();
     }
-    close(m_tcp_socket);
-    close(m_epoll_fd);
-    close(m_shutdown_event_fd);
-    if (m_server_thread.joinable())
+    for (auto& reactor : m_reactors)
     {
-        m_server_thread.join();
+        if (reactor->thread.joinable())
+        {
+            reactor->thread.join();
+        }
     }
     m_task_queue->Stop();
+    m_clock.Stop();
+    if (m_metrics_listener)
+    {
+        m_metrics_listener->Stop();
+    }
+    for (auto& reactor : m_reactors)
+    {
+        if (m_is_handed_over.load())
+        {
+            reactor->listeners.Release();
+        }
+        CloseReactor(*reactor);
+    }
+    m_connections->ForEachOpen([](Connection& connection) {
+        shutdown(connection.socket, SHUT_RDWR);
+        close(connection.socket);
+    });
     LOG(m_logger, LogHelper::info, "Server closed");
 }
 
-void TCPUPDServer::Init(int port, unsigned int max_events)
+void TCPUPDServer::Drain()
 {
-    m_max_events = max_events;
-    m_tcp_socket = socket(AF_INET, SOCK_STREAM, 0);
-    m_udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    
-    if (m_tcp_socket < 0 || m_udp_socket < 0) 
+    std::unique_lock lock(m_drain_mutex);
+    if (m_is_drained || !m_server_run.load() || m_config.drain_timeout_ms == 0)
     {
-        throw std::runtime_error("socket creating error");
+        return;
     }
-    int reuse = 1;
-
-    if (setsockopt(m_tcp_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) 
+    m_is_drained = true;
+    for (auto& reactor : m_reactors)
     {
-        close(m_tcp_socket);
-        close(m_udp_socket);
-        throw std::runtime_error("reuse failed");
+        reactor->backend->Drain();
     }
-
-    m_epoll_fd = epoll_create1(0);
-    if (m_epoll_fd < 0)
+    LOG(m_logger, LogHelper::info, "Draining " << m_connections->Size() << " connections for up to " << m_config.drain_timeout_ms << " ms");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config.drain_timeout_ms);
+    while (m_connections->Size() > 0 && std::chrono::steady_clock::now() < deadline)
     {
-        close(m_tcp_socket);
-        close(m_udp_socket);
-        throw std::runtime_error("epoll creation error");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
     }
-
-    m_shutdown_event_fd = eventfd(0, EFD_NONBLOCK);
-    AddSocketToEpoll(m_shutdown_event_fd, EPOLL_CTL_ADD);
-
-    sockaddr_in address;
-    memset(&address, 0, sizeof(address));
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
-    
-    if (bind(m_tcp_socket, (sockaddr*)&address, sizeof(address)) < 0 || bind(m_udp_socket, (sockaddr*)&address, sizeof(address)) < 0)
+    size_t remaining = m_connections->Size();
+    if (remaining > 0)
     {
-        throw std::runtime_error("bind address error");
+        LOG(m_logger, LogHelper::warning, "Drain timed out, closing " << remaining << " busy connections");
     }
-
-    if (listen(m_tcp_socket, 3) < 0)
+    else
     {
-        throw std::runtime_error("listen tcp error");
+        LOG(m_logger, LogHelper::info, "All connections drained");
     }
+}
 
-    int flags = fcntl(m_tcp_socket, F_GETFL, 0);
-    fcntl(m_tcp_socket, F_SETFL, flags | O_NONBLOCK);
+void TCPUPDServer::Init(const ServerConfig& config)
+{
+    m_config = config;
+    m_commands.Build();
+    m_command_latency = std::make_unique<Histogram[]>(m_commands.Size());
+    m_rate_limiter = std::make_unique<RateLimiter>(m_config.rate_limit_sources);
+    m_rate_limiter->Configure(m_config.rate_limit, m_config.rate_burst);
+    m_task_queue = std::make_unique<ThreadPoolQueue>(m_config.queue_capacity);
+    m_task_queue->SetOverloadPolicy(m_config.overload_policy);
+    if (m_config.metrics_port != 0)
+    {
+        m_metrics_listener = std::make_unique<MetricsListener>(PrometheusText::content_type, [this](std::string& output) {
+            AppendMetrics(output);
+        });
+        m_metrics_listener->Open(static_cast<int>(m_config.metrics_port));
+    }
+    m_is_sharded = m_config.shards_count > 0;
+    m_buffer_pool = std::make_unique<BufferPool>(m_config.read_buffer_size);
+    m_connections = std::make_unique<ConnectionTable>(*m_buffer_pool, ConnectionTable::DefaultCapacity());
+    std::vector<ListenerHandover::Socket> inherited;
+    if (!m_config.handover_path.empty())
+    {
+        inherited = m_handover.Receive(m_config.handover_path);
+    }
+    unsigned int reactors_count = m_is_sharded ? m_config.shards_count : 1;
+    for (unsigned int i = 0; i < reactors_count; ++i)
+    {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->id = i;
+        reactor->connections = m_connections.get();
+        InitReactor(*reactor, m_is_sharded, inherited);
+        m_reactors.push_back(std::move(reactor));
+    }
+    for (const ListenerHandover::Socket& socket : inherited)
+    {
+        if (socket.socket >= 0)
+        {
+            LOG(m_logger, LogHelper::warning, "Inherited listener " << socket.endpoint << " is not configured, closed");
+            close(socket.socket);
+        }
+    }
 
-    flags = fcntl(m_udp_socket, F_GETFL, 0);
-    fcntl(m_udp_socket, F_SETFL, flags | O_NONBLOCK);
+    std::string endpoints;
+    for (const Endpoint& endpoint : m_config.endpoints)
+    {
+        endpoints.append(endpoints.empty() ? "" : ", ").append(endpoint.ToString(m_config.port));
+    }
+    LOG(m_logger, LogHelper::info, "Server started on " << endpoints << " with " << reactors_count << (m_is_sharded ? " reactor shards" : " reactor")
+        << " on " << (m_config.io_backend == IoBackendType::IoUring ? "io_uring" : "epoll"));
+}
 
-    AddSocketToEpoll(m_tcp_socket, EPOLLIN | EPOLLET);
-    AddSocketToEpoll(m_udp_socket, EPOLLIN);
+void TCPUPDServer::InitReactor(Reactor& reactor, bool reuse_port, std::vector<ListenerHandover::Socket>& inherited)
+{
+    try
+    {
+        // reactors share IP endpoints through SO_REUSEPORT, a Unix path can only be bound once
+        reactor.listeners.Open(m_config, reuse_port, reactor.id == 0, inherited);
+        reactor.backend = CreateBackend(reactor);
+    }
+    catch (const std::exception&)
+    {
+        CloseReactor(reactor);
+        throw;
+    }
+}
 
-    LOG(m_logger, LogHelper::info, "Server started on port " << port);
+std::unique_ptr<IoBackend> TCPUPDServer::CreateBackend(Reactor& reactor)
+{
+    if (m_config.io_backend == IoBackendType::IoUring)
+    {
+        try
+        {
+            auto backend = std::make_unique<UringBackend>(reactor, *this, m_metrics, m_config);
+            backend->Init();
+            return backend;
+        }
+        catch (const std::exception& err)
+        {
+            LOG(m_logger, LogHelper::warning, "io_uring backend is unavailable, falling back to epoll: " << err.what());
+            m_config.io_backend = IoBackendType::Epoll;
+        }
+    }
+    auto backend = std::make_unique<EpollBackend>(reactor, *this, m_metrics, m_config, m_is_sharded ? nullptr : m_task_queue.get());
+    backend->Init();
+    return backend;
 }
 
-void TCPUPDServer::AddSocketToEpoll(unsigned int client_socket, uint32_t events)
+void TCPUPDServer::CloseReactor(Reactor& reactor)
 {
-    epoll_event event;
-    event.events = events;
-    event.data.fd = client_socket;
-    
-    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1) 
+    if (reactor.backend)
     {
-        throw std::runtime_error("epoll_ctl add error");
+        reactor.backend->Close();
     }
+    reactor.listeners.Close();
 }
 
-void TCPUPDServer::ListenAsync(unsigned int max_threads)
+void TCPUPDServer::ListenAsync()
 {
+    m_clock.Start();
     m_server_run = true;
-    
-    m_task_queue->startAsync(max_threads);
-    m_server_thread = std::thread([this] {
-        epoll_event events[m_max_events];
-        while(m_server_run.load())
+
+    if (!m_is_sharded && m_config.io_backend == IoBackendType::Epoll)
+    {
+        m_task_queue->SetWaitHistogram(&m_metrics.Get(Distribution::QueueWait));
+        m_task_queue->startAsync(m_config.max_threads);
+    }
+    if (m_metrics_listener)
+    {
+        m_metrics_listener->Start();
+    }
+    unsigned int cpus_count = std::max(1u, std::thread::hardware_concurrency());
+    for (auto& reactor : m_reactors)
+    {
+        reactor->thread = std::thread(&IoBackend::Run, reactor->backend.get());
+        if (m_is_sharded && m_config.pin_shards)
         {
-            int num_events = epoll_wait(m_epoll_fd, events, m_max_events, -1);
-            if (num_events == -1) 
-            {
-                LOG(m_logger, LogHelper::error, "Error while epoll wait");
-                continue;
-            }
+            PinThread(reactor->thread, reactor->id % cpus_count);
+        }
+    }
+    if (!m_config.handover_path.empty())
+    {
+        // the socket file is replaced before the previous server hears it may go, so it never leaves one behind
+        m_handover.Open(m_config.handover_path);
+        m_handover.Confirm();
+        m_handover.Start([this] { return CollectListeners(); }, [this] {
+            m_is_handed_over.store(true);
+            RequestShutdown();
+        });
+    }
+}
 
-            for (int i = 0; i < num_events; ++i) 
+std::vector<ListenerHandover::Socket> TCPUPDServer::CollectListeners() const
+{
+    std::vector<ListenerHandover::Socket> sockets;
+    for (const auto& reactor : m_reactors)
+    {
+        for (const auto* listeners : {&reactor->listeners.Streams(), &reactor->listeners.Datagrams()})
+        {
+            for (const ListenerSet::Listener& listener : *listeners)
             {
-                if (!m_server_run.load())
-                {
-                    break;
-                }
-                int fd = events[i].data.fd;
-                uint32_t event_flag = events[i].events;
-                if (event_flag & (m_error_mask))
-                {
-                    if (fd != m_tcp_socket && fd != m_udp_socket && fd != m_shutdown_event_fd) 
-                    {
-                        CloseSocket(fd);
-                        continue;
-                    }
-                }
-
-                if (fd == m_tcp_socket)
-                {
-                    m_task_queue->Push(std::bind(&TCPUPDServer::HandleNewTCPConnection, this));
-                } 
-                else if (fd == m_udp_socket) 
-                {
-                    m_task_queue->Push(std::bind(&TCPUPDServer::HandleUDPData, this));
-                }
-                else if (fd == m_shutdown_event_fd)
-                {
-                    uint64_t value;
-                    read(m_shutdown_event_fd, &value, sizeof(value));
-                    break;
-                }
-                else 
-                {
-                    {
-                        std::shared_lock lock(m_set_mutex);
-                        auto it = m_client_sockets.find(fd);
-                        if (it == m_client_sockets.end())
-                        {
-                            LOG(m_logger, LogHelper::warning, "Unknow descriptor " << fd);
-                            epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-                            continue;
-                        }
-                    }
-                    m_task_queue->Push(std::bind(&TCPUPDServer::HandleTCPClientData, this, fd));
-                }
+                sockets.push_back({listener.endpoint, listener.socket});
             }
         }
-    });
+    }
+    return sockets;
 }
 
-void TCPUPDServer::HandleNewTCPConnection()
+void TCPUPDServer::Reload(const ServerConfig& config)
 {
-    while (m_server_run.load())
+    if (!m_server_run.load())
     {
-        sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_socket = accept(m_tcp_socket, (sockaddr*)&client_addr, &client_len);
-        
-        if (client_socket == -1) 
+        return;
+    }
+    for (auto& reactor : m_reactors)
+    {
+        reactor->backend->Reload(config);
+    }
+    m_rate_limiter->Configure(config.rate_limit, config.rate_burst);
+    m_task_queue->SetOverloadPolicy(config.overload_policy);
+    bool has_pool = !m_is_sharded && m_config.io_backend == IoBackendType::Epoll;
+    if (has_pool && config.max_threads != m_config.max_threads)
+    {
+        m_config.max_threads = m_task_queue->Resize(config.max_threads);
+        LOG(m_logger, LogHelper::info, "Thread pool resized to " << m_config.max_threads << " workers");
+    }
+    LOG(m_logger, LogHelper::info, "Timeouts idle/read/write: " << config.idle_timeout_ms << "/" << config.read_timeout_ms << "/"
+        << config.write_timeout_ms << " ms, rate limit " << config.rate_limit << "/s per source with burst " << config.rate_burst);
+}
+
+void TCPUPDServer::PinThread(std::thread& thread, unsigned int cpu)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    int result = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+    if (result != 0)
+    {
+        LOG(m_logger, LogHelper::warning, "Failed to pin reactor thread to cpu " << cpu << ": " << strerror(result));
+    }
+}
+
+bool TCPUPDServer::IsRunning() const
+{
+    return m_server_run.load();
+}
+
+Connection* TCPUPDServer::OnAccept(Reactor& reactor, int client_socket)
+{
+    // accepts are never shed: one shed accept task would close the whole backlog, and accepting is cheap
+    uint64_t source = 0;
+    if (m_rate_limiter->IsEnabled())
+    {
+        sockaddr_storage address {};
+        socklen_t length = sizeof(address);
+        if (getpeername(client_socket, reinterpret_cast<sockaddr*>(&address), &length) == 0)
         {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) 
-            {
-                break;
-            }
-            else 
-            {
-                LOG(m_logger, LogHelper::error, "Error while accepting new tcp client: " << strerror(errno));
-                break;
-            }
+            source = RateLimiter::SourceKey(address);
         }
-        
-        int flags = fcntl(client_socket, F_GETFL, 0);
-        fcntl(client_socket, F_SETFL, flags | O_NONBLOCK);
-        
-        int enable_keepalive = 1;
-        setsockopt(client_socket, SOL_SOCKET, SO_KEEPALIVE, &enable_keepalive, sizeof(enable_keepalive));
-        
-        int do_nothing_sec = 30;
-        int interval_sec = 5;
-        int count = 3;
-        
-        setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPIDLE, &do_nothing_sec, sizeof(do_nothing_sec));
-        setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPINTVL, &interval_sec, sizeof(interval_sec));
-        setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
-            
-        AddSocketToEpoll(client_socket, EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP);
+        if (!m_rate_limiter->Allow(source))
         {
-            std::unique_lock lock(m_set_mutex);
-            m_client_sockets.insert(client_socket);
+            LOG(m_logger, LogHelper::debug, "Rate limited TCP connection " << client_socket);
+            m_metrics.Add(Counter::TcpRateLimited);
+            return nullptr;
         }
-        LOG(m_logger, LogHelper::info, "New TCP Connection " << client_socket);
-        ++m_clients_count;
     }
+    Connection* connection = reactor.connections->Open(client_socket);
+    if (connection == nullptr)
+    {
+        LOG(m_logger, LogHelper::warning, "Rejected TCP connection " << client_socket << ", descriptor is out of the connection table");
+        m_metrics.Add(Counter::TcpErrors);
+        return nullptr;
+    }
+
+    connection->source = source;
+    connection->reactor = reactor.id;
+    LOG(m_logger, LogHelper::debug, "New TCP Connection " << client_socket << " on reactor " << reactor.id);
+    m_metrics.Add(Counter::TcpAccepts);
+    return connection;
 }
 
-void TCPUPDServer::HandleTCPClientData(unsigned int client_socket)
+bool TCPUPDServer::OnTCPData(Connection& connection, bool is_drained, OutputQueue& responses)
 {
-    if (!m_server_run.load()) 
+    ReadBuffer& read_buffer = connection.read_buffer;
+    if (connection.is_command_running.load())
     {
-        return;
+        // the requests wait for the command, it resumes reading when it returns
+        return true;
     }
-    char buffer[m_buffer_size];
-    ssize_t total_bytes_read = 0;
-    bool is_closed = false;
-    while (m_server_run.load())
+    if (m_config.framing == FramingMode::Raw && !is_drained && read_buffer.Size() < m_config.max_message_size)
     {
-        ssize_t bytes_read = recv(client_socket, buffer + total_bytes_read, m_buffer_size - 1, 0);
-        if (bytes_read > 0)
+        return true;
+    }
+    std::string& text = t_response_text;
+    text.clear();
+    // Frames are consumed only at the end: a run of echoed frames is answered by the frame bytes themselves,
+    // [echo_begin, echo_begin + echo_size) of the unconsumed data.
+    size_t parsed = 0;
+    size_t echo_begin = 0;
+    size_t echo_size = 0;
+    auto flush_echo = [&] {
+        if (echo_size == 0)
         {
-            total_bytes_read += bytes_read;
-            if (total_bytes_read >= m_buffer_size - 1)
-            {
-                total_bytes_read = m_buffer_size - 1;
-                LOG(m_logger, LogHelper::warning, "Buffer is overflowed for client " << client_socket);
-                break;
-            }
+            return;
         }
-        else if (bytes_read == 0)
+        if (m_config.zerocopy_threshold == 0 || echo_size < m_config.zerocopy_threshold)
         {
-            is_closed = true;
-            break;
+            text.append(read_buffer.Data().substr(echo_begin, echo_size));
         }
         else
         {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-            {
-                break;
-            }
-            else 
+            // large runs leave in the block they were read into
+            responses.PushCopy(text);
+            text.clear();
+            read_buffer.Consume(echo_begin);
+            size_t offset = 0;
+            PooledBuffer block = read_buffer.Detach(echo_size, offset);
+            responses.Push(std::move(block), offset, offset + echo_size);
+            parsed = 0;
+        }
+        echo_size = 0;
+    };
+    bool is_open = true;
+    while (parsed < read_buffer.Size())
+    {
+        std::string_view message;
+        size_t consumed = 0;
+        FrameStatus status = Framing::Next(m_config.framing, read_buffer.Data().substr(parsed), m_config.max_message_size, message, consumed);
+        if (status == FrameStatus::Incomplete)
+        {
+            break;
+        }
+        if (status == FrameStatus::Oversized)
+        {
+            LOG(m_logger, LogHelper::warning, "Message exceeds " << m_config.max_message_size << " bytes for client " << connection.socket);
+            m_metrics.Add(Counter::TcpErrors);
+            is_open = false;
+            break;
+        }
+        LOG(m_logger, LogHelper::debug, "New message from client " << connection.socket << " : " << message);
+        m_metrics.Add(Counter::TcpMessages);
+        if (std::optional<std::string_view> refusal = RefuseTCP(connection))
+        {
+            flush_echo();
+            if (!refusal->empty())
             {
-                LOG(m_logger, LogHelper::error, "Reading error: " << strerror(errno) << " for client " << client_socket);
-                is_closed = true;
-                break;
+                size_t frame_start = Framing::BeginFrame(m_config.framing, text);
+                if (BinaryProtocol::IsBatch(message))
+                {
+                    BinaryProtocol::AppendRefusal(message, *refusal == busy_reply ? BinaryProtocol::Status::Busy :
+                        BinaryProtocol::Status::RateLimited, text);
+                }
+                else
+                {
+                    text.append(*refusal);
+                }
+                Framing::EndFrame(m_config.framing, text, frame_start);
             }
+            parsed += consumed;
+            continue;
+        }
+        if (IsEcho(message) && !message.empty() && Framing::IsVerbatim(m_config.framing, message, consumed))
+        {
+            echo_begin = echo_size == 0 ? parsed : echo_begin;
+            echo_size += consumed;
+            parsed += consumed;
+            continue;
+        }
+        flush_echo();
+        size_t frame_start = Framing::BeginFrame(m_config.framing, text);
+        CommandStream stream {&connection, connection.generation.load(), m_reactors[connection.reactor]->backend.get(),
+            m_config.framing, m_config.max_message_size, &responses, &frame_start};
+        parsed += consumed;
+        if (PrepareAnswer(message, text, stream))
+        {
+            // the command sent the replies so far, the rest of the input waits for it
+            break;
         }
+        Framing::EndFrame(m_config.framing, text, frame_start);
     }
+    flush_echo();
+    read_buffer.Consume(parsed);
+    responses.PushCopy(text);
+    return is_open;
+}
 
-    if (!m_server_run.load())
+std::optional<std::string_view> TCPUPDServer::RefuseTCP(const Connection& connection)
+{
+    OverloadPolicy shed = ThreadPoolQueue::ShedPolicy();
+    if (shed != OverloadPolicy::Run)
     {
-        return;
+        m_metrics.Add(Counter::TcpShed);
+        return shed == OverloadPolicy::Reject ? busy_reply : std::string_view();
     }
-
-    if (is_closed)
+    if (connection.source != 0 && !m_rate_limiter->Allow(connection.source))
     {
-        CloseSocket(client_socket);
-        return;
+        m_metrics.Add(Counter::TcpRateLimited);
+        return rate_limited_reply;
     }
+    return std::nullopt;
+}
 
-    if (total_bytes_read > 0)
+bool TCPUPDServer::IsEcho(std::string_view message) const
+{
+    return !message.starts_with("/") && !BinaryProtocol::MayBeBatch(message);
+}
+
+void TCPUPDServer::OnUDPData(const sockaddr_storage& source, std::string_view message, std::string& response)
+{
+    LOG(m_logger, LogHelper::debug, "Received message to UPD socket : " << message);
+    m_metrics.Add(Counter::UdpMessages);
+    OverloadPolicy shed = ThreadPoolQueue::ShedPolicy();
+    if (shed != OverloadPolicy::Run)
     {
-        buffer[total_bytes_read] = '\0';
-        std::string_view message(buffer, total_bytes_read);
-        LOG(m_logger, LogHelper::info, "New message from client " << client_socket << " : " << message);
-        std::string response = PrepareAnswer(message);
-        if (response.size() != 0)
+        m_metrics.Add(Counter::UdpShed);
+        if (shed == OverloadPolicy::Reject && BinaryProtocol::IsBatch(message))
         {
-            if (send(client_socket, response.c_str(), response.size(), 0) == -1) 
-            {
-                LOG(m_logger, LogHelper::error, "Error while sending message " << response << " to TCP client " << client_socket);
-            }
+            BinaryProtocol::AppendRefusal(message, BinaryProtocol::Status::Busy, response);
+        }
+        else if (shed == OverloadPolicy::Reject)
+        {
+            response.append(busy_reply);
         }
+        return;
+    }
+    // no reply, it would let spoofed senders aim the server at someone else
+    if (m_rate_limiter->IsEnabled() && !m_rate_limiter->Allow(RateLimiter::SourceKey(source)))
+    {
+        m_metrics.Add(Counter::UdpRateLimited);
+        return;
     }
+    PrepareAnswer(message, response);
 }
 
-void TCPUPDServer::CloseSocket(unsigned int client_socket)
+bool TCPUPDServer::OnClose(Reactor& reactor, Connection& connection, uint32_t generation)
 {
-    close(client_socket);
+    if (!reactor.connections->Close(connection, generation))
     {
-        std::unique_lock lock(m_set_mutex);
-        m_client_sockets.erase(client_socket);
+        return false;
     }
-    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, client_socket, nullptr);
-    LOG(m_logger, LogHelper::info, "Closed connection for client " << client_socket);
+    m_metrics.Add(Counter::TcpCloses);
+    LOG(m_logger, LogHelper::debug, "Closed connection for client " << connection.socket);
+    return true;
 }
 
-std::string TCPUPDServer::PrepareAnswer(std::string_view response)
+void TCPUPDServer::RegisterCommand(std::string_view name, CommandRegistry::Handler&& handler)
 {
-    if (!response.starts_with("/"))
-    {
-        return response.data();
-    }
-    else
-    {
-        if (response == "/time")
+    m_commands.Register(name, std::move(handler));
+}
+
+void TCPUPDServer::RegisterAsyncCommand(std::string_view name, CommandRegistry::AsyncHandler&& handler)
+{
+    m_commands.RegisterAsync(name, std::move(handler));
+}
+
+void TCPUPDServer::RegisterBuiltinCommands()
+{
+    m_commands.Register("/time", [this](std::string_view, std::string& output) {
+        m_clock.Append(ClockService::Format::Local, output);
+    });
+    m_commands.Register("/time_ms", [this](std::string_view, std::string& output) {
+        m_clock.Append(ClockService::Format::LocalMs, output);
+    });
+    m_commands.Register("/time_utc", [this](std::string_view, std::string& output) {
+        m_clock.Append(ClockService::Format::Utc, output);
+    });
+    m_commands.Register("/time_utc_ms", [this](std::string_view, std::string& output) {
+        m_clock.Append(ClockService::Format::UtcMs, output);
+    });
+    m_commands.Register("/stats", [this](std::string_view, std::string& output) {
+        AppendStats(output);
+    });
+    // "/watch [count] [interval_ms]": the /stats line count times, 0 for as long as the client stays
+    m_commands.RegisterAsync("/watch", [this](std::string_view args, CommandContext& context) -> AsyncTask<> {
+        uint64_t count = 10;
+        uint64_t interval_ms = 1000;
+        for (uint64_t* value : {&count, &interval_ms})
         {
-            LOG(m_logger, LogHelper::info, "Received time command");
-            auto now = std::chrono::system_clock::now();
-            auto time_t = std::chrono::system_clock::to_time_t(now);
-            std::tm tm;
-            localtime_r(&time_t, &tm);
-            
-            char time_buffer[20];
-            std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", &tm);
-            return std::string(time_buffer);
+            args.remove_prefix(std::min(args.find_first_not_of(' '), args.size()));
+            std::from_chars(args.data(), args.data() + args.size(), *value);
+            args.remove_prefix(std::min(args.find(' '), args.size()));
         }
-        else if (response == "/stats")
+        for (uint64_t line = 1; ; ++line)
         {
-            LOG(m_logger, LogHelper::info, "Received stats command");
-            return "Total clients: " + m_clients_count.Get() + ". Active clients: " + std::to_string(m_client_sockets.size());
+            AppendStats(context.Output());
+            if (line == count || !co_await context.Flush() || !co_await context.SleepFor(interval_ms))
+            {
+                break;
+            }
         }
-        else if (response == "/shutdown")
+    });
+    m_commands.Register("/pools", [](std::string_view, std::string& output) {
+        SlabAllocator::Stats stats = SlabAllocator::GetStats();
+        uint64_t basis_points = static_cast<uint64_t>(stats.HitRate() * 10000);
+        output.append("Slab hit rate: ");
+        AppendNumber(output, basis_points / 100);
+        output.push_back('.');
+        output.push_back(static_cast<char>('0' + basis_points / 10 % 10));
+        output.push_back(static_cast<char>('0' + basis_points % 10));
+        output.append("%. Oversized: ");
+        AppendNumber(output, stats.oversized);
+        output.append(". Hits/misses/remote frees per block size:");
+        const char* separator = " ";
+        for (const SlabAllocator::ClassStats& entry : stats.classes)
         {
-            LOG(m_logger, LogHelper::info, "Received shutdown command");
-            
-            if (m_shutdown_callback)
+            if (entry.hits + entry.misses == 0)
             {
-                m_is_shutdown.store(true);
-                m_shutdown_cv.notify_all();
-                {
-                    std::unique_lock lock(m_callback_mutex);
-                    m_shutdown_callback();
-                }
+                continue;
             }
-            return std::string();
+            output.append(separator);
+            separator = ", ";
+            AppendNumber(output, entry.block_size);
+            output.append(": ");
+            AppendNumber(output, entry.hits);
+            output.push_back('/');
+            AppendNumber(output, entry.misses);
+            output.push_back('/');
+            AppendNumber(output, entry.remote_frees);
         }
-        else
+    });
+    m_commands.Register("/metrics", [this](std::string_view, std::string& output) {
+        AppendMetrics(output);
+    });
+    m_commands.Register("/shutdown", [this](std::string_view, std::string&) {
+        LOG(m_logger, LogHelper::info, "Received shutdown command");
+        RequestShutdown();
+    });
+}
+
+void TCPUPDServer::RequestShutdown()
+{
+    if (m_shutdown_callback)
+    {
+        m_is_shutdown.store(true);
+        m_shutdown_cv.notify_all();
         {
-            LOG(m_logger, LogHelper::warning, "Received unknow command " << response);
-            return "Unknow command";
+            std::unique_lock lock(m_callback_mutex);
+            m_shutdown_callback();
         }
     }
 }
 
-void TCPUPDServer::HandleUDPData()
+bool TCPUPDServer::PrepareAnswer(std::string_view message, std::string& output, const CommandStream& stream)
 {
-    if (!m_server_run.load()) 
+    if (BinaryProtocol::IsBatch(message))
     {
-        return;
+        AnswerBinary(message, output);
+        return false;
+    }
+    if (!message.starts_with("/"))
+    {
+        output.append(message);
+        return false;
     }
-    
-    char buffer[1024];
-    sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    ssize_t bytes_recv = recvfrom(m_udp_socket, buffer, sizeof(buffer), 0, (sockaddr*)&client_addr, &client_len);
-    
-    if (bytes_recv < 0) 
+    CommandStatus status = RunCommand(message, output, stream);
+    if (status == CommandStatus::Unknown)
     {
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        LOG(m_logger, LogHelper::warning, "Received unknow command " << message);
+        output.append("Unknow command");
+    }
+    return status == CommandStatus::Running;
+}
+
+TCPUPDServer::CommandStatus TCPUPDServer::RunCommand(std::string_view message, std::string& output, const CommandStream& stream)
+{
+    // "/name arguments", the handler gets everything after the first space
+    size_t space = message.find(' ');
+    std::string_view name = message.substr(0, space);
+    std::string_view args = space == std::string_view::npos ? std::string_view() : message.substr(space + 1);
+    int32_t index = m_commands.FindIndex(name);
+    if (index < 0)
+    {
+        return CommandStatus::Unknown;
+    }
+    LOG(m_logger, LogHelper::debug, "Received command " << name);
+    if (!m_commands.IsAsync(index))
+    {
+        uint64_t start = NowNs();
+        try
         {
-            return;
+            m_commands.HandlerAt(index)(args, output);
         }
-        else 
+        catch (const std::exception& error)
         {
-            LOG(m_logger, LogHelper::error, "UDP recvfrom error: " << strerror(errno));
-            return;
+            LOG(m_logger, LogHelper::error, "Command " << name << " failed: " << error.what());
         }
+        m_command_latency[index].Record(NowNs() - start);
+        return CommandStatus::Done;
     }
-    
-    if (!m_server_run.load()) 
+    AsyncTask<> task = ServeCommand(index, args, output, stream);
+    return task.Start() ? CommandStatus::Done : CommandStatus::Running;
+}
+
+// The frame of a suspended command frees itself when the handler returns. Its service time runs until then.
+AsyncTask<> TCPUPDServer::ServeCommand(int32_t index, std::string_view args, std::string& output, CommandStream stream)
+{
+    uint64_t start = NowNs();
+    // args points into the read buffer, which the caller consumes once the command suspends
+    std::string arguments(args);
+    CommandContext context(output, stream);
+    try
     {
-        return;
+        co_await m_commands.AsyncHandlerAt(index)(arguments, context);
+    }
+    catch (const std::exception& error)
+    {
+        LOG(m_logger, LogHelper::error, "Command " << m_commands.NameAt(index) << " failed: " << error.what());
     }
+    context.Finish();
+    m_command_latency[index].Record(NowNs() - start);
+}
 
-    buffer[bytes_recv] = '\0'; 
-    std::string_view message(buffer, bytes_recv);
-    LOG(m_logger, LogHelper::info, "Received message to UPD socket : " << message);
-    
-    if (bytes_recv > 0) 
+// Responses are written straight into output in request order; a truncated request ends the batch with a
+// Malformed entry, the requests before it are answered.
+void TCPUPDServer::AnswerBinary(std::string_view batch, std::string& output)
+{
+    output.append(BinaryProtocol::magic);
+    batch.remove_prefix(BinaryProtocol::magic.size());
+    BinaryProtocol::Header header;
+    std::string_view payload;
+    uint64_t requests_count = 0;
+    while (!batch.empty())
     {
-        std::string response = PrepareAnswer(message);
-        if (response.size() != 0)
+        if (!BinaryProtocol::Next(batch, header, payload))
         {
-            if (sendto(m_udp_socket, response.c_str(), response.size(), 0, (sockaddr*)&client_addr, client_len) == -1)
-            {
-                LOG(m_logger, LogHelper::info, "Error while sending message " << response << " to UPD client ");
-            }
+            LOG(m_logger, LogHelper::warning, "Malformed binary batch, " << batch.size() << " bytes left after " << requests_count << " requests");
+            BinaryProtocol::EndResponse(output, BinaryProtocol::BeginResponse(output, 0, 0), BinaryProtocol::Status::Malformed);
+            break;
+        }
+        ++requests_count;
+        size_t position = BinaryProtocol::BeginResponse(output, header.request_id, header.opcode);
+        BinaryProtocol::Status status = AnswerBinaryRequest(static_cast<BinaryProtocol::Opcode>(header.opcode), payload, output);
+        BinaryProtocol::EndResponse(output, position, status);
+    }
+    m_metrics.Add(Counter::BinaryRequests, requests_count);
+}
+
+BinaryProtocol::Status TCPUPDServer::AnswerBinaryRequest(BinaryProtocol::Opcode opcode, std::string_view payload, std::string& output)
+{
+    switch (opcode)
+    {
+    case BinaryProtocol::Opcode::Echo:
+        output.append(payload);
+        return BinaryProtocol::Status::Ok;
+    case BinaryProtocol::Opcode::Time:
+        BinaryProtocol::AppendLittle(output, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()));
+        return BinaryProtocol::Status::Ok;
+    case BinaryProtocol::Opcode::Stats:
+    {
+        MetricsSnapshot snapshot = m_metrics.Snapshot();
+        BinaryProtocol::AppendLittle(output, static_cast<uint16_t>(Counter::Count));
+        BinaryProtocol::AppendLittle(output, static_cast<uint16_t>(Gauge::Count));
+        for (unsigned int i = 0; i < static_cast<unsigned int>(Counter::Count); ++i)
+        {
+            BinaryProtocol::AppendLittle(output, snapshot.Get(static_cast<Counter>(i)));
+        }
+        for (unsigned int i = 0; i < static_cast<unsigned int>(Gauge::Count); ++i)
+        {
+            BinaryProtocol::AppendLittle(output, static_cast<int64_t>(snapshot.Get(static_cast<Gauge>(i))));
         }
+        return BinaryProtocol::Status::Ok;
     }
+    case BinaryProtocol::Opcode::Command:
+        return payload.starts_with("/") && RunCommand(payload, output) != CommandStatus::Unknown ? BinaryProtocol::Status::Ok :
+            BinaryProtocol::Status::UnknownCommand;
+    }
+    return BinaryProtocol::Status::UnknownOpcode;
+}
+
+void TCPUPDServer::AppendStats(std::string& output) const
+{
+    MetricsSnapshot stats = m_metrics.Snapshot();
+    output.append("Total clients: ");
+    AppendNumber(output, stats.Get(Counter::TcpAccepts));
+    output.append(". Active clients: ");
+    AppendNumber(output, stats.Get(Gauge::TcpConnections));
+    output.append(". TCP messages: ");
+    AppendNumber(output, stats.Get(Counter::TcpMessages));
+    output.append(", bytes in/out: ");
+    AppendNumber(output, stats.Get(Counter::TcpBytesIn));
+    output.push_back('/');
+    AppendNumber(output, stats.Get(Counter::TcpBytesOut));
+    output.append(", errors: ");
+    AppendNumber(output, stats.Get(Counter::TcpErrors));
+    output.append(". UDP messages: ");
+    AppendNumber(output, stats.Get(Counter::UdpMessages));
+    output.append(", bytes in/out: ");
+    AppendNumber(output, stats.Get(Counter::UdpBytesIn));
+    output.push_back('/');
+    AppendNumber(output, stats.Get(Counter::UdpBytesOut));
+    output.append(", errors: ");
+    AppendNumber(output, stats.Get(Counter::UdpErrors));
+}
+
+void TCPUPDServer::AppendMetrics(std::string& output) const
+{
+    PrometheusText text(output);
+    MetricsSnapshot snapshot = m_metrics.Snapshot();
+    std::string name;
+    for (unsigned int i = 0; i < static_cast<unsigned int>(Counter::Count); ++i)
+    {
+        auto counter = static_cast<Counter>(i);
+        name.assign("server_").append(Metrics::Name(counter)).append("_total");
+        text.Family(name, "counter", Metrics::Help(counter));
+        text.Sample(name, {}, snapshot.Get(counter));
+    }
+    for (unsigned int i = 0; i < static_cast<unsigned int>(Gauge::Count); ++i)
+    {
+        auto gauge = static_cast<Gauge>(i);
+        name.assign("server_").append(Metrics::Name(gauge));
+        text.Family(name, "gauge", Metrics::Help(gauge));
+        text.Sample(name, {}, snapshot.Get(gauge));
+    }
+
+    text.Family("server_command_duration_seconds", "histogram", "Time spent in command handlers.");
+    std::string labels;
+    for (size_t i = 0; i < m_commands.Size(); ++i)
+    {
+        labels.clear();
+        PrometheusText::AppendLabel(labels, "command", m_commands.NameAt(i));
+        text.HistogramSamples("server_command_duration_seconds", labels, m_command_latency[i].Read(), ns_per_second);
+    }
+    text.Family("server_queue_wait_seconds", "histogram", "Time requests waited in the thread pool queue.");
+    text.HistogramSamples("server_queue_wait_seconds", {}, m_metrics.Get(Distribution::QueueWait).Read(), ns_per_second);
+    text.Family("server_reactor_batch_size", "histogram", "Events returned by one epoll wait or completions reaped in one io_uring pass.");
+    text.HistogramSamples("server_reactor_batch_size", {}, m_metrics.Get(Distribution::ReactorBatch).Read(), 1.0);
 }
 
 void TCPUPDServer::SetShutdownCallback(ShutdownCallback&& callback)
@@ -420,7 +806,8 @@ void TCPUPDServer::SetShutdownCallback(ShutdownCallback&& callback)
                     return m_is_shutdown.load();
                 });
             }
+            Drain();
             Stop();
         });
     });
-}
\ No newline at end of file
+}
@@ -1,53 +1,124 @@
 #pragma once
 
+#include <netinet/in.h>
+
 #include <thread>
-#include <set>
+#include <vector>
+#include <memory>
 #include <shared_mutex>
 #include <atomic>
 #include <string_view>
 #include <condition_variable>
 #include <mutex>
+#include <functional>
+#include <optional>
 
 #include "ThreadPoolQueue.h"
+#include "CommandRegistry.h"
+#include "CommandContext.h"
+#include "ClockService.h"
 #include "../logging/Logging.h"
-#include "StringCounter.h"
+#include "Metrics.h"
+#include "ServerConfig.h"
+#include "Reactor.h"
+#include "BufferPool.h"
+#include "SlabAllocator.h"
+#include "ConnectionTable.h"
+#include "IoBackend.h"
+#include "Histogram.h"
+#include "MetricsListener.h"
+#include "RateLimiter.h"
+#include "BinaryProtocol.h"
+#include "ListenerHandover.h"
 
-class TCPUPDServer 
+class TCPUPDServer : public IoHandler
 {
 public:
     using ShutdownCallback = std::function<void()>;
     TCPUPDServer();
     ~TCPUPDServer();
-    void Init(int port, unsigned int max_events = 64);
-    void ListenAsync(unsigned int max_threads = 4);
+    void Init(const ServerConfig& config);
+    void ListenAsync();
     void SetShutdownCallback(ShutdownCallback&& callback);
+    // Adds a "/name" command; only before Init.
+    void RegisterCommand(std::string_view name, CommandRegistry::Handler&& handler);
+    // Adds a command that streams its reply or waits, see CommandContext; only before Init.
+    void RegisterAsyncCommand(std::string_view name, CommandRegistry::AsyncHandler&& handler);
+    // Applies the settings of config that may change while running: timeouts, the thread pool size, rate
+    // limits and the overload policy. Everything else keeps the values Init was given.
+    void Reload(const ServerConfig& config);
+    // Stops accepting and receiving and waits up to drain_timeout_ms for the open connections to finish
+    // what they sent; Stop closes whatever is left.
+    void Drain();
     void Stop();
+    // true once a process started with the same handover_path took over the listening sockets
+    bool IsHandedOver() const
+    {
+        return m_is_handed_over.load();
+    }
 private:
-    void AddSocketToEpoll(unsigned int client_socket, uint32_t events);
-    void HandleNewTCPConnection();
-    void HandleTCPClientData(unsigned int client_socket);
-    void HandleUDPData();
-    void CloseSocket(unsigned int client_socket);
-    std::string PrepareAnswer(std::string_view);
+    bool IsRunning() const override;
+    Connection* OnAccept(Reactor& reactor, int client_socket) override;
+    bool OnTCPData(Connection& connection, bool is_drained, OutputQueue& responses) override;
+    bool IsEcho(std::string_view message) const override;
+    void OnUDPData(const sockaddr_storage& source, std::string_view message, std::string& response) override;
+    bool OnClose(Reactor& reactor, Connection& connection, uint32_t generation) override;
+
+    void InitReactor(Reactor& reactor, bool reuse_port, std::vector<ListenerHandover::Socket>& inherited);
+    std::unique_ptr<IoBackend> CreateBackend(Reactor& reactor);
+    void CloseReactor(Reactor& reactor);
+    void PinThread(std::thread& thread, unsigned int cpu);
+    void RegisterBuiltinCommands();
+    // Appends the reply to message. A command given a stream may go on after it returns, true then.
+    bool PrepareAnswer(std::string_view message, std::string& output, const CommandStream& stream = {});
+    enum class CommandStatus
+    {
+        Unknown,
+        Done,
+        // suspended, it sends the rest of its reply through the stream
+        Running
+    };
+    // Runs the "/name arguments" command of message.
+    CommandStatus RunCommand(std::string_view message, std::string& output, const CommandStream& stream = {});
+    // The handler of command index in a CommandContext; logs what it throws and finishes the context.
+    AsyncTask<> ServeCommand(int32_t index, std::string_view args, std::string& output, CommandStream stream);
+    void AnswerBinary(std::string_view batch, std::string& output);
+    BinaryProtocol::Status AnswerBinaryRequest(BinaryProtocol::Opcode opcode, std::string_view payload, std::string& output);
+    // Reply to a TCP message that is not served, empty to drop it silently, nullopt to serve it.
+    std::optional<std::string_view> RefuseTCP(const Connection& connection);
+    // Runs the shutdown callback and wakes the thread that drains and stops the server.
+    void RequestShutdown();
+    // The listening sockets of every reactor, for the process that replaces this one.
+    std::vector<ListenerHandover::Socket> CollectListeners() const;
+    // The line served by /stats and /watch.
+    void AppendStats(std::string& output) const;
+    // The Prometheus text served by /metrics and the metrics listener.
+    void AppendMetrics(std::string& output) const;
     
-    static constexpr size_t m_buffer_size {1024};
     std::mutex m_shutdown_mutex;
     std::condition_variable m_shutdown_cv;
     std::thread m_shutdown_thread;
     std::mutex m_callback_mutex;
     ShutdownCallback m_shutdown_callback;
     std::atomic<bool> m_is_shutdown;
-    StringCounter m_clients_count;
-    std::shared_mutex m_set_mutex;
-    int m_tcp_socket;
-    int m_udp_socket;
-    std::thread m_server_thread;
-    std::set<unsigned int> m_client_sockets;
-    int m_epoll_fd;
+    std::mutex m_drain_mutex;
+    bool m_is_drained;
+    ListenerHandover m_handover;
+    // set once another process took over the listening sockets
+    std::atomic<bool> m_is_handed_over;
+    Metrics m_metrics;
+    CommandRegistry m_commands;
+    // service time in nanoseconds, indexed like m_commands
+    std::unique_ptr<Histogram[]> m_command_latency;
+    std::unique_ptr<MetricsListener> m_metrics_listener;
+    std::unique_ptr<RateLimiter> m_rate_limiter;
+    ClockService m_clock;
+    ServerConfig m_config;
+    bool m_is_sharded;
+    std::unique_ptr<BufferPool> m_buffer_pool;
+    std::unique_ptr<ConnectionTable> m_connections;
+    std::vector<std::unique_ptr<Reactor>> m_reactors;
     std::atomic<bool> m_server_run;
-    int m_shutdown_event_fd;
-    unsigned int m_max_events;
-    const uint32_t m_error_mask;
     std::unique_ptr<ThreadPoolQueue> m_task_queue;
-    mutable boost::log::sources::severity_channel_logger_mt<boost::log::trivial::severity_level> m_logger;
-};
\ No newline at end of file
+    mutable LogHelper::Logger m_logger;
+};
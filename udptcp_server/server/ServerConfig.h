@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Endpoint.h"
+#include "Framing.h"
+#include "IoBackend.h"
+#include "ThreadPoolQueue.h"
+
+struct ServerConfig
+{
+    int port {8087};
+    // addresses served, IP endpoints without a port take port
+    std::vector<Endpoint> endpoints {Endpoint::AnyIPv4(EndpointKind::Tcp), Endpoint::AnyIPv4(EndpointKind::Udp)};
+    unsigned int max_events {64};
+    unsigned int max_threads {8};
+    // 0 keeps the single reactor + thread pool mode, N > 0 starts N SO_REUSEPORT shards
+    unsigned int shards_count {0};
+    bool pin_shards {false};
+    // accept queue length of every listener, the kernel caps it at net.core.somaxconn
+    unsigned int listen_backlog {4096};
+    // TCP listeners per reactor; more than one accept connection storms in parallel
+    unsigned int accept_listeners {1};
+    IoBackendType io_backend {IoBackendType::Epoll};
+    // io_uring provided buffer ring of the reactor: count must be a power of two, each buffer is read_buffer_size bytes
+    unsigned int uring_buffers_count {1024};
+    unsigned int uring_entries {4096};
+    FramingMode framing {FramingMode::Raw};
+    size_t read_buffer_size {4096};
+    size_t max_message_size {64 * 1024};
+    // reads from a client stop once this many response bytes wait for it and resume below the low watermark
+    size_t write_high_watermark {1024 * 1024};
+    size_t write_low_watermark {256 * 1024};
+    // echoes and sends of at least this many bytes avoid copies: echoed input is sent from its read block,
+    // epoll sends use MSG_ZEROCOPY and raw framing splices echoed streams through a pipe; 0 disables all three
+    size_t zerocopy_threshold {64 * 1024};
+    // a connection is closed after this long without any transfer, with a partial frame waiting for the rest,
+    // or with queued output the peer does not read; 0 disables a timeout
+    unsigned int idle_timeout_ms {300000};
+    unsigned int read_timeout_ms {30000};
+    unsigned int write_timeout_ms {30000};
+    // resolution of the reactor timer wheels
+    unsigned int timer_tick_ms {100};
+    // TCP keepalive of accepted sockets: idle seconds before the first probe, seconds between probes, probes
+    unsigned int keepalive_idle_s {30};
+    unsigned int keepalive_interval_s {5};
+    unsigned int keepalive_count {3};
+    unsigned int udp_batch_size {64};
+    size_t udp_datagram_size {2048};
+    // HTTP port serving GET /metrics, 0 leaves the metrics to the /metrics command
+    unsigned int metrics_port {0};
+    // requests per second admitted from one source IP (UDP datagrams, TCP connections and messages), 0 disables;
+    // burst is the bucket size, 0 for one second worth; sources is the size of the bucket table
+    unsigned int rate_limit {0};
+    unsigned int rate_burst {0};
+    unsigned int rate_limit_sources {65536};
+    // tasks each thread pool worker queues before overload_policy applies
+    unsigned int queue_capacity {1024};
+    OverloadPolicy overload_policy {OverloadPolicy::Run};
+    // on shutdown open connections are served this long after the listeners close, 0 closes them at once
+    unsigned int drain_timeout_ms {10000};
+    // Unix socket a replacing server process takes the listening sockets from, empty disables the handover
+    std::string handover_path;
+};
@@ -0,0 +1,303 @@
+#include "SlabAllocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+struct ThreadCache;
+
+// Precedes every block, Free finds the owner cache through it. Blocks without an owner belong to malloc.
+struct alignas(16) Header
+{
+    ThreadCache* owner;
+    uint32_t class_index;
+};
+
+constexpr uint32_t oversized_class {UINT32_MAX};
+constexpr std::align_val_t block_alignment {alignof(Header)};
+
+// A cached block stores the link in its own bytes.
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+struct alignas(64) ClassCache
+{
+    // owner thread only
+    FreeBlock* free_list {nullptr};
+    size_t free_count {0};
+    // pushed by other threads, taken whole by the owner
+    std::atomic<FreeBlock*> remote_list {nullptr};
+    // only the owner writes hits and misses, GetStats reads them from any thread
+    std::atomic<uint64_t> hits {0};
+    std::atomic<uint64_t> misses {0};
+    std::atomic<uint64_t> remote_frees {0};
+};
+
+struct ThreadCache
+{
+    std::array<ClassCache, SlabAllocator::classes_count> classes;
+    std::atomic<bool> is_owned {true};
+};
+
+// Caches outlive their threads since blocks may still be freed to them; a new thread adopts an orphaned one.
+class CacheRegistry {
+public:
+    ThreadCache* Adopt()
+    {
+        std::unique_lock lock(m_mutex);
+        for (auto& cache : m_caches)
+        {
+            bool is_owned = false;
+            if (cache->is_owned.compare_exchange_strong(is_owned, true, std::memory_order_acquire))
+            {
+                return cache.get();
+            }
+        }
+        m_caches.push_back(std::make_unique<ThreadCache>());
+        return m_caches.back().get();
+    }
+
+    template<class F>
+    void ForEach(F&& callback)
+    {
+        std::unique_lock lock(m_mutex);
+        for (auto& cache : m_caches)
+        {
+            callback(*cache);
+        }
+    }
+private:
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadCache>> m_caches;
+};
+
+// Never destroyed: static destructors may still free blocks.
+CacheRegistry& Registry()
+{
+    static CacheRegistry* registry = new CacheRegistry();
+    return *registry;
+}
+
+std::atomic<uint64_t> g_oversized {0};
+
+thread_local ThreadCache* t_cache {nullptr};
+thread_local bool t_is_exited {false};
+
+// Hands the cache over for adoption when the thread exits; later allocations of the thread go to malloc.
+struct CacheOwner
+{
+    ~CacheOwner()
+    {
+        if (t_cache != nullptr)
+        {
+            t_cache->is_owned.store(false, std::memory_order_release);
+            t_cache = nullptr;
+        }
+        t_is_exited = true;
+    }
+
+    bool is_registered {false};
+};
+
+thread_local CacheOwner t_cache_owner;
+
+ThreadCache* LocalCache()
+{
+    if (t_cache == nullptr && !t_is_exited)
+    {
+        t_cache_owner.is_registered = true;
+        t_cache = Registry().Adopt();
+    }
+    return t_cache;
+}
+
+uint32_t ClassIndex(size_t size)
+{
+    size_t block_size = std::bit_ceil(std::max(size, SlabAllocator::min_block_size));
+    return std::countr_zero(block_size) - std::countr_zero(SlabAllocator::min_block_size);
+}
+
+size_t ClassBlockSize(uint32_t index)
+{
+    return SlabAllocator::min_block_size << index;
+}
+
+// Classes that fit several times into a slab are carved from slabs, larger blocks are allocated one by one.
+bool IsCarved(uint32_t index)
+{
+    return ClassBlockSize(index) <= SlabAllocator::slab_size / 8;
+}
+
+void* AllocateUnowned(size_t size, uint32_t class_index)
+{
+    Header* header = static_cast<Header*>(::operator new(sizeof(Header) + size, block_alignment));
+    header->owner = nullptr;
+    header->class_index = class_index;
+    return header + 1;
+}
+
+void* Initialize(void* memory, ThreadCache* owner, uint32_t index)
+{
+    Header* header = static_cast<Header*>(memory);
+    header->owner = owner;
+    header->class_index = index;
+    return header + 1;
+}
+
+// Takes back the blocks other threads freed, large ones only up to the cache limit.
+void ReclaimRemote(ClassCache& entry, uint32_t index)
+{
+    FreeBlock* block = entry.remote_list.exchange(nullptr, std::memory_order_acquire);
+    size_t max_count = IsCarved(index) ? SIZE_MAX : SlabAllocator::max_cached_bytes / ClassBlockSize(index);
+    while (block != nullptr)
+    {
+        FreeBlock* next = block->next;
+        if (entry.free_count < max_count)
+        {
+            block->next = entry.free_list;
+            entry.free_list = block;
+            ++entry.free_count;
+        }
+        else
+        {
+            ::operator delete(reinterpret_cast<Header*>(block) - 1, block_alignment);
+        }
+        block = next;
+    }
+}
+
+// Cuts a new slab into blocks of the class, returns the first one and caches the rest.
+void* Refill(ThreadCache& cache, ClassCache& entry, uint32_t index)
+{
+    if (!IsCarved(index))
+    {
+        return Initialize(::operator new(sizeof(Header) + ClassBlockSize(index), block_alignment), &cache, index);
+    }
+    size_t stride = sizeof(Header) + ClassBlockSize(index);
+    char* slab = static_cast<char*>(::operator new(SlabAllocator::slab_size, block_alignment));
+    size_t count = SlabAllocator::slab_size / stride;
+    for (size_t i = 1; i < count; ++i)
+    {
+        FreeBlock* block = static_cast<FreeBlock*>(Initialize(slab + i * stride, &cache, index));
+        block->next = entry.free_list;
+        entry.free_list = block;
+        ++entry.free_count;
+    }
+    return Initialize(slab, &cache, index);
+}
+
+void Increment(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+} // namespace
+
+void* SlabAllocator::Allocate(size_t size)
+{
+    if (size > max_block_size)
+    {
+        g_oversized.fetch_add(1, std::memory_order_relaxed);
+        return AllocateUnowned(size, oversized_class);
+    }
+    uint32_t index = ClassIndex(size);
+    ThreadCache* cache = LocalCache();
+    if (cache == nullptr)
+    {
+        return AllocateUnowned(ClassBlockSize(index), index);
+    }
+    ClassCache& entry = cache->classes[index];
+    if (entry.free_list == nullptr && entry.remote_list.load(std::memory_order_relaxed) != nullptr)
+    {
+        ReclaimRemote(entry, index);
+    }
+    if (entry.free_list == nullptr)
+    {
+        Increment(entry.misses);
+        return Refill(*cache, entry, index);
+    }
+    Increment(entry.hits);
+    FreeBlock* block = entry.free_list;
+    entry.free_list = block->next;
+    --entry.free_count;
+    return block;
+}
+
+void SlabAllocator::Free(void* block) noexcept
+{
+    if (block == nullptr)
+    {
+        return;
+    }
+    Header* header = static_cast<Header*>(block) - 1;
+    ThreadCache* owner = header->owner;
+    if (owner == nullptr)
+    {
+        ::operator delete(header, block_alignment);
+        return;
+    }
+    uint32_t index = header->class_index;
+    ClassCache& entry = owner->classes[index];
+    FreeBlock* free_block = static_cast<FreeBlock*>(block);
+    if (owner == t_cache)
+    {
+        if (!IsCarved(index) && (entry.free_count + 1) * ClassBlockSize(index) > max_cached_bytes)
+        {
+            ::operator delete(header, block_alignment);
+            return;
+        }
+        free_block->next = entry.free_list;
+        entry.free_list = free_block;
+        ++entry.free_count;
+        return;
+    }
+    entry.remote_frees.fetch_add(1, std::memory_order_relaxed);
+    FreeBlock* head = entry.remote_list.load(std::memory_order_relaxed);
+    do
+    {
+        free_block->next = head;
+    } while (!entry.remote_list.compare_exchange_weak(head, free_block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+size_t SlabAllocator::BlockSize(size_t size)
+{
+    return size > max_block_size ? size : ClassBlockSize(ClassIndex(size));
+}
+
+SlabAllocator::Stats SlabAllocator::GetStats()
+{
+    Stats stats;
+    for (uint32_t i = 0; i < classes_count; ++i)
+    {
+        stats.classes[i].block_size = ClassBlockSize(i);
+    }
+    Registry().ForEach([&stats](ThreadCache& cache) {
+        for (size_t i = 0; i < classes_count; ++i)
+        {
+            stats.classes[i].hits += cache.classes[i].hits.load(std::memory_order_relaxed);
+            stats.classes[i].misses += cache.classes[i].misses.load(std::memory_order_relaxed);
+            stats.classes[i].remote_frees += cache.classes[i].remote_frees.load(std::memory_order_relaxed);
+        }
+    });
+    stats.oversized = g_oversized.load(std::memory_order_relaxed);
+    return stats;
+}
+
+double SlabAllocator::Stats::HitRate() const
+{
+    uint64_t hits = 0;
+    uint64_t total = oversized;
+    for (const ClassStats& entry : classes)
+    {
+        hits += entry.hits;
+        total += entry.hits + entry.misses;
+    }
+    return total == 0 ? 1.0 : static_cast<double>(hits) / total;
+}
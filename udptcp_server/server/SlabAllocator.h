@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Process wide block allocator with power of two size classes from 64 bytes to 1 MiB. Every thread owns a
+// cache per class: blocks freed by the owner go back to its free list without any synchronization, blocks
+// freed by another thread are pushed onto a lock-free list of the owner, which takes them back once its
+// own list runs dry. Small classes are carved from 64 KiB slabs that are never returned to the system,
+// large ones are allocated one by one and a cache keeps at most max_cached_bytes of them.
+class SlabAllocator {
+public:
+    static constexpr size_t min_block_size {64};
+    static constexpr size_t max_block_size {1 << 20};
+    static constexpr size_t classes_count {15};
+    static constexpr size_t slab_size {64 * 1024};
+    static constexpr size_t max_cached_bytes {4 * 1024 * 1024};
+
+    struct ClassStats
+    {
+        size_t block_size {0};
+        // served from the cache of the calling thread, including blocks other threads gave back
+        uint64_t hits {0};
+        // had to get memory from malloc
+        uint64_t misses {0};
+        // blocks freed by a thread that does not own them
+        uint64_t remote_frees {0};
+    };
+
+    struct Stats
+    {
+        std::array<ClassStats, classes_count> classes;
+        // larger than max_block_size, always malloc
+        uint64_t oversized {0};
+
+        double HitRate() const;
+    };
+
+    // Block of at least size bytes, aligned to 16.
+    static void* Allocate(size_t size);
+    static void Free(void* block) noexcept;
+    // Usable size of the block Allocate returns for size.
+    static size_t BlockSize(size_t size);
+    static Stats GetStats();
+};
+
+struct SlabDeleter
+{
+    void operator()(void* block) const noexcept
+    {
+        SlabAllocator::Free(block);
+    }
+};
+
+// Standard allocator interface, e.g. for the nodes of the containers on the request path.
+template<class T>
+struct SlabStlAllocator
+{
+    using value_type = T;
+
+    SlabStlAllocator() noexcept = default;
+
+    template<class U>
+    SlabStlAllocator(const SlabStlAllocator<U>&) noexcept {}
+
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(SlabAllocator::Allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t) noexcept
+    {
+        SlabAllocator::Free(pointer);
+    }
+
+    friend bool operator==(const SlabStlAllocator&, const SlabStlAllocator&) noexcept
+    {
+        return true;
+    }
+};
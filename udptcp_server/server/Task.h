@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "SlabAllocator.h"
+
+// Move-only void() callable that keeps small closures inline instead of allocating like std::function;
+// larger ones live in a slab block.
+class Task {
+public:
+    static constexpr size_t inline_size {48};
+
+    Task() noexcept : m_vtable(nullptr) {}
+
+    template<class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& function) : m_vtable(&m_vtable_for<std::decay_t<F>>)
+    {
+        using Function = std::decay_t<F>;
+        if constexpr (IsInline<Function>())
+        {
+            new (m_storage) Function(std::forward<F>(function));
+        }
+        else
+        {
+            static_assert(alignof(Function) <= alignof(std::max_align_t), "slab blocks are aligned to max_align_t");
+            void* block = SlabAllocator::Allocate(sizeof(Function));
+            try
+            {
+                *reinterpret_cast<Function**>(m_storage) = new (block) Function(std::forward<F>(function));
+            }
+            catch (...)
+            {
+                SlabAllocator::Free(block);
+                throw;
+            }
+        }
+    }
+
+    Task(Task&& other) noexcept : m_vtable(other.m_vtable)
+    {
+        if (m_vtable)
+        {
+            m_vtable->move(m_storage, other.m_storage);
+            other.m_vtable = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_vtable = other.m_vtable;
+            if (m_vtable)
+            {
+                m_vtable->move(m_storage, other.m_storage);
+                other.m_vtable = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        Reset();
+    }
+
+    void operator()()
+    {
+        m_vtable->invoke(m_storage);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return m_vtable != nullptr;
+    }
+
+    void Reset() noexcept
+    {
+        if (m_vtable)
+        {
+            m_vtable->destroy(m_storage);
+            m_vtable = nullptr;
+        }
+    }
+
+    template<class F>
+    static constexpr bool IsInline()
+    {
+        return sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+    }
+private:
+    struct VTable
+    {
+        void (*invoke)(void*);
+        void (*move)(void*, void*) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template<class F>
+    static constexpr VTable m_vtable_for = IsInline<F>() ?
+        VTable {
+            [](void* storage) { (*static_cast<F*>(storage))(); },
+            [](void* destination, void* source) noexcept 
+            {
+                new (destination) F(std::move(*static_cast<F*>(source)));
+                static_cast<F*>(source)->~F();
+            },
+            [](void* storage) noexcept { static_cast<F*>(storage)->~F(); }
+        } :
+        VTable {
+            [](void* storage) { (**static_cast<F**>(storage))(); },
+            [](void* destination, void* source) noexcept 
+            {
+                *static_cast<F**>(destination) = *static_cast<F**>(source);
+            },
+            [](void* storage) noexcept
+            {
+                F* function = *static_cast<F**>(storage);
+                function->~F();
+                SlabAllocator::Free(function);
+            }
+        };
+
+    alignas(std::max_align_t) unsigned char m_storage[inline_size];
+    const VTable* m_vtable;
+};
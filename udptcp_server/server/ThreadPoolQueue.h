@@ -2,52 +2,108 @@
 
 #include <vector>
 #include <thread>
-#include <queue>
-#include <functional>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
 #include <atomic>
+#include <array>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#include "Task.h"
+#include "BoundedQueue.h"
+#include "Histogram.h"
+
+// What Push does when every active queue is full. The pushing thread runs the task itself in all cases;
+// with a shedding policy it runs marked as shed (see ShedPolicy), so the task only discards or refuses its
+// work and the producer is not held up serving it.
+enum class OverloadPolicy
+{
+    // serve the new task in full, which slows the producer down
+    Run,
+    // shed the new task
+    DropNewest,
+    // shed the task queued longest ago and queue the new one
+    DropOldest,
+    // shed the new task, which answers its requests with an error
+    Reject
+};
 
+// Work-stealing pool: every worker owns a bounded lock-free queue, pushes from a worker stay local, pushes
+// from other threads are spread round-robin, and idle workers steal before they spin and park. Resize
+// changes the number of active workers at runtime: surplus workers park and their queued tasks get stolen.
+// Tasks pushed before startAsync wait in the queue of the first worker.
 class ThreadPoolQueue {
 public:
-    ThreadPoolQueue() : m_is_running(true) {};
+    static constexpr unsigned int max_workers {256};
+
+    // queue_capacity is per worker, rounded up to a power of two.
+    explicit ThreadPoolQueue(size_t queue_capacity = 1024) : m_queue_capacity(queue_capacity), m_overload_policy(OverloadPolicy::Run),
+        m_is_running(true), m_started(1), m_active(0), m_resizes(0), m_next_worker(0), m_sleepers(0), m_epoch(0)
+    {
+        m_workers[0] = std::make_unique<Worker>(m_queue_capacity);
+    }
+
+    // Records the nanoseconds every task waits between Push and its start; only before startAsync.
+    void SetWaitHistogram(Histogram* histogram)
+    {
+        m_wait_histogram = histogram;
+    }
+
+    // Any thread.
+    void SetOverloadPolicy(OverloadPolicy policy)
+    {
+        m_overload_policy.store(policy, std::memory_order_relaxed);
+    }
+
+    // Policy the pool applies to the task running on this thread: Run while it is served normally.
+    static OverloadPolicy ShedPolicy()
+    {
+        return t_shed_policy;
+    }
 
     void startAsync(unsigned int max_threads)
     {
-        for (int i = 0; i < max_threads; ++i)
-        {
-            m_threads_vec.emplace_back([this]{
-                while (m_is_running.load())
-                {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock lock(m_mutex);
-                        m_cv.wait(lock, [this] { 
-                            return !m_is_running.load() || !m_tasks_queue.empty(); 
-                        });
-
-                        if (m_tasks_queue.empty())
-                        {
-                            continue;
-                        }
-                        task = std::move(m_tasks_queue.front());
-                        m_tasks_queue.pop();
-                    }
-                    task();
-                }
-            });
-        }
+        Resize(max_threads);
     }
 
-    ~ThreadPoolQueue() 
+    ~ThreadPoolQueue()
     {
         Stop();
     }
 
+    // Runs threads_count workers, capped to 1..max_workers, and returns the new count. Not from a worker.
+    unsigned int Resize(unsigned int threads_count)
+    {
+        std::unique_lock lock(m_control_mutex);
+        threads_count = std::clamp(threads_count, 1u, max_workers);
+        if (!m_is_running.load())
+        {
+            return m_active.load();
+        }
+        size_t started = m_started.load(std::memory_order_relaxed);
+        for (size_t i = started; i < threads_count; ++i)
+        {
+            m_workers[i] = std::make_unique<Worker>(m_queue_capacity);
+        }
+        if (threads_count > started)
+        {
+            m_started.store(threads_count, std::memory_order_release);
+        }
+        m_active.store(threads_count, std::memory_order_release);
+        for (size_t i = m_threads_vec.size(); i < threads_count; ++i)
+        {
+            m_threads_vec.emplace_back([this, i] { RunWorker(i); });
+        }
+        // parked workers recheck whether they are active, active ones take the tasks of deactivated queues
+        WakeAll();
+        return threads_count;
+    }
+
     void Stop()
     {
+        std::unique_lock lock(m_control_mutex);
         m_is_running.store(false);
-        m_cv.notify_all();
+        WakeAll();
         for (auto& task : m_threads_vec)
         {
             if (task.joinable())
@@ -58,22 +114,210 @@ public:
     }
 
     template<class T>
-    void Push(T&& task) 
+    void Push(T&& task)
     {
-        if (!m_is_running.load())
+        if (!m_is_running.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        QueuedTask new_task {Task(std::forward<T>(task)), m_wait_histogram != nullptr ? NowNs() : 0};
+        if (!TryEnqueue(new_task) && !HandleOverload(new_task))
         {
             return;
         }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) > 0)
         {
-            std::unique_lock lock(m_mutex);
-            m_tasks_queue.emplace(std::forward<T>(task));
+            m_epoch.fetch_add(1, std::memory_order_release);
+            m_epoch.notify_one();
         }
-        m_cv.notify_one();
     }
 private:
+    struct QueuedTask
+    {
+        Task task;
+        uint64_t enqueue_ns {0};
+    };
+
+    struct alignas(64) Worker
+    {
+        explicit Worker(size_t capacity) : queue(capacity) {}
+        BoundedQueue<QueuedTask> queue;
+    };
+
+    void RunWorker(size_t index)
+    {
+        t_current_pool = this;
+        t_current_worker = index;
+        QueuedTask task;
+        while (m_is_running.load(std::memory_order_relaxed))
+        {
+            if (index >= m_active.load(std::memory_order_acquire))
+            {
+                uint32_t resizes = m_resizes.load(std::memory_order_acquire);
+                if (index >= m_active.load(std::memory_order_acquire) && m_is_running.load())
+                {
+                    m_resizes.wait(resizes, std::memory_order_acquire);
+                }
+                continue;
+            }
+            if (FindTask(index, task) || SpinForTask(index, task))
+            {
+                if (m_wait_histogram != nullptr)
+                {
+                    m_wait_histogram->Record(NowNs() - task.enqueue_ns);
+                }
+                task.task();
+                task.task.Reset();
+                continue;
+            }
+            Park();
+        }
+    }
+
+    void WakeAll()
+    {
+        m_resizes.fetch_add(1, std::memory_order_release);
+        m_resizes.notify_all();
+        m_epoch.fetch_add(1, std::memory_order_release);
+        m_epoch.notify_all();
+    }
+
+    // Every queue is full: runs or sheds a task on this thread. true if new_task got queued after all.
+    bool HandleOverload(QueuedTask& new_task)
+    {
+        OverloadPolicy policy = m_overload_policy.load(std::memory_order_relaxed);
+        if (policy == OverloadPolicy::DropOldest)
+        {
+            QueuedTask oldest;
+            if (FindTask(m_next_worker.fetch_add(1, std::memory_order_relaxed), oldest))
+            {
+                RunShed(oldest.task, policy);
+                if (TryEnqueue(new_task))
+                {
+                    return true;
+                }
+            }
+        }
+        RunShed(new_task.task, policy);
+        return false;
+    }
+
+    static void RunShed(Task& task, OverloadPolicy policy)
+    {
+        t_shed_policy = policy;
+        task();
+        t_shed_policy = OverloadPolicy::Run;
+        task.Reset();
+    }
+
+    bool TryEnqueue(QueuedTask& task)
+    {
+        size_t workers_count = m_active.load(std::memory_order_acquire);
+        if (workers_count == 0)
+        {
+            // not started, the first worker takes it
+            return m_workers[0]->queue.TryPush(std::move(task));
+        }
+        size_t start = t_current_pool == this ? t_current_worker % workers_count : m_next_worker.fetch_add(1, std::memory_order_relaxed) % workers_count;
+        for (size_t i = 0; i < workers_count; ++i)
+        {
+            if (m_workers[(start + i) % workers_count]->queue.TryPush(std::move(task)))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Scans every started queue, deactivated workers may still hold tasks.
+    bool FindTask(size_t index, QueuedTask& task)
+    {
+        size_t workers_count = m_started.load(std::memory_order_acquire);
+        for (size_t i = 0; i < workers_count; ++i)
+        {
+            if (m_workers[(index + i) % workers_count]->queue.TryPop(task))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool SpinForTask(size_t index, QueuedTask& task)
+    {
+        for (unsigned int i = 0; i < m_spin_count && m_is_running.load(std::memory_order_relaxed); ++i)
+        {
+            CpuRelax();
+            if (FindTask(index, task))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool HasTasks() const
+    {
+        size_t workers_count = m_started.load(std::memory_order_acquire);
+        for (size_t i = 0; i < workers_count; ++i)
+        {
+            if (!m_workers[i]->queue.Empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Park()
+    {
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+        if (m_is_running.load() && !HasTasks())
+        {
+            m_epoch.wait(epoch, std::memory_order_acquire);
+        }
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    static uint64_t NowNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    static constexpr unsigned int m_spin_count {256};
+    static inline thread_local ThreadPoolQueue* t_current_pool {nullptr};
+    static inline thread_local size_t t_current_worker {0};
+    static inline thread_local OverloadPolicy t_shed_policy {OverloadPolicy::Run};
+
+    const size_t m_queue_capacity;
+    Histogram* m_wait_histogram {nullptr};
+    std::atomic<OverloadPolicy> m_overload_policy;
+    // serializes Resize and Stop, which own m_threads_vec
+    std::mutex m_control_mutex;
     std::vector<std::thread> m_threads_vec;
-    std::queue<std::function<void()>> m_tasks_queue;
-    std::mutex m_mutex;
+    // slots below m_started are set once and never freed while the pool runs; the first one exists before
+    // any thread does
+    std::array<std::unique_ptr<Worker>, max_workers> m_workers;
     std::atomic<bool> m_is_running;
-    std::condition_variable m_cv;
-};
\ No newline at end of file
+    std::atomic<size_t> m_started;
+    std::atomic<size_t> m_active;
+    // inactive workers sleep on it until the next Resize or Stop
+    std::atomic<uint32_t> m_resizes;
+    alignas(64) std::atomic<size_t> m_next_worker;
+    alignas(64) std::atomic<uint32_t> m_sleepers;
+    alignas(64) std::atomic<uint32_t> m_epoch;
+};
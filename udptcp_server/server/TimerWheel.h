@@ -0,0 +1,220 @@
+#pragma once
+
+#include <sys/timerfd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "Task.h"
+
+// Entry of a TimerWheel, embedded in its owner. The owner cancels it before the memory goes away.
+class TimerNode {
+public:
+    TimerNode() = default;
+    TimerNode(const TimerNode&) = delete;
+    TimerNode& operator=(const TimerNode&) = delete;
+private:
+    friend class TimerWheel;
+
+    TimerNode* m_prev {nullptr};
+    TimerNode* m_next {nullptr};
+    // in ticks
+    uint64_t m_expiry {0};
+    Task m_callback;
+};
+
+// Hierarchical timing wheel: levels_count wheels of slots_count slots, a slot of level L spans
+// slots_count^L ticks. Schedule and Cancel are O(1). A tick fires one slot of level 0 and, every
+// slots_count^L ticks, moves one slot of level L down a level, so the work per tick does not grow with the
+// number of timers. Timers beyond the top level wait in its farthest slot and are sorted again when it comes
+// around. Schedule and Cancel may be called from any thread, Advance from the one thread that drives the wheel.
+class TimerWheel {
+public:
+    static constexpr unsigned int slot_bits {6};
+    static constexpr uint64_t slots_count {1ull << slot_bits};
+    static constexpr unsigned int levels_count {4};
+
+    TimerWheel(uint64_t tick_ms, uint64_t now_ms) : m_tick_ms(std::max<uint64_t>(1, tick_ms)), m_current(now_ms / m_tick_ms),
+        m_now_ms(now_ms) {}
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    static uint64_t MonotonicMs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    }
+
+    // Time of the last Advance, cheap enough for every I/O event; timer users measure in it.
+    uint64_t Now() const
+    {
+        return m_now_ms.load(std::memory_order_relaxed);
+    }
+
+    // Non-blocking timerfd that expires every tick, the driving event loop calls Advance when it is readable.
+    int OpenTickTimer() const
+    {
+        int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd < 0)
+        {
+            throw std::runtime_error("timerfd creation error");
+        }
+        itimerspec period {};
+        period.it_interval.tv_sec = static_cast<time_t>(m_tick_ms / 1000);
+        period.it_interval.tv_nsec = static_cast<long>(m_tick_ms % 1000) * 1000000;
+        period.it_value = period.it_interval;
+        timerfd_settime(timer_fd, 0, &period, nullptr);
+        return timer_fd;
+    }
+
+    // Runs callback on the driving thread once expiry_ms has passed, replacing an earlier schedule of node.
+    void Schedule(TimerNode& node, uint64_t expiry_ms, Task&& callback)
+    {
+        std::unique_lock lock(m_mutex);
+        Unlink(node);
+        node.m_callback = std::move(callback);
+        node.m_expiry = ToTicks(expiry_ms);
+        Link(node, m_current + 1);
+    }
+
+    // Like Schedule, but keeps a scheduled node that already expires no later.
+    void ScheduleBefore(TimerNode& node, uint64_t expiry_ms, Task&& callback)
+    {
+        std::unique_lock lock(m_mutex);
+        uint64_t expiry = ToTicks(expiry_ms);
+        if (node.m_prev != nullptr && node.m_expiry <= expiry)
+        {
+            return;
+        }
+        Unlink(node);
+        node.m_callback = std::move(callback);
+        node.m_expiry = expiry;
+        Link(node, m_current + 1);
+    }
+
+    void Cancel(TimerNode& node)
+    {
+        std::unique_lock lock(m_mutex);
+        Unlink(node);
+        node.m_callback.Reset();
+    }
+
+    // Moves the wheel to now_ms and runs the callbacks of the expired timers. They run without the wheel
+    // lock, so they may schedule again.
+    void Advance(uint64_t now_ms)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_now_ms.store(std::max(now_ms, m_now_ms.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+            uint64_t target = now_ms / m_tick_ms;
+            while (m_current < target)
+            {
+                ++m_current;
+                for (unsigned int level = 1; level < levels_count && (m_current & LevelMask(level)) == 0; ++level)
+                {
+                    Cascade(level);
+                }
+                TimerNode& slot = Slot(0, m_current);
+                while (slot.m_next != &slot)
+                {
+                    TimerNode& node = *slot.m_next;
+                    Unlink(node);
+                    m_due.push_back(std::move(node.m_callback));
+                }
+            }
+        }
+        for (Task& callback : m_due)
+        {
+            callback();
+        }
+        m_due.clear();
+    }
+private:
+    using Level = std::array<TimerNode, slots_count>;
+
+    static constexpr uint64_t LevelMask(unsigned int level)
+    {
+        return (1ull << (slot_bits * level)) - 1;
+    }
+
+    uint64_t ToTicks(uint64_t ms) const
+    {
+        return (ms + m_tick_ms - 1) / m_tick_ms;
+    }
+
+    // Slots are sentinels of circular lists, empty ones point at themselves.
+    TimerNode& Slot(unsigned int level, uint64_t tick)
+    {
+        TimerNode& slot = m_slots[level][(tick >> (slot_bits * level)) & (slots_count - 1)];
+        if (slot.m_next == nullptr)
+        {
+            slot.m_prev = &slot;
+            slot.m_next = &slot;
+        }
+        return slot;
+    }
+
+    // earliest is the first tick whose slot has not fired yet: m_current + 1, or m_current within Advance, whose
+    // cascades run before the level 0 slot of the tick.
+    void Link(TimerNode& node, uint64_t earliest)
+    {
+        // due or overdue timers fire in the earliest slot
+        uint64_t expiry = std::max(node.m_expiry, earliest);
+        uint64_t delta = expiry - m_current;
+        unsigned int level = 0;
+        while (level + 1 < levels_count && delta > LevelMask(level + 1))
+        {
+            ++level;
+        }
+        if (delta > LevelMask(levels_count))
+        {
+            expiry = m_current + LevelMask(levels_count);
+        }
+        TimerNode& slot = Slot(level, expiry);
+        node.m_prev = slot.m_prev;
+        node.m_next = &slot;
+        slot.m_prev->m_next = &node;
+        slot.m_prev = &node;
+    }
+
+    static void Unlink(TimerNode& node)
+    {
+        if (node.m_prev == nullptr)
+        {
+            return;
+        }
+        node.m_prev->m_next = node.m_next;
+        node.m_next->m_prev = node.m_prev;
+        node.m_prev = nullptr;
+        node.m_next = nullptr;
+    }
+
+    // Sorts the timers of the current slot of level into the levels below. A timer due exactly at the start of
+    // the slot goes to the level 0 slot of this tick, which fires next.
+    void Cascade(unsigned int level)
+    {
+        TimerNode& slot = Slot(level, m_current);
+        while (slot.m_next != &slot)
+        {
+            TimerNode& node = *slot.m_next;
+            Unlink(node);
+            Link(node, m_current);
+        }
+    }
+
+    const uint64_t m_tick_ms;
+    std::mutex m_mutex;
+    uint64_t m_current;
+    std::atomic<uint64_t> m_now_ms;
+    std::array<Level, levels_count> m_slots;
+    // driving thread only, kept to avoid allocating on every tick
+    std::vector<Task> m_due;
+};
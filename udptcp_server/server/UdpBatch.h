@@ -0,0 +1,81 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Preallocated recvmmsg/sendmmsg state for one datagram socket; only one thread drains the socket at a time.
+struct UdpBatch
+{
+    UdpBatch(unsigned int batch_size, size_t datagram_size) : batch_size(batch_size), datagram_size(datagram_size),
+        buffers(std::make_unique_for_overwrite<char[]>(batch_size * datagram_size)), addresses(batch_size), recv_iovecs(batch_size),
+        recv_messages(batch_size), responses(batch_size), send_iovecs(batch_size), send_messages(batch_size)
+    {
+        for (unsigned int i = 0; i < batch_size; ++i)
+        {
+            recv_iovecs[i].iov_base = buffers.get() + i * datagram_size;
+            recv_iovecs[i].iov_len = datagram_size;
+            // io_uring answers from whichever slot a datagram landed in, a reply never grows a slot on the request path
+            responses[i].reserve(datagram_size);
+        }
+        PrepareReceive();
+    }
+
+    void PrepareReceive()
+    {
+        for (unsigned int i = 0; i < batch_size; ++i)
+        {
+            PrepareReceive(i);
+        }
+    }
+
+    void PrepareReceive(unsigned int index)
+    {
+        msghdr& header = recv_messages[index].msg_hdr;
+        header = msghdr {};
+        header.msg_name = &addresses[index];
+        header.msg_namelen = sizeof(sockaddr_storage);
+        // a sender without an address leaves it untouched
+        addresses[index].ss_family = AF_UNSPEC;
+        header.msg_iov = &recv_iovecs[index];
+        header.msg_iovlen = 1;
+    }
+
+    // Points reply slot reply_index at responses[reply_index], addressed to the sender of datagram message_index.
+    void PrepareSend(unsigned int reply_index, unsigned int message_index)
+    {
+        send_iovecs[reply_index].iov_base = responses[reply_index].data();
+        send_iovecs[reply_index].iov_len = responses[reply_index].size();
+        msghdr& header = send_messages[reply_index].msg_hdr;
+        header = msghdr {};
+        header.msg_name = &addresses[message_index];
+        header.msg_namelen = recv_messages[message_index].msg_hdr.msg_namelen;
+        header.msg_iov = &send_iovecs[reply_index];
+        header.msg_iovlen = 1;
+    }
+
+    // False for datagrams from unbound Unix sockets, they have no address to answer.
+    bool CanReply(unsigned int index) const
+    {
+        return recv_messages[index].msg_hdr.msg_namelen > sizeof(sa_family_t);
+    }
+
+    std::string_view Datagram(unsigned int index) const
+    {
+        return std::string_view(static_cast<const char*>(recv_iovecs[index].iov_base), recv_messages[index].msg_len);
+    }
+
+    const unsigned int batch_size;
+    const size_t datagram_size;
+    std::unique_ptr<char[]> buffers;
+    std::vector<sockaddr_storage> addresses;
+    std::vector<iovec> recv_iovecs;
+    std::vector<mmsghdr> recv_messages;
+    std::vector<std::string> responses;
+    std::vector<iovec> send_iovecs;
+    std::vector<mmsghdr> send_messages;
+};
@@ -0,0 +1,767 @@
+#include "UringBackend.h"
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <utility>
+
+#include "AsyncIo.h"
+
+UringBackend::UringBackend(Reactor& reactor, IoHandler& handler, Metrics& metrics, const ServerConfig& config) : m_reactor(reactor),
+    m_handler(handler), m_metrics(metrics), m_config(config), m_event_fd(-1), m_event_value(0), m_timer_fd(-1), m_timer_value(0),
+    m_timers(config.timer_tick_ms, TimerWheel::MonotonicMs()),
+    m_timeouts(m_timers, config, [this](int client_socket, uint32_t generation) { CheckTimeouts(client_socket, generation); }),
+    m_is_draining(false), m_is_listening(true), m_logger("IoUring") {}
+
+UringBackend::~UringBackend()
+{
+    Close();
+}
+
+void UringBackend::Init()
+{
+    m_ring = std::make_unique<IoUring>(m_config.uring_entries, IORING_SETUP_COOP_TASKRUN);
+    m_buffer_ring = std::make_unique<BufferRing>(*m_ring, m_config.uring_buffers_count, m_config.read_buffer_size, 0,
+        MakeUserData(Operation::ProvideBuffers, 0));
+    if (!m_buffer_ring->IsMapped())
+    {
+        LOG(m_logger, LogHelper::warning, "Kernel does not select from registered buffer rings, using IORING_OP_PROVIDE_BUFFERS");
+    }
+    m_event_fd = eventfd(0, EFD_NONBLOCK);
+    if (m_event_fd < 0)
+    {
+        throw std::runtime_error("eventfd creation error");
+    }
+    PostWakeupRead();
+    m_timer_fd = m_timers.OpenTickTimer();
+    PostTimerRead();
+    for (uint32_t listener = 0; listener < m_reactor.listeners.Streams().size(); ++listener)
+    {
+        PostAccept(listener);
+    }
+    m_accept_waiters.resize(m_reactor.listeners.Streams().size());
+    size_t datagrams_count = m_reactor.listeners.Datagrams().size();
+    m_udp_batches.reserve(datagrams_count);
+    for (size_t listener = 0; listener < datagrams_count; ++listener)
+    {
+        m_udp_batches.emplace_back(m_config.udp_batch_size, m_config.udp_datagram_size);
+    }
+    for (uint32_t id = 0; id < datagrams_count * m_config.udp_batch_size; ++id)
+    {
+        PostUdpRecv(id);
+    }
+    int result = m_ring->Submit(0);
+    if (result < 0)
+    {
+        throw std::runtime_error(std::string("io_uring submit error: ") + strerror(-result));
+    }
+}
+
+void UringBackend::Close()
+{
+    // the reactor is stopped, a loop still parked never runs again
+    for (AcceptWaiter& waiter : m_accept_waiters)
+    {
+        if (waiter.handle)
+        {
+            std::exchange(waiter.handle, nullptr).destroy();
+        }
+    }
+    // the ring goes first so the kernel stops touching the buffers before they are freed
+    m_ring.reset();
+    m_buffer_ring.reset();
+    // nothing completes any more: the connections left open close here and the commands they held run to
+    // their end on this thread
+    for (UringConnection& state : m_connections)
+    {
+        if (state.connection != nullptr)
+        {
+            state.is_closing = true;
+            state.inflight = 0;
+            ReleaseIfDone(state);
+        }
+    }
+    ResumeQueued();
+    m_connections.clear();
+    for (int* fd : {&m_event_fd, &m_timer_fd})
+    {
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void UringBackend::Wakeup()
+{
+    uint64_t value = 1;
+    write(m_event_fd, &value, sizeof(value));
+}
+
+TimerWheel& UringBackend::Timers()
+{
+    return m_timers;
+}
+
+void UringBackend::Reload(const ServerConfig& config)
+{
+    m_timeouts.Configure(config);
+}
+
+void UringBackend::Drain()
+{
+    m_is_draining.store(true);
+    Wakeup();
+}
+
+void UringBackend::Run()
+{
+    for (uint32_t listener = 0; listener < m_accept_waiters.size(); ++listener)
+    {
+        AsyncTask<> accept = AcceptConnections(listener);
+        accept.Start();
+    }
+    while (m_handler.IsRunning())
+    {
+        if (m_is_listening && m_is_draining.load())
+        {
+            StopListening();
+        }
+        int result = m_ring->Submit(1);
+        if (result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY)
+        {
+            LOG(m_logger, LogHelper::error, "io_uring enter error: " << strerror(-result));
+        }
+        unsigned int completions = m_ring->ForEachCompletion([this](const io_uring_cqe& cqe) { HandleCompletion(cqe); });
+        if (completions > 0)
+        {
+            m_metrics.Record(Distribution::ReactorBatch, completions);
+        }
+        ResumeQueued();
+        m_buffer_ring->Publish();
+    }
+}
+
+uint64_t UringBackend::MakeUserData(Operation operation, uint32_t id)
+{
+    return (static_cast<uint64_t>(operation) << 32) | id;
+}
+
+void UringBackend::PostWakeupRead()
+{
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_event_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_event_value);
+    sqe->len = sizeof(m_event_value);
+    sqe->user_data = MakeUserData(Operation::Wakeup, 0);
+}
+
+void UringBackend::PostTimerRead()
+{
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_timer_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_timer_value);
+    sqe->len = sizeof(m_timer_value);
+    sqe->user_data = MakeUserData(Operation::Timer, 0);
+}
+
+void UringBackend::PostAccept(uint32_t listener)
+{
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_reactor.listeners.Streams()[listener].socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = MakeUserData(Operation::Accept, listener);
+}
+
+void UringBackend::PostRecv(uint32_t id, UringConnection& connection)
+{
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection.connection->socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = m_buffer_ring->GroupId();
+    sqe->user_data = MakeUserData(Operation::Recv, id);
+    ++connection.inflight;
+    connection.is_receiving = true;
+}
+
+void UringBackend::PostCancelRecv(uint32_t id)
+{
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = MakeUserData(Operation::Recv, id);
+    sqe->user_data = MakeUserData(Operation::CancelRecv, id);
+}
+
+void UringBackend::PostSend(uint32_t id, UringConnection& connection)
+{
+    connection.message = msghdr {};
+    connection.message.msg_iov = connection.iovecs.data();
+    connection.message.msg_iovlen = connection.connection->output.Gather(connection.iovecs.data(), connection.iovecs.size());
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = connection.connection->socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&connection.message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = MakeUserData(Operation::Send, id);
+    ++connection.inflight;
+    connection.is_sending = true;
+}
+
+void UringBackend::PostUdpRecv(uint32_t id)
+{
+    uint32_t listener = id / m_config.udp_batch_size;
+    uint32_t slot = id % m_config.udp_batch_size;
+    UdpBatch& batch = m_udp_batches[listener];
+    batch.PrepareReceive(slot);
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = m_reactor.listeners.Datagrams()[listener].socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&batch.recv_messages[slot].msg_hdr);
+    sqe->len = 1;
+    sqe->user_data = MakeUserData(Operation::UdpRecv, id);
+}
+
+void UringBackend::PostUdpSend(uint32_t id)
+{
+    uint32_t listener = id / m_config.udp_batch_size;
+    uint32_t slot = id % m_config.udp_batch_size;
+    UdpBatch& batch = m_udp_batches[listener];
+    batch.PrepareSend(slot, slot);
+    io_uring_sqe* sqe = m_ring->GetSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = m_reactor.listeners.Datagrams()[listener].socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&batch.send_messages[slot].msg_hdr);
+    sqe->len = 1;
+    sqe->user_data = MakeUserData(Operation::UdpSend, id);
+}
+
+void UringBackend::HandleCompletion(const io_uring_cqe& cqe)
+{
+    auto operation = static_cast<Operation>(cqe.user_data >> 32);
+    auto id = static_cast<uint32_t>(cqe.user_data);
+    switch (operation)
+    {
+    case Operation::ProvideBuffers:
+        if (cqe.res < 0)
+        {
+            LOG(m_logger, LogHelper::error, "Error while providing recv buffers: " << strerror(-cqe.res));
+        }
+        break;
+    case Operation::Wakeup:
+        if (m_handler.IsRunning())
+        {
+            PostWakeupRead();
+        }
+        break;
+    case Operation::Timer:
+        if (m_handler.IsRunning())
+        {
+            m_timers.Advance(TimerWheel::MonotonicMs());
+            PostTimerRead();
+            if (!m_is_listening)
+            {
+                CloseQuiescent();
+            }
+        }
+        break;
+    case Operation::Accept:
+        HandleAccept(id, cqe);
+        break;
+    case Operation::Recv:
+        HandleRecv(id, cqe);
+        break;
+    case Operation::CancelRecv:
+        break;
+    case Operation::Send:
+        HandleSend(id, cqe);
+        break;
+    case Operation::UdpRecv:
+        HandleUdpRecv(id, cqe);
+        break;
+    case Operation::UdpSend:
+        if (cqe.res < 0)
+        {
+            LOG(m_logger, LogHelper::error, "Error while sending UDP reply: " << strerror(-cqe.res));
+            m_metrics.Add(Counter::UdpErrors);
+        }
+        else
+        {
+            m_metrics.Add(Counter::UdpBytesOut, cqe.res);
+        }
+        if (m_handler.IsRunning() && m_is_listening)
+        {
+            PostUdpRecv(id);
+        }
+        break;
+    case Operation::CancelListener:
+        break;
+    }
+}
+
+void UringBackend::HandleAccept(uint32_t listener, const io_uring_cqe& cqe)
+{
+    if (cqe.res >= 0)
+    {
+        AcceptWaiter& waiter = m_accept_waiters[listener];
+        if (waiter.handle)
+        {
+            *waiter.client = cqe.res;
+            std::exchange(waiter.handle, nullptr).resume();
+        }
+        else
+        {
+            // the loop ended with StopListening
+            close(cqe.res);
+        }
+    }
+    else if (cqe.res != -EAGAIN && cqe.res != -ECANCELED)
+    {
+        LOG(m_logger, LogHelper::error, "Error while accepting new tcp client: " << strerror(-cqe.res));
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE) && m_handler.IsRunning() && m_is_listening)
+    {
+        PostAccept(listener);
+    }
+}
+
+// Serves one listener until the reactor stops listening. The multishot accept hands over one client per
+// completion, the loop is parked again before the next one.
+AsyncTask<> UringBackend::AcceptConnections(uint32_t listener)
+{
+    while (m_handler.IsRunning() && m_is_listening)
+    {
+        int client_socket = co_await AsyncAccept(*this, listener);
+        if (client_socket < 0)
+        {
+            continue;
+        }
+        Connection* connection = m_handler.OnAccept(m_reactor, client_socket);
+        if (connection == nullptr)
+        {
+            close(client_socket);
+            continue;
+        }
+        if (static_cast<size_t>(client_socket) >= m_connections.size())
+        {
+            m_connections.resize(client_socket + 1);
+        }
+        UringConnection& state = m_connections[client_socket];
+        state = UringConnection {};
+        state.connection = connection;
+        m_timeouts.Open(*connection);
+        PostRecv(client_socket, state);
+    }
+}
+
+bool UringBackend::WaitAccept(size_t listener, std::coroutine_handle<> handle, int& client)
+{
+    if (!m_handler.IsRunning() || !m_is_listening)
+    {
+        return false;
+    }
+    m_accept_waiters[listener] = AcceptWaiter {handle, &client};
+    return true;
+}
+
+// A closing connection parks the coroutine too, ReleaseIfDone wakes it once the connection is closed.
+bool UringBackend::WaitReadable(Connection& connection, uint32_t generation, size_t seen, std::coroutine_handle<> handle)
+{
+    UringConnection* state = FindConnection(connection.socket);
+    if (state == nullptr || !connection.IsCurrent(generation) || connection.is_command_cancelled.load())
+    {
+        return false;
+    }
+    if (connection.read_buffer.Size() > seen)
+    {
+        QueueResume(handle);
+        return true;
+    }
+    connection.read_waiter = handle;
+    connection.read_waiter_seen = seen;
+    if (!state->is_receiving && !state->is_closing && IsReading(connection) && m_handler.IsRunning())
+    {
+        PostRecv(connection.socket, *state);
+    }
+    return true;
+}
+
+// HandleSend resumes the waiter once the output drained.
+bool UringBackend::WaitWritable(Connection& connection, uint32_t generation, std::coroutine_handle<> handle)
+{
+    UringConnection* state = FindConnection(connection.socket);
+    if (state == nullptr || !connection.IsCurrent(generation) ||
+        (!state->is_closing && connection.output.Size() <= m_config.write_high_watermark))
+    {
+        return false;
+    }
+    connection.write_waiter = handle;
+    return true;
+}
+
+void UringBackend::HandleRecv(uint32_t id, const io_uring_cqe& cqe)
+{
+    bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+    auto buffer_id = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    UringConnection* state = FindConnection(id);
+    if (state == nullptr)
+    {
+        if (has_buffer)
+        {
+            m_buffer_ring->Add(buffer_id);
+        }
+        return;
+    }
+    UringConnection& connection = *state;
+    bool is_armed = cqe.flags & IORING_CQE_F_MORE;
+    if (!is_armed)
+    {
+        --connection.inflight;
+        connection.is_receiving = false;
+    }
+
+    if (cqe.res > 0 && has_buffer && !connection.is_closing)
+    {
+        ReadBuffer& read_buffer = connection.connection->read_buffer;
+        size_t space = 0;
+        char* destination = read_buffer.PrepareWrite(cqe.res, space);
+        memcpy(destination, m_buffer_ring->Buffer(buffer_id), cqe.res);
+        read_buffer.Commit(cqe.res);
+        m_metrics.Add(Counter::TcpBytesIn, cqe.res);
+        // a recv that exactly fills its buffer may still be all there is, the kernel tells whether more is queued
+        ProcessInput(id, connection, !(cqe.flags & IORING_CQE_F_SOCK_NONEMPTY));
+    }
+    if (has_buffer)
+    {
+        m_buffer_ring->Add(buffer_id);
+    }
+
+    if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED))
+    {
+        if (cqe.res < 0 && !connection.is_closing)
+        {
+            LOG(m_logger, LogHelper::error, "Reading error: " << strerror(-cqe.res) << " for client " << connection.connection->socket);
+            m_metrics.Add(Counter::TcpErrors);
+        }
+        CloseConnection(connection);
+    }
+    else if (!is_armed && !connection.is_closing && IsReading(*connection.connection) && m_handler.IsRunning())
+    {
+        PostRecv(id, connection);
+    }
+    ReleaseIfDone(connection);
+}
+
+// Answers the complete requests in the read buffer. A command that suspends holds the connection, the recv is
+// cancelled like for a paused connection until ResumeReading, unless the command waits for input in AsyncRead.
+void UringBackend::ProcessInput(uint32_t id, UringConnection& connection, bool is_drained)
+{
+    Connection& client = *connection.connection;
+    ReadBuffer& read_buffer = client.read_buffer;
+    OutputQueue responses;
+    size_t buffered = read_buffer.Size();
+    bool is_open = m_handler.OnTCPData(client, is_drained, responses);
+    QueueResponses(id, connection, responses);
+    bool is_waiting = client.is_read_paused || client.is_command_running;
+    m_timeouts.OnRead(client, read_buffer.Size() < buffered, read_buffer.Size() > 0 && !is_waiting);
+    if (!is_open)
+    {
+        CloseConnection(connection);
+    }
+    else if (client.is_command_running && !client.is_read_paused)
+    {
+        if (!client.read_waiter)
+        {
+            if (connection.is_receiving)
+            {
+                PostCancelRecv(id);
+            }
+        }
+        else if (read_buffer.Size() > client.read_waiter_seen)
+        {
+            QueueResume(std::exchange(client.read_waiter, nullptr));
+        }
+    }
+}
+
+void UringBackend::HandleSend(uint32_t id, const io_uring_cqe& cqe)
+{
+    UringConnection* state = FindConnection(id);
+    if (state == nullptr)
+    {
+        return;
+    }
+    UringConnection& connection = *state;
+    --connection.inflight;
+    connection.is_sending = false;
+    if (cqe.res < 0)
+    {
+        if (!connection.is_closing)
+        {
+            LOG(m_logger, LogHelper::error, "Error while sending message to TCP client " << connection.connection->socket << ": " << strerror(-cqe.res));
+            m_metrics.Add(Counter::TcpErrors);
+            CloseConnection(connection);
+        }
+    }
+    else if (!connection.is_closing)
+    {
+        OutputQueue& output = connection.connection->output;
+        output.Consume(cqe.res);
+        m_metrics.Add(Counter::TcpBytesOut, cqe.res);
+        m_timeouts.OnWrite(*connection.connection, cqe.res, !output.Empty());
+        if (!output.Empty())
+        {
+            PostSend(id, connection);
+        }
+        if (connection.connection->write_waiter && output.Size() <= m_config.write_low_watermark)
+        {
+            QueueResume(std::exchange(connection.connection->write_waiter, nullptr));
+        }
+        if (connection.connection->is_read_paused && output.Size() <= m_config.write_low_watermark)
+        {
+            connection.connection->is_read_paused = false;
+            if (!connection.is_receiving && IsReading(*connection.connection) && m_handler.IsRunning())
+            {
+                PostRecv(id, connection);
+            }
+        }
+    }
+    ReleaseIfDone(connection);
+}
+
+// Responses join the output queue; while one SENDMSG is in flight new data waits for its completion and
+// leaves with the rest in the next one. Above the high watermark the multishot recv is cancelled.
+void UringBackend::QueueResponses(uint32_t id, UringConnection& connection, OutputQueue& responses)
+{
+    OutputQueue& output = connection.connection->output;
+    output.Append(std::move(responses));
+    if (!connection.is_sending && !output.Empty())
+    {
+        // the send completes only once the peer makes room, the write timeout counts from here
+        m_timeouts.OnWrite(*connection.connection, 0, true);
+        PostSend(id, connection);
+    }
+    if (output.Size() > m_config.write_high_watermark && !connection.connection->is_read_paused)
+    {
+        LOG(m_logger, LogHelper::info, "Pausing reads from client " << connection.connection->socket << " with " << output.Size() << " bytes queued");
+        connection.connection->is_read_paused = true;
+        if (connection.is_receiving)
+        {
+            PostCancelRecv(id);
+        }
+    }
+}
+
+bool UringBackend::Send(Connection& connection, uint32_t generation, OutputQueue& data)
+{
+    UringConnection* state = FindConnection(connection.socket);
+    if (state == nullptr || state->is_closing || !connection.IsCurrent(generation))
+    {
+        return false;
+    }
+    QueueResponses(connection.socket, *state, data);
+    return true;
+}
+
+void UringBackend::ResumeReading(Connection& connection, uint32_t generation)
+{
+    UringConnection* state = FindConnection(connection.socket);
+    if (state == nullptr || state->is_closing || !connection.IsCurrent(generation))
+    {
+        return;
+    }
+    ProcessInput(connection.socket, *state, true);
+    if (!state->is_receiving && !state->is_closing && IsReading(connection) && m_handler.IsRunning())
+    {
+        PostRecv(connection.socket, *state);
+    }
+    ReleaseIfDone(*state);
+}
+
+UringBackend::UringConnection* UringBackend::FindConnection(uint32_t client_socket)
+{
+    if (client_socket >= m_connections.size() || m_connections[client_socket].connection == nullptr)
+    {
+        return nullptr;
+    }
+    return &m_connections[client_socket];
+}
+
+bool UringBackend::IsReading(const Connection& connection)
+{
+    return !connection.is_read_paused && (!connection.is_command_running || connection.read_waiter);
+}
+
+void UringBackend::CloseConnection(UringConnection& connection)
+{
+    if (connection.is_closing)
+    {
+        return;
+    }
+    connection.is_closing = true;
+    // terminates the multishot recv and a pending send, the descriptor is closed once they completed
+    shutdown(connection.connection->socket, SHUT_RDWR);
+}
+
+// The descriptor stays open while requests are in flight, so it cannot be reused under them and the
+// connection slot keeps the output they point at.
+void UringBackend::ReleaseIfDone(UringConnection& connection)
+{
+    if (!connection.is_closing || connection.inflight != 0)
+    {
+        return;
+    }
+    Connection& closed = *connection.connection;
+    connection.connection = nullptr;
+    m_timeouts.Close(closed);
+    if (m_handler.OnClose(m_reactor, closed, closed.generation.load()))
+    {
+        ReleaseWaiters(closed, true);
+        close(closed.socket);
+    }
+}
+
+void UringBackend::ReleaseWaiters(Connection& connection, bool is_closing)
+{
+    for (std::coroutine_handle<> waiter : connection.CancelCommand(is_closing))
+    {
+        if (waiter)
+        {
+            QueueResume(waiter);
+        }
+    }
+}
+
+void UringBackend::QueueResume(std::coroutine_handle<> handle)
+{
+    m_resume_queue.push_back(handle);
+}
+
+void UringBackend::ResumeQueued()
+{
+    while (!m_resume_queue.empty())
+    {
+        m_resuming.swap(m_resume_queue);
+        for (std::coroutine_handle<> handle : m_resuming)
+        {
+            handle.resume();
+        }
+        m_resuming.clear();
+    }
+}
+
+void UringBackend::CheckTimeouts(int client_socket, uint32_t generation)
+{
+    UringConnection* state = FindConnection(client_socket);
+    if (state == nullptr || state->is_closing || !state->connection->IsCurrent(generation))
+    {
+        return;
+    }
+    ConnectionTimeouts::Reason reason = m_timeouts.Check(*state->connection, generation);
+    if (reason == ConnectionTimeouts::Reason::None)
+    {
+        return;
+    }
+    LOG(m_logger, LogHelper::info, "Closing client " << client_socket << " after the " << ConnectionTimeouts::Name(reason) << " timeout");
+    m_metrics.Add(Counter::TcpTimeouts);
+    CloseConnection(*state);
+}
+
+// Cancels the multishot accepts and the datagram receives; replies in flight still complete.
+void UringBackend::StopListening()
+{
+    m_is_listening = false;
+    auto cancel = [this](uint64_t user_data) {
+        io_uring_sqe* sqe = m_ring->GetSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = user_data;
+        sqe->user_data = MakeUserData(Operation::CancelListener, 0);
+    };
+    for (uint32_t listener = 0; listener < m_reactor.listeners.Streams().size(); ++listener)
+    {
+        cancel(MakeUserData(Operation::Accept, listener));
+        // the accept loop ends once resumed
+        if (m_accept_waiters[listener].handle)
+        {
+            std::exchange(m_accept_waiters[listener].handle, nullptr).resume();
+        }
+    }
+    for (uint32_t id = 0; id < m_udp_batches.size() * m_config.udp_batch_size; ++id)
+    {
+        cancel(MakeUserData(Operation::UdpRecv, id));
+    }
+    // suspended commands end so their connections can go quiet, the output they left is still sent
+    for (UringConnection& state : m_connections)
+    {
+        if (state.connection != nullptr && !state.is_closing)
+        {
+            ReleaseWaiters(*state.connection, false);
+        }
+    }
+    CloseQuiescent();
+}
+
+void UringBackend::CloseQuiescent()
+{
+    for (UringConnection& state : m_connections)
+    {
+        if (state.connection != nullptr && !state.is_closing && !state.is_sending && state.connection->IsQuiescent())
+        {
+            CloseConnection(state);
+        }
+    }
+}
+
+void UringBackend::HandleUdpRecv(uint32_t id, const io_uring_cqe& cqe)
+{
+    if (!m_handler.IsRunning() || (cqe.res == -ECANCELED && !m_is_listening))
+    {
+        return;
+    }
+    if (cqe.res < 0)
+    {
+        if (cqe.res != -EAGAIN && cqe.res != -EINTR)
+        {
+            LOG(m_logger, LogHelper::error, "UDP recvmsg error: " << strerror(-cqe.res));
+            m_metrics.Add(Counter::UdpErrors);
+        }
+        PostUdpRecv(id);
+        return;
+    }
+    UdpBatch& batch = m_udp_batches[id / m_config.udp_batch_size];
+    uint32_t slot = id % m_config.udp_batch_size;
+    batch.recv_messages[slot].msg_len = cqe.res;
+    if (batch.recv_messages[slot].msg_hdr.msg_flags & MSG_TRUNC)
+    {
+        LOG(m_logger, LogHelper::warning, "UDP datagram truncated to " << batch.datagram_size << " bytes");
+        m_metrics.Add(Counter::UdpErrors);
+    }
+    m_metrics.Add(Counter::UdpBytesIn, cqe.res);
+    std::string& response = batch.responses[slot];
+    response.clear();
+    std::string_view message = batch.Datagram(slot);
+    if (!message.empty())
+    {
+        m_handler.OnUDPData(batch.addresses[slot], message, response);
+    }
+    if (response.empty() || !batch.CanReply(slot))
+    {
+        if (m_is_listening)
+        {
+            PostUdpRecv(id);
+        }
+    }
+    else
+    {
+        PostUdpSend(id);
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ConnectionTimeouts.h"
+#include "Coroutine.h"
+#include "IoBackend.h"
+#include "Metrics.h"
+#include "IoUring.h"
+#include "Reactor.h"
+#include "ServerConfig.h"
+#include "UdpBatch.h"
+#include "../logging/Logging.h"
+
+// Completion based backend: multishot accept, multishot recv into a provided buffer ring and one
+// io_uring_enter per loop iteration that submits every queued send and waits for new completions.
+// Handlers run inline on the reactor thread, accepted clients go to one accept loop coroutine per listener.
+class UringBackend : public IoBackend
+{
+public:
+    UringBackend(Reactor& reactor, IoHandler& handler, Metrics& metrics, const ServerConfig& config);
+    ~UringBackend() override;
+    void Init() override;
+    void Run() override;
+    void Wakeup() override;
+    void Close() override;
+    TimerWheel& Timers() override;
+    void Reload(const ServerConfig& config) override;
+    void Drain() override;
+    bool Send(Connection& connection, uint32_t generation, OutputQueue& data) override;
+    void ResumeReading(Connection& connection, uint32_t generation) override;
+    bool WaitAccept(size_t listener, std::coroutine_handle<> handle, int& client) override;
+    bool WaitReadable(Connection& connection, uint32_t generation, size_t seen, std::coroutine_handle<> handle) override;
+    bool WaitWritable(Connection& connection, uint32_t generation, std::coroutine_handle<> handle) override;
+private:
+    enum class Operation : uint8_t
+    {
+        Wakeup,
+        Timer,
+        ProvideBuffers,
+        Accept,
+        Recv,
+        CancelRecv,
+        Send,
+        UdpRecv,
+        UdpSend,
+        CancelListener
+    };
+
+    // The in-flight SENDMSG points at iovecs and message, so they live as long as the connection.
+    struct UringConnection
+    {
+        Connection* connection {nullptr};
+        std::array<iovec, OutputQueue::max_iovecs> iovecs;
+        msghdr message {};
+        unsigned int inflight {0};
+        bool is_receiving {false};
+        bool is_sending {false};
+        bool is_closing {false};
+    };
+
+    static uint64_t MakeUserData(Operation operation, uint32_t id);
+    void PostWakeupRead();
+    void PostTimerRead();
+    void PostAccept(uint32_t listener);
+    void PostRecv(uint32_t id, UringConnection& connection);
+    void PostCancelRecv(uint32_t id);
+    void PostSend(uint32_t id, UringConnection& connection);
+    // UDP ids number the slots of every datagram listener: listener * udp_batch_size + slot
+    void PostUdpRecv(uint32_t id);
+    void PostUdpSend(uint32_t id);
+    void HandleCompletion(const io_uring_cqe& cqe);
+    void HandleAccept(uint32_t listener, const io_uring_cqe& cqe);
+    AsyncTask<> AcceptConnections(uint32_t listener);
+    void HandleRecv(uint32_t id, const io_uring_cqe& cqe);
+    void ProcessInput(uint32_t id, UringConnection& connection, bool is_drained);
+    void HandleSend(uint32_t id, const io_uring_cqe& cqe);
+    void HandleUdpRecv(uint32_t id, const io_uring_cqe& cqe);
+    void QueueResponses(uint32_t id, UringConnection& connection, OutputQueue& responses);
+    UringConnection* FindConnection(uint32_t client_socket);
+    // true while the connection takes input: not paused, and no command holds it unless one waits in AsyncRead
+    static bool IsReading(const Connection& connection);
+    void CloseConnection(UringConnection& connection);
+    void ReleaseIfDone(UringConnection& connection);
+    // Wakes the coroutines parked on the connection, which find it closed or their command cancelled, see
+    // Connection::CancelCommand.
+    void ReleaseWaiters(Connection& connection, bool is_closing);
+    // Resumes handle after the current batch of completions, the caller may be within OnTCPData.
+    void QueueResume(std::coroutine_handle<> handle);
+    void ResumeQueued();
+    void CheckTimeouts(int client_socket, uint32_t generation);
+    // Reactor thread side of Drain: StopListening once, then CloseQuiescent at every tick.
+    void StopListening();
+    void CloseQuiescent();
+
+    Reactor& m_reactor;
+    IoHandler& m_handler;
+    Metrics& m_metrics;
+    const ServerConfig& m_config;
+    std::unique_ptr<IoUring> m_ring;
+    std::unique_ptr<BufferRing> m_buffer_ring;
+    int m_event_fd;
+    uint64_t m_event_value;
+    int m_timer_fd;
+    uint64_t m_timer_value;
+    TimerWheel m_timers;
+    ConnectionTimeouts m_timeouts;
+    // The accept loop of one stream listener while it waits for a client.
+    struct AcceptWaiter
+    {
+        std::coroutine_handle<> handle;
+        int* client {nullptr};
+    };
+    // indexed like the stream listeners of the reactor
+    std::vector<AcceptWaiter> m_accept_waiters;
+    std::vector<std::coroutine_handle<>> m_resume_queue;
+    std::vector<std::coroutine_handle<>> m_resuming;
+    // one per datagram listener of the reactor, each slot has its own receive in flight
+    std::vector<UdpBatch> m_udp_batches;
+    std::atomic<bool> m_is_draining;
+    // cleared by StopListening, completions of accepts and datagram receives are not renewed any more
+    bool m_is_listening;
+    // indexed by descriptor, a deque keeps the in-flight iovecs in place when it grows
+    std::deque<UringConnection> m_connections;
+    mutable LogHelper::Logger m_logger;
+};